@@ -0,0 +1,300 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  File-Roller
+ *
+ *  Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef HAVE_LINUX_OPENAT2_H
+#include <sys/syscall.h>
+#include <linux/openat2.h>
+#endif
+#include <glib.h>
+#include <gio/gio.h>
+#include "dirfd-utils.h"
+#include "glib-utils.h"
+
+
+#define DIRFD_CACHE_MAX_SIZE 256
+
+
+struct _DirfdCache {
+	int               root_fd;
+	GHashTable       *dirs;         /* relative path -> fd */
+	DirfdCreatedFunc  created_func;
+	gpointer          user_data;
+	gboolean          use_openat2;
+	GMutex            mutex;
+};
+
+
+static void
+_close_fd (gpointer data)
+{
+	close (GPOINTER_TO_INT (data));
+}
+
+
+DirfdCache *
+dirfd_cache_new (const char        *root_path,
+		 DirfdCreatedFunc   created_func,
+		 gpointer           user_data,
+		 GError           **error)
+{
+	DirfdCache *cache;
+	int         root_fd;
+
+	root_fd = open (root_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (root_fd < 0) {
+		_g_set_error_from_errno (error, errno, root_path);
+		return NULL;
+	}
+
+	cache = g_new0 (DirfdCache, 1);
+	cache->root_fd = root_fd;
+	cache->dirs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, _close_fd);
+	cache->created_func = created_func;
+	cache->user_data = user_data;
+#ifdef HAVE_LINUX_OPENAT2_H
+	cache->use_openat2 = TRUE;
+#endif
+	g_mutex_init (&cache->mutex);
+
+	return cache;
+}
+
+
+void
+dirfd_cache_free (DirfdCache *cache)
+{
+	if (cache == NULL)
+		return;
+	g_hash_table_unref (cache->dirs);
+	close (cache->root_fd);
+	g_mutex_clear (&cache->mutex);
+	g_free (cache);
+}
+
+
+#ifdef HAVE_LINUX_OPENAT2_H
+
+/* Opens the whole path with a single call, failing if any component is a
+ * symbolic link or is outside the root folder. */
+static int
+_dirfd_cache_openat2 (DirfdCache *cache,
+		      const char *path)
+{
+	struct open_how how;
+	int             fd;
+
+	memset (&how, 0, sizeof (how));
+	how.flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+	how.resolve = RESOLVE_BENEATH | RESOLVE_NO_SYMLINKS;
+	fd = syscall (SYS_openat2, cache->root_fd, path, &how, sizeof (how));
+	if ((fd < 0) && ((errno == ENOSYS) || (errno == EPERM) || (errno == E2BIG)))
+		cache->use_openat2 = FALSE;
+
+	return fd;
+}
+
+#endif
+
+
+/* Returns the fd of the folder @path, creating it if needed, @path must be
+ * normalized.  The fd is owned by the cache. */
+static int
+_dirfd_cache_open_dir (DirfdCache  *cache,
+		       const char  *path,
+		       GError     **error)
+{
+	gpointer         value;
+	g_autofree char *parent_path = NULL;
+	const char      *name;
+	int              parent_fd;
+	int              fd;
+
+	if (*path == '\0')
+		return cache->root_fd;
+
+	if (g_hash_table_lookup_extended (cache->dirs, path, NULL, &value))
+		return GPOINTER_TO_INT (value);
+
+	fd = -1;
+#ifdef HAVE_LINUX_OPENAT2_H
+	if (cache->use_openat2)
+		fd = _dirfd_cache_openat2 (cache, path);
+#endif
+
+	if (fd < 0) {
+		name = strrchr (path, '/');
+		if (name != NULL) {
+			parent_path = g_strndup (path, name - path);
+			name++;
+		}
+		else
+			name = path;
+
+		parent_fd = _dirfd_cache_open_dir (cache, (parent_path != NULL) ? parent_path : "", error);
+		if (parent_fd < 0)
+			return -1;
+
+		fd = openat (parent_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+		if ((fd < 0) && (errno == ENOENT)) {
+			if (mkdirat (parent_fd, name, 0777) == 0) {
+				if (cache->created_func != NULL)
+					cache->created_func (path, cache->user_data);
+			}
+			else if (errno != EEXIST) {
+				_g_set_error_from_errno (error, errno, path);
+				return -1;
+			}
+			fd = openat (parent_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+		}
+		if (fd < 0) {
+			int         errsv = errno;
+			struct stat st;
+
+			/* O_NOFOLLOW with O_DIRECTORY can fail with ENOTDIR
+			 * for a symbolic link */
+			if ((errsv == ENOTDIR)
+			    && (fstatat (parent_fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0)
+			    && S_ISLNK (st.st_mode))
+			{
+				errsv = ELOOP;
+			}
+			_g_set_error_from_errno (error, errsv, path);
+			return -1;
+		}
+	}
+
+	g_hash_table_insert (cache->dirs, g_strdup (path), GINT_TO_POINTER (fd));
+
+	return fd;
+}
+
+
+/* Returns @relative_path without the empty and '.' components. */
+static char *
+_normalize_path (const char *relative_path)
+{
+	char       *path;
+	char       *dest;
+	const char *src;
+
+	path = g_malloc (strlen (relative_path) + 1);
+	dest = path;
+	src = relative_path;
+	while (*src != '\0') {
+		const char *end = strchr (src, '/');
+
+		if (end == NULL)
+			end = src + strlen (src);
+
+		if ((end > src) && ! ((end - src == 1) && (*src == '.'))) {
+			if (dest > path)
+				*dest++ = '/';
+			memcpy (dest, src, end - src);
+			dest += end - src;
+		}
+		src = (*end == '/') ? end + 1 : end;
+	}
+	*dest = '\0';
+
+	return path;
+}
+
+
+/* Returns a new fd for the parent folder of @relative_path, that must be
+ * closed by the caller, creating the missing folders.  @name is set to the
+ * last component of the path.  A symbolic link in the parents results in a
+ * G_IO_ERROR_TOO_MANY_LINKS error. */
+int
+dirfd_cache_open_parent (DirfdCache  *cache,
+			 const char  *relative_path,
+			 char       **name,
+			 GError     **error)
+{
+	g_autofree char *path = NULL;
+	char            *last_slash;
+	int              fd;
+
+	path = _normalize_path (relative_path);
+	last_slash = strrchr (path, '/');
+	if (last_slash != NULL) {
+		*last_slash = '\0';
+		*name = g_strdup (last_slash + 1);
+	}
+	else {
+		*name = g_strdup ((*path != '\0') ? path : ".");
+		*path = '\0';
+	}
+
+	g_mutex_lock (&cache->mutex);
+	if (g_hash_table_size (cache->dirs) >= DIRFD_CACHE_MAX_SIZE)
+		g_hash_table_remove_all (cache->dirs);
+	fd = _dirfd_cache_open_dir (cache, path, error);
+	if (fd >= 0) {
+		fd = fcntl (fd, F_DUPFD_CLOEXEC, 0);
+		if (fd < 0)
+			_g_set_error_from_errno (error, errno, path);
+	}
+	g_mutex_unlock (&cache->mutex);
+
+	if (fd < 0)
+		g_clear_pointer (name, g_free);
+
+	return fd;
+}
+
+
+static gboolean
+_path_is_in_folder (gpointer key,
+		    gpointer value,
+		    gpointer user_data)
+{
+	const char *path = key;
+	const char *folder = user_data;
+	gsize       folder_len = strlen (folder);
+
+	return (strncmp (path, folder, folder_len) == 0)
+		&& ((path[folder_len] == '\0') || (path[folder_len] == '/'));
+}
+
+
+/* Forgets the folder @relative_path and its subfolders, to be called before
+ * the folder is removed. */
+void
+dirfd_cache_remove (DirfdCache *cache,
+		    const char *relative_path)
+{
+	g_autofree char *path = NULL;
+
+	path = _normalize_path (relative_path);
+	if (*path == '\0')
+		return;
+
+	g_mutex_lock (&cache->mutex);
+	g_hash_table_foreach_remove (cache->dirs, _path_is_in_folder, path);
+	g_mutex_unlock (&cache->mutex);
+}
@@ -0,0 +1,53 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  File-Roller
+ *
+ *  Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DIRFD_UTILS_H
+#define DIRFD_UTILS_H
+
+#include <glib.h>
+#include <gio/gio.h>
+
+/* DirfdCache: the folders below a local root folder, opened once and kept
+ * open, used to create files with openat and the other *at functions.
+ * Paths are resolved one component at a time without following symbolic
+ * links, so nothing is created outside the root folder.  All the functions
+ * are thread safe. */
+
+typedef struct _DirfdCache DirfdCache;
+
+typedef void (*DirfdCreatedFunc) (const char *relative_path,
+				  gpointer    user_data);
+
+DirfdCache * dirfd_cache_new         (const char        *root_path,
+				      DirfdCreatedFunc   created_func,
+				      gpointer           user_data,
+				      GError           **error);
+void         dirfd_cache_free        (DirfdCache        *cache);
+int          dirfd_cache_open_parent (DirfdCache        *cache,
+				      const char        *relative_path,
+				      char             **name,
+				      GError           **error);
+void         dirfd_cache_remove      (DirfdCache        *cache,
+				      const char        *relative_path);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (DirfdCache, dirfd_cache_free)
+
+#endif /* DIRFD_UTILS_H */
@@ -54,6 +54,8 @@ gboolean            _g_file_remove_directory              (GFile         *direct
 							   GError       **error);
 GFile *             _g_file_new_user_config_subdir        (const char  *child_name,
 						    	   gboolean     create_);
+GFile *             _g_file_new_user_cache_subdir         (const char  *child_name,
+							   gboolean     create_child);
 GFile *             _g_file_get_dir_content_if_unique     (GFile       *file);
 guint64             _g_file_get_free_space                (GFile       *file);
 GFile *             _g_file_get_temp_work_dir             (GFile       *parent_folder);
@@ -0,0 +1,627 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  File-Roller
+ *
+ *  Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+#include <gio/gio.h>
+#include "file-utils.h"
+#include "fr-archive-cache.h"
+#include "fr-file-data.h"
+#include "glib-utils.h"
+
+
+/* Cache file format, numbers are little endian, strings are stored as a
+ * 32 bit length followed by the bytes, without the terminator:
+ *
+ * "FRL1"
+ * key length (32 bit), key
+ * multi_volume (8 bit)
+ * number of files (32 bit)
+ * for each file:
+ *   flags (8 bit), see CacheFlags
+ *   size (64 bit)
+ *   modified (64 bit)
+ *   full_path
+ *   original_path, only if neither CACHE_ORIGINAL_IS_FULL_PATH nor
+ *                  CACHE_ORIGINAL_IS_RELATIVE_PATH is set
+ *   name
+ *   path
+ *   link, only if CACHE_HAS_LINK is set
+ */
+
+
+#define CACHE_MAGIC          "FRL1"
+#define CACHE_MAGIC_SIZE     4
+#define CACHE_DIR_NAME       "file-roller/listing"
+#define CACHE_MAX_SIZE       (64 * 1024 * 1024)
+#define KEY_DATA_SAMPLE_SIZE (64 * 1024)
+
+
+typedef enum {
+	CACHE_DIR                       = 1 << 0,
+	CACHE_ENCRYPTED                 = 1 << 1,
+	CACHE_HAS_LINK                  = 1 << 2,
+	CACHE_ORIGINAL_IS_FULL_PATH     = 1 << 3,  /* original_path == full_path */
+	CACHE_ORIGINAL_IS_RELATIVE_PATH = 1 << 4   /* original_path == full_path + 1 */
+} CacheFlags;
+
+
+static GFile *
+_fr_archive_cache_get_file (FrArchive *archive,
+			    gboolean   create_dir)
+{
+	g_autoptr (GFile) dir = NULL;
+	g_autofree char  *uri = NULL;
+	g_autofree char  *name = NULL;
+
+	dir = _g_file_new_user_cache_subdir (CACHE_DIR_NAME, create_dir);
+	if (dir == NULL)
+		return NULL;
+
+	uri = g_file_get_uri (fr_archive_get_file (archive));
+	name = g_compute_checksum_for_string (G_CHECKSUM_SHA256, uri, -1);
+
+	return g_file_get_child (dir, name);
+}
+
+
+/* -- writing -- */
+
+
+static void
+_g_byte_array_append_uint8 (GByteArray *array,
+			    guint8      value)
+{
+	g_byte_array_append (array, &value, 1);
+}
+
+
+static void
+_g_byte_array_append_uint32 (GByteArray *array,
+			     guint32     value)
+{
+	value = GUINT32_TO_LE (value);
+	g_byte_array_append (array, (guint8 *) &value, 4);
+}
+
+
+static void
+_g_byte_array_append_uint64 (GByteArray *array,
+			     guint64     value)
+{
+	value = GUINT64_TO_LE (value);
+	g_byte_array_append (array, (guint8 *) &value, 8);
+}
+
+
+static void
+_g_byte_array_append_string (GByteArray *array,
+			     const char *value)
+{
+	gsize size = (value != NULL) ? strlen (value) : 0;
+
+	_g_byte_array_append_uint32 (array, size);
+	g_byte_array_append (array, (guint8 *) value, size);
+}
+
+
+/* -- reading -- */
+
+
+typedef struct {
+	const guint8 *p;
+	const guint8 *end;
+	gboolean      error;
+} CacheReader;
+
+
+static const guint8 *
+cache_reader_get_data (CacheReader *reader,
+		       gsize        size)
+{
+	const guint8 *data;
+
+	if (reader->error || ((gsize) (reader->end - reader->p) < size)) {
+		reader->error = TRUE;
+		return NULL;
+	}
+
+	data = reader->p;
+	reader->p += size;
+
+	return data;
+}
+
+
+static guint8
+cache_reader_get_uint8 (CacheReader *reader)
+{
+	const guint8 *data = cache_reader_get_data (reader, 1);
+	return (data != NULL) ? data[0] : 0;
+}
+
+
+static guint32
+cache_reader_get_uint32 (CacheReader *reader)
+{
+	const guint8 *data = cache_reader_get_data (reader, 4);
+	guint32       value;
+
+	if (data == NULL)
+		return 0;
+	memcpy (&value, data, 4);
+
+	return GUINT32_FROM_LE (value);
+}
+
+
+static guint64
+cache_reader_get_uint64 (CacheReader *reader)
+{
+	const guint8 *data = cache_reader_get_data (reader, 8);
+	guint64       value;
+
+	if (data == NULL)
+		return 0;
+	memcpy (&value, data, 8);
+
+	return GUINT64_FROM_LE (value);
+}
+
+
+static char *
+cache_reader_get_string (CacheReader *reader)
+{
+	guint32       size;
+	const guint8 *data;
+
+	size = cache_reader_get_uint32 (reader);
+	data = cache_reader_get_data (reader, size);
+	if (data == NULL)
+		return NULL;
+
+	return g_strndup ((const char *) data, size);
+}
+
+
+/* -- key -- */
+
+
+static gboolean
+_g_input_stream_checksum_range (GInputStream  *istream,
+				goffset        offset,
+				gsize          size,
+				GChecksum     *checksum,
+				GCancellable  *cancellable)
+{
+	g_autofree guint8 *buffer = NULL;
+	gsize              bytes_read;
+
+	if (! g_seekable_seek (G_SEEKABLE (istream), offset, G_SEEK_SET, cancellable, NULL))
+		return FALSE;
+
+	buffer = g_malloc (size);
+	if (! g_input_stream_read_all (istream, buffer, size, &bytes_read, cancellable, NULL))
+		return FALSE;
+	g_checksum_update (checksum, buffer, bytes_read);
+
+	return TRUE;
+}
+
+
+/* Returns NULL if the archive cannot be identified, for example if it's a
+ * remote file. */
+GBytes *
+fr_archive_cache_get_key (FrArchive    *archive,
+			  GCancellable *cancellable)
+{
+	GFile      *file;
+	g_autoptr (GFileInfo) info = NULL;
+	g_autoptr (GInputStream) istream = NULL;
+	g_autoptr (GChecksum) checksum = NULL;
+	GByteArray *key;
+	goffset     size;
+	goffset     tail_offset;
+	guint8      digest[32];
+	gsize       digest_size = sizeof (digest);
+
+	file = fr_archive_get_file (archive);
+	if ((file == NULL) || ! g_file_is_native (file))
+		return NULL;
+
+	info = g_file_query_info (file,
+				  G_FILE_ATTRIBUTE_UNIX_DEVICE ","
+				  G_FILE_ATTRIBUTE_UNIX_INODE ","
+				  G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+				  G_FILE_QUERY_INFO_NONE,
+				  cancellable,
+				  NULL);
+	if ((info == NULL) || ! g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_UNIX_INODE))
+		return NULL;
+
+	/* a checksum of the start and the end of the file, where the
+	 * archive headers and the directory usually are. */
+
+	istream = (GInputStream *) g_file_read (file, cancellable, NULL);
+	if (istream == NULL)
+		return NULL;
+
+	size = g_file_info_get_size (info);
+	checksum = g_checksum_new (G_CHECKSUM_SHA256);
+	if (! _g_input_stream_checksum_range (istream, 0, MIN (size, KEY_DATA_SAMPLE_SIZE), checksum, cancellable))
+		return NULL;
+	tail_offset = MAX (size - KEY_DATA_SAMPLE_SIZE, KEY_DATA_SAMPLE_SIZE);
+	if ((size > tail_offset) && ! _g_input_stream_checksum_range (istream, tail_offset, size - tail_offset, checksum, cancellable))
+		return NULL;
+	g_checksum_get_digest (checksum, digest, &digest_size);
+
+	key = g_byte_array_new ();
+	_g_byte_array_append_uint32 (key, g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_DEVICE));
+	_g_byte_array_append_uint64 (key, g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE));
+	_g_byte_array_append_uint64 (key, size);
+	_g_byte_array_append_uint64 (key, g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED));
+	_g_byte_array_append_uint32 (key, g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC));
+	g_byte_array_append (key, digest, digest_size);
+	_g_byte_array_append_string (key, archive->mime_type);
+	_g_byte_array_append_string (key, G_OBJECT_TYPE_NAME (archive));
+
+	return g_byte_array_free_to_bytes (key);
+}
+
+
+/* -- prune -- */
+
+
+typedef struct {
+	char    *name;
+	goffset  size;
+	guint64  modified;
+} CacheEntry;
+
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+	g_free (entry->name);
+	g_free (entry);
+}
+
+
+static int
+cache_entry_compare_by_time (gconstpointer a,
+			     gconstpointer b)
+{
+	const CacheEntry *entry_a = * (CacheEntry **) a;
+	const CacheEntry *entry_b = * (CacheEntry **) b;
+
+	if (entry_a->modified < entry_b->modified)
+		return -1;
+	if (entry_a->modified > entry_b->modified)
+		return 1;
+	return 0;
+}
+
+
+/* Deletes the least recently used entries if the size of the cache exceeds
+ * CACHE_MAX_SIZE. */
+static void
+_fr_archive_cache_prune (GCancellable *cancellable)
+{
+	g_autoptr (GFile)           dir = NULL;
+	g_autoptr (GFileEnumerator) enumerator = NULL;
+	g_autoptr (GPtrArray)       entries = NULL;
+	GFileInfo                  *info;
+	goffset                     total_size;
+	guint                       i;
+
+	dir = _g_file_new_user_cache_subdir (CACHE_DIR_NAME, FALSE);
+	if (dir == NULL)
+		return;
+
+	enumerator = g_file_enumerate_children (dir,
+						G_FILE_ATTRIBUTE_STANDARD_NAME ","
+						G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+						G_FILE_ATTRIBUTE_TIME_MODIFIED,
+						G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+						cancellable,
+						NULL);
+	if (enumerator == NULL)
+		return;
+
+	entries = g_ptr_array_new_with_free_func ((GDestroyNotify) cache_entry_free);
+	total_size = 0;
+	while ((info = g_file_enumerator_next_file (enumerator, cancellable, NULL)) != NULL) {
+		CacheEntry *entry;
+
+		entry = g_new (CacheEntry, 1);
+		entry->name = g_strdup (g_file_info_get_name (info));
+		entry->size = g_file_info_get_size (info);
+		entry->modified = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+		g_ptr_array_add (entries, entry);
+		total_size += entry->size;
+		g_object_unref (info);
+	}
+
+	if (total_size <= CACHE_MAX_SIZE)
+		return;
+
+	g_ptr_array_sort (entries, cache_entry_compare_by_time);
+	for (i = 0; (i < entries->len) && (total_size > CACHE_MAX_SIZE); i++) {
+		CacheEntry       *entry = g_ptr_array_index (entries, i);
+		g_autoptr (GFile) file = g_file_get_child (dir, entry->name);
+
+		if (g_file_delete (file, cancellable, NULL))
+			total_size -= entry->size;
+	}
+}
+
+
+/* -- load -- */
+
+
+static FrFileData *
+cache_reader_get_file_data (CacheReader *reader)
+{
+	FrFileData *file_data;
+	CacheFlags  flags;
+
+	file_data = fr_file_data_new ();
+
+	flags = cache_reader_get_uint8 (reader);
+	file_data->dir = (flags & CACHE_DIR) != 0;
+	file_data->encrypted = (flags & CACHE_ENCRYPTED) != 0;
+	file_data->size = (goffset) cache_reader_get_uint64 (reader);
+	file_data->modified = (time_t) cache_reader_get_uint64 (reader);
+
+	file_data->full_path = cache_reader_get_string (reader);
+	if (flags & CACHE_ORIGINAL_IS_FULL_PATH)
+		file_data->original_path = file_data->full_path;
+	else if (flags & CACHE_ORIGINAL_IS_RELATIVE_PATH)
+		file_data->original_path = (file_data->full_path != NULL) ? file_data->full_path + 1 : NULL;
+	else {
+		file_data->original_path = cache_reader_get_string (reader);
+		file_data->free_original_path = TRUE;
+	}
+	file_data->name = cache_reader_get_string (reader);
+	file_data->path = cache_reader_get_string (reader);
+	if (flags & CACHE_HAS_LINK)
+		file_data->link = cache_reader_get_string (reader);
+
+	if (reader->error || (file_data->full_path == NULL) || (*file_data->full_path == '\0')) {
+		reader->error = TRUE;
+		fr_file_data_free (file_data);
+		return NULL;
+	}
+
+	return file_data;
+}
+
+
+static gboolean
+_fr_archive_cache_load_file (FrArchive    *archive,
+			     GFile        *cache_file,
+			     GBytes       *key,
+			     GCancellable *cancellable)
+{
+	g_autofree char      *contents = NULL;
+	gsize                 size;
+	CacheReader           reader;
+	const guint8         *data;
+	guint32               key_size;
+	gboolean              multi_volume;
+	guint32               n_files;
+	g_autoptr (GPtrArray) files = NULL;
+	guint32               i;
+
+	if (! g_file_load_contents (cache_file, cancellable, &contents, &size, NULL, NULL))
+		return FALSE;
+
+	reader.p = (guint8 *) contents;
+	reader.end = reader.p + size;
+	reader.error = FALSE;
+
+	data = cache_reader_get_data (&reader, CACHE_MAGIC_SIZE);
+	if ((data == NULL) || (memcmp (data, CACHE_MAGIC, CACHE_MAGIC_SIZE) != 0))
+		return FALSE;
+
+	key_size = cache_reader_get_uint32 (&reader);
+	data = cache_reader_get_data (&reader, key_size);
+	if ((data == NULL)
+	    || (key_size != g_bytes_get_size (key))
+	    || (memcmp (data, g_bytes_get_data (key, NULL), key_size) != 0))
+	{
+		return FALSE;
+	}
+
+	/* the multi-volume archives are not cached, the list operation
+	 * locates the first volume. */
+	multi_volume = cache_reader_get_uint8 (&reader) != 0;
+	n_files = cache_reader_get_uint32 (&reader);
+	if (reader.error || multi_volume)
+		return FALSE;
+
+	files = g_ptr_array_new_full (MIN (n_files, size / 16), (GDestroyNotify) fr_file_data_free);
+	for (i = 0; i < n_files; i++) {
+		FrFileData *file_data;
+
+		if (g_cancellable_is_cancelled (cancellable))
+			return FALSE;
+
+		file_data = cache_reader_get_file_data (&reader);
+		if (file_data == NULL)
+			return FALSE;
+		g_ptr_array_add (files, file_data);
+	}
+
+	if (reader.p != reader.end)
+		return FALSE;
+
+	archive->multi_volume = multi_volume;
+	g_ptr_array_set_free_func (files, NULL);
+	for (i = 0; i < files->len; i++)
+		fr_archive_add_file (archive, g_ptr_array_index (files, i));
+
+	return TRUE;
+}
+
+
+/* Adds the cached files to the archive, only if the cache is valid for the
+ * given key.  An invalid cache is deleted, and the oldest entries are
+ * removed to make room for the new one.  Can be called from a thread. */
+gboolean
+fr_archive_cache_load (FrArchive    *archive,
+		       GBytes       *key,
+		       GCancellable *cancellable)
+{
+	g_autoptr (GFile) cache_file = NULL;
+
+	cache_file = _fr_archive_cache_get_file (archive, FALSE);
+	if (cache_file == NULL)
+		return FALSE;
+
+	if (_fr_archive_cache_load_file (archive, cache_file, key, cancellable)) {
+		/* the modification time orders the entries by last use */
+		g_file_set_attribute_uint64 (cache_file,
+					     G_FILE_ATTRIBUTE_TIME_MODIFIED,
+					     g_get_real_time () / G_USEC_PER_SEC,
+					     G_FILE_QUERY_INFO_NONE,
+					     cancellable,
+					     NULL);
+		return TRUE;
+	}
+
+	if (g_cancellable_is_cancelled (cancellable))
+		return FALSE;
+
+	g_file_delete (cache_file, NULL, NULL);
+	_fr_archive_cache_prune (cancellable);
+
+	return FALSE;
+}
+
+
+/* -- save -- */
+
+
+typedef struct {
+	GFile     *cache_file;
+	GBytes    *key;
+	GPtrArray *files;
+} SaveData;
+
+
+static void
+save_data_free (SaveData *save_data)
+{
+	g_object_unref (save_data->cache_file);
+	g_bytes_unref (save_data->key);
+	g_ptr_array_unref (save_data->files);
+	g_free (save_data);
+}
+
+
+static gpointer
+save_thread (gpointer user_data)
+{
+	SaveData   *save_data = user_data;
+	GPtrArray  *files = save_data->files;
+	GBytes     *key = save_data->key;
+	GByteArray *contents;
+	guint       i;
+
+	contents = g_byte_array_new ();
+	g_byte_array_append (contents, (guint8 *) CACHE_MAGIC, CACHE_MAGIC_SIZE);
+	_g_byte_array_append_uint32 (contents, g_bytes_get_size (key));
+	g_byte_array_append (contents, g_bytes_get_data (key, NULL), g_bytes_get_size (key));
+	_g_byte_array_append_uint8 (contents, 0);
+	_g_byte_array_append_uint32 (contents, files->len);
+
+	for (i = 0; i < files->len; i++) {
+		FrFileData *file_data = g_ptr_array_index (files, i);
+		CacheFlags  flags = 0;
+
+		if (file_data->dir)
+			flags |= CACHE_DIR;
+		if (file_data->encrypted)
+			flags |= CACHE_ENCRYPTED;
+		if (file_data->link != NULL)
+			flags |= CACHE_HAS_LINK;
+		if (g_strcmp0 (file_data->original_path, file_data->full_path) == 0)
+			flags |= CACHE_ORIGINAL_IS_FULL_PATH;
+		else if ((file_data->full_path != NULL) && (g_strcmp0 (file_data->original_path, file_data->full_path + 1) == 0))
+			flags |= CACHE_ORIGINAL_IS_RELATIVE_PATH;
+
+		_g_byte_array_append_uint8 (contents, flags);
+		_g_byte_array_append_uint64 (contents, file_data->size);
+		_g_byte_array_append_uint64 (contents, file_data->modified);
+		_g_byte_array_append_string (contents, file_data->full_path);
+		if ((flags & (CACHE_ORIGINAL_IS_FULL_PATH | CACHE_ORIGINAL_IS_RELATIVE_PATH)) == 0)
+			_g_byte_array_append_string (contents, file_data->original_path);
+		_g_byte_array_append_string (contents, file_data->name);
+		_g_byte_array_append_string (contents, file_data->path);
+		if (file_data->link != NULL)
+			_g_byte_array_append_string (contents, file_data->link);
+	}
+
+	g_file_replace_contents (save_data->cache_file,
+				 (char *) contents->data,
+				 contents->len,
+				 NULL,
+				 FALSE,
+				 G_FILE_CREATE_PRIVATE,
+				 NULL,
+				 NULL,
+				 NULL);
+
+	g_byte_array_unref (contents);
+	save_data_free (save_data);
+
+	return NULL;
+}
+
+
+/* Saves the files of the archive in a thread, the archive files must not be
+ * changed until the returned thread is joined.  Returns NULL if the cache
+ * is not saved.  Multi-volume archives are not cached. */
+GThread *
+fr_archive_cache_save (FrArchive *archive,
+		       GBytes    *key)
+{
+	GFile    *cache_file;
+	SaveData *save_data;
+
+	if (archive->multi_volume)
+		return NULL;
+
+	cache_file = _fr_archive_cache_get_file (archive, TRUE);
+	if (cache_file == NULL)
+		return NULL;
+
+	save_data = g_new (SaveData, 1);
+	save_data->cache_file = cache_file;
+	save_data->key = g_bytes_ref (key);
+	save_data->files = g_ptr_array_ref (archive->files);
+
+	return g_thread_new ("fr-archive-cache", save_thread, save_data);
+}
@@ -0,0 +1,43 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  File-Roller
+ *
+ *  Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FR_ARCHIVE_CACHE_H
+#define FR_ARCHIVE_CACHE_H
+
+#include <glib.h>
+#include <gio/gio.h>
+#include "fr-archive.h"
+
+/* The listing cache saves the content of an archive, to avoid reading it
+ * again when the archive is opened another time.  The cache is valid for
+ * the archive identified by the key, that is the same file (device and
+ * inode), with the same size, modification time and the same data at the
+ * start and at the end of the file, opened with the same backend. */
+
+GBytes *   fr_archive_cache_get_key (FrArchive     *archive,
+				     GCancellable  *cancellable);
+gboolean   fr_archive_cache_load    (FrArchive     *archive,
+				     GBytes        *key,
+				     GCancellable  *cancellable);
+GThread *  fr_archive_cache_save    (FrArchive     *archive,
+				     GBytes        *key);
+
+#endif /* FR_ARCHIVE_CACHE_H */
@@ -21,21 +21,38 @@
 
 #include <config.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef HAVE_SYS_VFS_H
+#include <sys/vfs.h>
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <pwd.h>
 #include <grp.h>
 #include <glib.h>
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <gio/gio.h>
 #include <archive.h>
 #include <archive_entry.h>
+#include "dirfd-utils.h"
 #include "fr-file-data.h"
 #include "file-utils.h"
 #include "fr-error.h"
 #include "fr-archive-libarchive.h"
+#include "fr-archive-cache.h"
 #include "gio-utils.h"
 #include "glib-utils.h"
+#include "gzip-utils.h"
+#include "tar-utils.h"
 #include "typedefs.h"
+#include "uring-utils.h"
+#include "zip-utils.h"
 
 
 #define BUFFER_SIZE (64 * 1024)
@@ -76,7 +93,6 @@ G_DEFINE_AUTOPTR_CLEANUP_FUNC(_archive_entry_ctx, _archive_entry_ctx_free)
 
 typedef struct {
 	gssize compressed_size;
-	gssize uncompressed_size;
 } FrArchiveLibarchivePrivate;
 
 
@@ -225,509 +241,2524 @@ fr_archive_libarchive_get_packages (FrArchive  *archive,
 }
 
 
-/* LoadData */
+/* -- archive journal --
+ *
+ * Some operations modify the archive in place: appending entries overwrites
+ * the tar end-of-archive blocks or the zip central directory, renaming zip
+ * entries overwrites their local headers.  The regions that will be
+ * overwritten are saved in a journal first, if the operation fails or the
+ * application is killed, the archive is restored the next time it's loaded. */
 
 
-#define LOAD_DATA(x) ((LoadData *)(x))
+#define ARCHIVE_JOURNAL_MAGIC "FRJ3"
 
 
-typedef struct {
-	FrArchive          *archive;
-	GCancellable       *cancellable;
-	GSimpleAsyncResult *result;
-	GInputStream       *istream;
-	void               *buffer;
-	gssize              buffer_size;
-	GError             *error;
-} LoadData;
+/* The archives modified by this process, the journal of an active
+ * operation must not be restored. */
+static GMutex      journal_mutex;
+static GHashTable *active_journals = NULL;
 
 
 static void
-load_data_init (LoadData *load_data)
+_archive_journal_set_active (GFile    *archive_file,
+			     gboolean  active)
 {
-	load_data->buffer_size = BUFFER_SIZE;
-	load_data->buffer = g_new (char, load_data->buffer_size);
+	g_mutex_lock (&journal_mutex);
+	if (active_journals == NULL)
+		active_journals = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal, g_object_unref, NULL);
+	if (active)
+		g_hash_table_add (active_journals, g_object_ref (archive_file));
+	else
+		g_hash_table_remove (active_journals, archive_file);
+	g_mutex_unlock (&journal_mutex);
 }
 
 
-static void
-load_data_free (LoadData *load_data)
+static gboolean
+_archive_journal_is_active (GFile *archive_file)
 {
-	_g_object_unref (load_data->archive);
-	_g_object_unref (load_data->cancellable);
-	_g_object_unref (load_data->result);
-	_g_object_unref (load_data->istream);
-	g_free (load_data->buffer);
-	g_free (load_data);
-}
-
-G_DEFINE_AUTOPTR_CLEANUP_FUNC (LoadData, load_data_free)
-
+	gboolean active;
 
-static int
-load_data_open (struct archive *a,
-		void           *client_data)
-{
-	LoadData *load_data = client_data;
+	g_mutex_lock (&journal_mutex);
+	active = (active_journals != NULL) && g_hash_table_contains (active_journals, archive_file);
+	g_mutex_unlock (&journal_mutex);
 
-	if (load_data->error != NULL)
-		return ARCHIVE_FATAL;
+	return active;
+}
 
-	if (g_simple_async_result_get_source_tag (load_data->result) == fr_archive_list) {
-		FrArchiveLibarchivePrivate *private = fr_archive_libarchive_get_instance_private (FR_ARCHIVE_LIBARCHIVE (load_data->archive));
-		private->compressed_size = 0;
-		private->uncompressed_size = 0;
-	}
 
-	load_data->istream = (GInputStream *) g_file_read (fr_archive_get_file (load_data->archive),
-							   load_data->cancellable,
-							   &load_data->error);
-	return (load_data->error == NULL) ? ARCHIVE_OK : ARCHIVE_FATAL;
+/* Returns a string that identifies the process @pid even when its pid is
+ * reused by another process: the boot id and the process start time.
+ * Returns an empty string if they are not available, and NULL if the process
+ * doesn't exist. */
+static char *
+_get_process_identity (pid_t pid)
+{
+	g_autofree char *stat_path = NULL;
+	g_autofree char *stat = NULL;
+	g_autofree char *boot_id = NULL;
+	const char      *p;
+	int              i;
+
+	if (! g_file_test ("/proc/self/stat", G_FILE_TEST_EXISTS))
+		return g_strdup ("");
+
+	stat_path = g_strdup_printf ("/proc/%d/stat", (int) pid);
+	if (! g_file_get_contents (stat_path, &stat, NULL, NULL))
+		return NULL;
+
+	/* the command name can contain spaces, the start time is the 20th
+	 * field after the closing parenthesis. */
+	p = strrchr (stat, ')');
+	for (i = 0; (p != NULL) && (i < 20); i++)
+		p = strchr (p + 1, ' ');
+	if (p == NULL)
+		return g_strdup ("");
+
+	if (g_file_get_contents ("/proc/sys/kernel/random/boot_id", &boot_id, NULL, NULL))
+		g_strstrip (boot_id);
+
+	return g_strdup_printf ("%s:%" G_GUINT64_FORMAT,
+				(boot_id != NULL) ? boot_id : "",
+				g_ascii_strtoull (p + 1, NULL, 10));
 }
 
 
-static ssize_t
-load_data_read (struct archive  *a,
-		void            *client_data,
-		const void     **buff)
+/* Whether the operation that created the journal could still be running. */
+static gboolean
+_archive_journal_owner_is_running (GFile      *archive_file,
+				   guint32     pid,
+				   const char *owner)
 {
-	LoadData *load_data = client_data;
-	gssize    bytes;
-
-	if (load_data->error != NULL)
-		return -1;
+	g_autofree char *identity = NULL;
 
-	*buff = load_data->buffer;
-	bytes = g_input_stream_read (load_data->istream,
-				     load_data->buffer,
-				     load_data->buffer_size,
-				     load_data->cancellable,
-				     &load_data->error);
+	identity = _get_process_identity ((pid_t) pid);
+	if (identity == NULL)
+		return FALSE;
 
-	/* update the progress only if listing the content */
-	if (g_simple_async_result_get_source_tag (load_data->result) == fr_archive_list) {
-		FrArchiveLibarchivePrivate *private = fr_archive_libarchive_get_instance_private (FR_ARCHIVE_LIBARCHIVE (load_data->archive));
-		fr_archive_progress_set_completed_bytes (load_data->archive,
-							 g_seekable_tell (G_SEEKABLE (load_data->istream)));
-		private->compressed_size += bytes;
+	if ((*identity == '\0') || (*owner == '\0')) {
+		/* the process identity is not available, the pid could have
+		 * been reused. */
+		if ((pid_t) pid == getpid ())
+			return _archive_journal_is_active (archive_file);
+		return (kill ((pid_t) pid, 0) == 0) || (errno != ESRCH);
 	}
 
-	return bytes;
+	if (strcmp (identity, owner) != 0)
+		return FALSE;
+
+	if ((pid_t) pid == getpid ())
+		return _archive_journal_is_active (archive_file);
+
+	return TRUE;
 }
 
 
-static gint64
-load_data_seek (struct archive *a,
-		void           *client_data,
-		gint64          request,
-		int             whence)
+/* Flushes the data written to @path to the disk, @path can be a folder. */
+static gboolean
+_sync_path (const char  *path,
+	    GError     **error)
 {
-	GSeekable *seekable;
-	GSeekType  seektype;
-	off_t      new_offset;
+	int fd;
+	int errsv;
 
-	LoadData *load_data = client_data;
-
-	seekable = (GSeekable*)(load_data->istream);
-	if ((load_data->error != NULL) || (load_data->istream == NULL))
-		return -1;
+	fd = open (path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		_g_set_error_from_errno (error, errno, path);
+		return FALSE;
+	}
 
-	switch (whence) {
-	case SEEK_SET:
-		seektype = G_SEEK_SET;
-		break;
-	case SEEK_CUR:
-		seektype = G_SEEK_CUR;
-		break;
-	case SEEK_END:
-		seektype = G_SEEK_END;
-		break;
-	default:
-		return -1;
+	if (fsync (fd) != 0) {
+		errsv = errno;
+		close (fd);
+		_g_set_error_from_errno (error, errsv, path);
+		return FALSE;
 	}
 
-	g_seekable_seek (seekable,
-			 request,
-			 seektype,
-			 load_data->cancellable,
-			 &load_data->error);
-	new_offset = g_seekable_tell (seekable);
-	if (load_data->error != NULL)
-		return -1;
+	close (fd);
 
-	return new_offset;
+	return TRUE;
 }
 
 
-static gint64
-load_data_skip (struct archive *a,
-		void           *client_data,
-		gint64          request)
+/* Flushes the archive to the disk before its journal is removed.  Archives
+ * without a local path cannot be synced. */
+static gboolean
+_archive_sync (GFile   *archive_file,
+	       GError **error)
 {
-	GSeekable *seekable;
-	off_t      old_offset, new_offset;
-
-	LoadData *load_data = client_data;
+	g_autofree char *path = NULL;
 
-	seekable = (GSeekable*)(load_data->istream);
-	if (load_data->error != NULL || load_data->istream == NULL)
-		return -1;
-
-	old_offset = g_seekable_tell (seekable);
-	new_offset = load_data_seek (a, client_data, request, SEEK_CUR);
-	if (new_offset > old_offset)
-		return (new_offset - old_offset);
+	path = g_file_get_path (archive_file);
+	if (path == NULL)
+		return TRUE;
 
-	return 0;
+	return _sync_path (path, error);
 }
 
 
-
-static int
-load_data_close (struct archive *a,
-		 void           *client_data)
+static GFile *
+_archive_journal_get_file (GFile    *archive_file,
+			   gboolean  create_dir)
 {
-	LoadData *load_data = client_data;
+	g_autoptr (GFile) dir = NULL;
+	g_autofree char  *uri = NULL;
+	g_autofree char  *name = NULL;
 
-	if (load_data->error != NULL)
-		return ARCHIVE_FATAL;
+	dir = _g_file_new_user_cache_subdir ("file-roller/journal", create_dir);
+	if (dir == NULL)
+		return NULL;
 
-	if (load_data->istream != NULL) {
-		_g_object_unref (load_data->istream);
-		load_data->istream = NULL;
-	}
+	uri = g_file_get_uri (archive_file);
+	name = g_compute_checksum_for_string (G_CHECKSUM_SHA256, uri, -1);
 
-	return ARCHIVE_OK;
+	return g_file_get_child (dir, name);
 }
 
 
-static int
-create_read_object (LoadData        *load_data,
-                    _archive_read_ctx **a)
+/* The journal contains the file id, to make sure it's not applied to
+ * another file with the same name. */
+static char *
+_archive_journal_get_file_id (GFileIOStream  *iostream,
+			      GCancellable   *cancellable,
+			      GError        **error)
 {
-	*a = archive_read_new ();
-	archive_read_support_filter_all (*a);
-	archive_read_support_format_all (*a);
+	g_autoptr (GFileInfo) info = NULL;
+	const char *id;
 
-	archive_read_set_open_callback (*a, load_data_open);
-	archive_read_set_read_callback (*a, load_data_read);
-	archive_read_set_close_callback (*a, load_data_close);
-	archive_read_set_seek_callback (*a, load_data_seek);
-	archive_read_set_skip_callback (*a, load_data_skip);
-	archive_read_set_callback_data (*a, load_data);
+	info = g_file_io_stream_query_info (G_FILE_IO_STREAM (iostream), G_FILE_ATTRIBUTE_ID_FILE, cancellable, error);
+	if (info == NULL)
+		return NULL;
 
-	return archive_read_open1 (*a);
+	id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
+	if (id == NULL) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "The file id is not available");
+		return NULL;
+	}
+
+	return g_strdup (id);
 }
 
 
-/* -- list -- */
+static void
+_archive_journal_put32 (GByteArray *journal,
+			guint32     value)
+{
+	value = GUINT32_TO_LE (value);
+	g_byte_array_append (journal, (guint8 *) &value, 4);
+}
 
 
-static goffset
-_g_file_get_size (GFile        *file,
-		  GCancellable *cancellable)
+static void
+_archive_journal_put64 (GByteArray *journal,
+			guint64     value)
 {
-	g_autoptr (GFileInfo) info = NULL;
-	goffset    size;
-
-	info = g_file_query_info (file,
-				  G_FILE_ATTRIBUTE_STANDARD_SIZE,
-				  G_FILE_QUERY_INFO_NONE,
-				  cancellable,
-				  NULL);
-	if (info == NULL)
-		return 0;
+	value = GUINT64_TO_LE (value);
+	g_byte_array_append (journal, (guint8 *) &value, 8);
+}
 
-	size = g_file_info_get_size (info);
 
-	return size;
+static GByteArray *
+_archive_journal_new (GFileIOStream  *iostream,
+		      GCancellable   *cancellable,
+		      GError        **error)
+{
+	g_autofree char *id = NULL;
+	g_autofree char *owner = NULL;
+	GByteArray      *journal;
+
+	id = _archive_journal_get_file_id (iostream, cancellable, error);
+	if (id == NULL)
+		return NULL;
+
+	if (! g_seekable_seek (G_SEEKABLE (iostream), 0, G_SEEK_END, cancellable, error))
+		return NULL;
+
+	owner = _get_process_identity (getpid ());
+	if (owner == NULL)
+		owner = g_strdup ("");
+
+	journal = g_byte_array_new ();
+	g_byte_array_append (journal, (guint8 *) ARCHIVE_JOURNAL_MAGIC, 4);
+	_archive_journal_put32 (journal, (guint32) getpid ());
+	_archive_journal_put32 (journal, strlen (owner));
+	g_byte_array_append (journal, (guint8 *) owner, strlen (owner));
+	_archive_journal_put64 (journal, g_seekable_tell (G_SEEKABLE (iostream)));
+	_archive_journal_put32 (journal, strlen (id));
+	g_byte_array_append (journal, (guint8 *) id, strlen (id));
+
+	return journal;
 }
 
 
-static GError *
-_g_error_new_from_archive_error (const char *s)
+/* Saves the region of the archive that is going to be overwritten. */
+static gboolean
+_archive_journal_add_region (GByteArray     *journal,
+			     GFileIOStream  *iostream,
+			     guint64         offset,
+			     guint64         size,
+			     GCancellable   *cancellable,
+			     GError        **error)
 {
-	g_autofree char *msg = NULL;
-	GError *error;
+	guint  data_offset;
+	gsize  bytes_read;
 
-	msg = (s != NULL) ? g_locale_to_utf8 (s, -1, NULL, NULL, NULL) : NULL;
-	if (msg == NULL)
-		msg = g_strdup ("Fatal error");
-	error = g_error_new_literal (FR_ERROR, FR_ERROR_COMMAND_ERROR, msg);
+	if (! g_seekable_seek (G_SEEKABLE (iostream), offset, G_SEEK_SET, cancellable, error))
+		return FALSE;
 
-	return error;
+	_archive_journal_put64 (journal, offset);
+	_archive_journal_put64 (journal, size);
+	data_offset = journal->len;
+	g_byte_array_set_size (journal, data_offset + size);
+	if (! g_input_stream_read_all (g_io_stream_get_input_stream (G_IO_STREAM (iostream)), journal->data + data_offset, size, &bytes_read, cancellable, error))
+		return FALSE;
+
+	if (bytes_read < size) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid journal region");
+		return FALSE;
+	}
+
+	return TRUE;
 }
 
 
-static void
-list_archive_thread (GSimpleAsyncResult *result,
-		     GObject            *object,
-		     GCancellable       *cancellable)
+static gboolean
+_archive_journal_save (GByteArray     *journal,
+		       GFile          *archive_file,
+		       GCancellable   *cancellable,
+		       GError        **error)
 {
-	g_autoptr (LoadData) load_data = NULL;
-	g_autoptr (_archive_read_ctx) a = NULL;
-	struct archive_entry *entry;
-	int                   r;
+	g_autoptr (GFile) journal_file = NULL;
+	g_autofree char  *path = NULL;
+	g_autofree char  *tmp_path = NULL;
+	g_autofree char  *dir_path = NULL;
+	gsize             written;
+	int               fd;
+	int               errsv;
+
+	journal_file = _archive_journal_get_file (archive_file, TRUE);
+	path = (journal_file != NULL) ? g_file_get_path (journal_file) : NULL;
+	if (path == NULL) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED, "Cannot create the journal folder");
+		return FALSE;
+	}
 
-	load_data = g_simple_async_result_get_op_res_gpointer (result);
+	_archive_journal_set_active (archive_file, TRUE);
 
-	fr_archive_progress_set_total_bytes (load_data->archive,
-					     _g_file_get_size (fr_archive_get_file (load_data->archive), cancellable));
+	/* the journal must be on the disk before the archive is modified:
+	 * write a temporary file, sync it, rename it and sync the folder. */
 
-	r = create_read_object (load_data, &a);
-	if (r != ARCHIVE_OK) {
-		return;
+	tmp_path = g_strconcat (path, ".tmp", NULL);
+	fd = open (tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		_g_set_error_from_errno (error, errno, tmp_path);
+		return FALSE;
 	}
 
-	while ((r = archive_read_next_header (a, &entry)) == ARCHIVE_OK) {
-		FrFileData *file_data;
-		const char *pathname;
+	written = 0;
+	while (written < journal->len) {
+		gssize n;
 
-		if (g_cancellable_is_cancelled (cancellable))
+		n = write (fd, journal->data + written, journal->len - written);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
 			break;
-
-		file_data = fr_file_data_new ();
-
-		if (archive_entry_size_is_set (entry)) {
-			FrArchiveLibarchivePrivate *private = fr_archive_libarchive_get_instance_private (FR_ARCHIVE_LIBARCHIVE (load_data->archive));
-			file_data->size = archive_entry_size (entry);
-			private->uncompressed_size += file_data->size;
 		}
+		written += n;
+	}
 
-		if (archive_entry_mtime_is_set (entry))
-			file_data->modified =  archive_entry_mtime (entry);
-
-		if (archive_entry_filetype (entry) == AE_IFLNK)
-			file_data->link = g_strdup (archive_entry_symlink (entry));
-
-		pathname = archive_entry_pathname (entry);
-		if (*pathname == '/') {
-			file_data->full_path = g_strdup (pathname);
-			file_data->original_path = file_data->full_path;
-		}
-		else {
-			file_data->full_path = g_strconcat ("/", pathname, NULL);
-			file_data->original_path = file_data->full_path + 1;
-		}
+	if ((written < journal->len) || (fsync (fd) != 0)) {
+		errsv = errno;
+		close (fd);
+		g_unlink (tmp_path);
+		_g_set_error_from_errno (error, errsv, tmp_path);
+		return FALSE;
+	}
+	close (fd);
 
-		file_data->dir = (archive_entry_filetype (entry) == AE_IFDIR);
-		if (file_data->dir)
-			file_data->name = _g_path_get_dir_name (file_data->full_path);
-		else
-			file_data->name = g_strdup (_g_path_get_basename (file_data->full_path));
-		file_data->path = _g_path_remove_level (file_data->full_path);
-
-		/*
-		g_print ("%s\n", archive_entry_pathname (entry));
-		g_print ("\tfull_path: %s\n", file_data->full_path);
-		g_print ("\toriginal_path: %s\n", file_data->original_path);
-		g_print ("\tname: %s\n", file_data->name);
-		g_print ("\tpath: %s\n", file_data->path);
-		g_print ("\tlink: %s\n", file_data->link);
-		*/
+	if (g_rename (tmp_path, path) != 0) {
+		errsv = errno;
+		g_unlink (tmp_path);
+		_g_set_error_from_errno (error, errsv, path);
+		return FALSE;
+	}
 
-		fr_archive_add_file (load_data->archive, file_data);
+	if (g_cancellable_set_error_if_cancelled (cancellable, error))
+		return FALSE;
 
-		archive_read_data_skip (a);
-	}
+	dir_path = g_path_get_dirname (path);
 
-	if ((load_data->error == NULL) && (r != ARCHIVE_EOF) && (archive_error_string (a) != NULL))
-		load_data->error = _g_error_new_from_archive_error (archive_error_string (a));
-	if (load_data->error == NULL)
-		g_cancellable_set_error_if_cancelled (cancellable, &load_data->error);
-	if (load_data->error != NULL)
-		g_simple_async_result_set_from_error (result, load_data->error);
+	return _sync_path (dir_path, error);
 }
 
 
 static void
-fr_archive_libarchive_list (FrArchive           *archive,
-			    const char          *password,
-			    GCancellable        *cancellable,
-			    GAsyncReadyCallback  callback,
-			    gpointer             user_data)
+_archive_journal_remove (GFile *archive_file)
 {
-	LoadData *load_data;
-
-	load_data = g_new0 (LoadData, 1);
-	load_data_init (load_data);
+	g_autoptr (GFile) journal_file = NULL;
 
-	load_data->archive = g_object_ref (archive);
-	load_data->cancellable = _g_object_ref (cancellable);
-	load_data->result = g_simple_async_result_new (G_OBJECT (archive),
-						       callback,
-						       user_data,
-						       fr_archive_list);
+	_archive_journal_set_active (archive_file, FALSE);
 
-	g_simple_async_result_set_op_res_gpointer (load_data->result, load_data, NULL);
-	g_simple_async_result_run_in_thread (load_data->result,
-					     list_archive_thread,
-					     G_PRIORITY_DEFAULT,
-					     cancellable);
+	journal_file = _archive_journal_get_file (archive_file, FALSE);
+	if (journal_file != NULL)
+		g_file_delete (journal_file, NULL, NULL);
+}
+
+
+static gboolean
+_archive_journal_get32 (const guchar **p,
+			const guchar  *end,
+			guint32       *value)
+{
+	if (end - *p < 4)
+		return FALSE;
+	memcpy (value, *p, 4);
+	*value = GUINT32_FROM_LE (*value);
+	*p += 4;
+	return TRUE;
+}
+
+
+static gboolean
+_archive_journal_get64 (const guchar **p,
+			const guchar  *end,
+			guint64       *value)
+{
+	if (end - *p < 8)
+		return FALSE;
+	memcpy (value, *p, 8);
+	*value = GUINT64_FROM_LE (*value);
+	*p += 8;
+	return TRUE;
+}
+
+
+static gboolean
+_archive_journal_write_regions (const guchar   *p,
+				const guchar   *end,
+				GFileIOStream  *iostream,
+				GCancellable   *cancellable,
+				GError        **error)
+{
+	while (p < end) {
+		guint64 offset;
+		guint64 size;
+
+		if (! _archive_journal_get64 (&p, end, &offset)
+		    || ! _archive_journal_get64 (&p, end, &size)
+		    || (size > (guint64) (end - p)))
+		{
+			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid journal");
+			return FALSE;
+		}
+
+		if (! g_seekable_seek (G_SEEKABLE (iostream), offset, G_SEEK_SET, cancellable, error)
+		    || ! g_output_stream_write_all (g_io_stream_get_output_stream (G_IO_STREAM (iostream)), p, size, NULL, cancellable, error))
+		{
+			return FALSE;
+		}
+
+		p += size;
+	}
+
+	return TRUE;
+}
+
+
+/* Restores the regions saved in the journal, if any.  @iostream can be NULL,
+ * in which case the archive is opened here and the journal is applied only
+ * if the operation that created it is not running anymore. */
+static gboolean
+_archive_journal_restore (GFile          *archive_file,
+			  GFileIOStream  *iostream,
+			  GCancellable   *cancellable,
+			  GError        **error)
+{
+	g_autoptr (GFile)         journal_file = NULL;
+	g_autoptr (GFileIOStream) local_iostream = NULL;
+	g_autofree char          *journal = NULL;
+	gsize                     journal_size;
+	const guchar             *p;
+	const guchar             *end;
+	GError                   *local_error = NULL;
+	guint32                   pid;
+	guint32                   owner_size;
+	g_autofree char          *owner = NULL;
+	guint64                   original_size;
+	guint32                   id_size;
+	g_autofree char          *id = NULL;
+
+	journal_file = _archive_journal_get_file (archive_file, FALSE);
+	if (journal_file == NULL)
+		return TRUE;
+
+	if (! g_file_load_contents (journal_file, cancellable, &journal, &journal_size, NULL, &local_error)) {
+		if (g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
+			g_error_free (local_error);
+			return TRUE;
+		}
+		g_propagate_error (error, local_error);
+		return FALSE;
+	}
+
+	if ((journal_size < 4) || (memcmp (journal, ARCHIVE_JOURNAL_MAGIC, 4) != 0)) {
+		g_file_delete (journal_file, NULL, NULL);
+		return TRUE;
+	}
+
+	p = (guchar *) journal + 4;
+	end = (guchar *) journal + journal_size;
+	if (! _archive_journal_get32 (&p, end, &pid)
+	    || ! _archive_journal_get32 (&p, end, &owner_size)
+	    || (owner_size > (guint32) (end - p)))
+	{
+		g_file_delete (journal_file, NULL, NULL);
+		return TRUE;
+	}
+	owner = g_strndup ((char *) p, owner_size);
+	p += owner_size;
+
+	if (! _archive_journal_get64 (&p, end, &original_size)
+	    || ! _archive_journal_get32 (&p, end, &id_size)
+	    || (id_size > (guint32) (end - p)))
+	{
+		g_file_delete (journal_file, NULL, NULL);
+		return TRUE;
+	}
+
+	if (iostream == NULL) {
+		if (_archive_journal_owner_is_running (archive_file, pid, owner))
+			return TRUE;
+
+		local_iostream = g_file_open_readwrite (archive_file, cancellable, &local_error);
+		if (local_iostream == NULL) {
+			if (g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
+				g_error_free (local_error);
+				g_file_delete (journal_file, NULL, NULL);
+				return TRUE;
+			}
+			g_propagate_error (error, local_error);
+			return FALSE;
+		}
+		iostream = local_iostream;
+	}
+
+	id = _archive_journal_get_file_id (iostream, cancellable, error);
+	if (id == NULL)
+		return FALSE;
+
+	if ((strlen (id) == id_size) && (memcmp (id, p, id_size) == 0)) {
+		if (! _archive_journal_write_regions (p + id_size, end, iostream, cancellable, error)
+		    || ! g_seekable_truncate (G_SEEKABLE (iostream), original_size, cancellable, error)
+		    || ! _archive_sync (archive_file, error))
+		{
+			return FALSE;
+		}
+	}
+
+	if ((local_iostream != NULL) && ! g_io_stream_close (G_IO_STREAM (local_iostream), cancellable, error))
+		return FALSE;
+
+	g_file_delete (journal_file, NULL, NULL);
+
+	return TRUE;
+}
+
+
+/* LoadData */
+
+
+#define LOAD_DATA(x) ((LoadData *)(x))
+
+
+typedef struct {
+	FrArchive          *archive;
+	GCancellable       *cancellable;
+	GSimpleAsyncResult *result;
+	GInputStream       *istream;
+	void               *buffer;
+	gssize              buffer_size;
+	GError             *error;
+	goffset             range_start;        /* the part of the file to read */
+	goffset             range_end;          /* 0 to read up to the end of the file */
+	GzipIndex          *gzip_index;         /* if set the gzip stream is
+						 * decompressed by gzip_reader,
+						 * offsets and ranges refer to
+						 * the uncompressed data */
+	GzipReader         *gzip_reader;
+	GMappedFile        *mapped_file;        /* used instead of istream for
+						 * local files */
+	goffset             mapped_offset;
+} LoadData;
+
+
+static void
+load_data_init (LoadData *load_data)
+{
+	load_data->buffer_size = BUFFER_SIZE;
+	load_data->buffer = g_new (char, load_data->buffer_size);
+}
+
+
+static void
+load_data_free (LoadData *load_data)
+{
+	_g_object_unref (load_data->archive);
+	_g_object_unref (load_data->cancellable);
+	_g_object_unref (load_data->result);
+	gzip_reader_free (load_data->gzip_reader);
+	_g_object_unref (load_data->istream);
+	if (load_data->mapped_file != NULL)
+		g_mapped_file_unref (load_data->mapped_file);
+	gzip_index_free (load_data->gzip_index);
+	g_free (load_data->buffer);
+	g_free (load_data);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (LoadData, load_data_free)
+
+
+/* libarchive reads the mapped file in blocks of this size, the progress is
+ * updated after each block. */
+#define MAPPED_BLOCK_SIZE (8 * 1024 * 1024)
+
+
+/* Whether @path is a regular file on a local disk filesystem.  A truncated
+ * mapped file or an I/O error raises SIGBUS, so network filesystems, FUSE
+ * filesystems (gvfs) and the filesystems used by removable media are
+ * excluded. */
+static gboolean
+_path_can_be_mapped (const char *path)
+{
+#ifdef HAVE_SYS_VFS_H
+	struct stat   st;
+	struct statfs fs;
+
+	if ((stat (path, &st) != 0) || ! S_ISREG (st.st_mode))
+		return FALSE;
+
+	if (statfs (path, &fs) != 0)
+		return FALSE;
+
+	switch ((unsigned long) fs.f_type) {
+	case 0xEF53UL:		/* ext2, ext3, ext4 */
+	case 0x58465342UL:	/* xfs */
+	case 0x9123683EUL:	/* btrfs */
+	case 0xF2F52010UL:	/* f2fs */
+	case 0x2FC12FC1UL:	/* zfs */
+	case 0xCA451A4EUL:	/* bcachefs */
+	case 0x01021994UL:	/* tmpfs */
+		return TRUE;
+	default:
+		return FALSE;
+	}
+#else
+	return FALSE;
+#endif
+}
+
+
+/* Maps a local file in memory, returns NULL for remote files or if the file
+ * cannot be mapped. */
+static GMappedFile *
+_g_file_map_for_reading (GFile   *file,
+			 goffset  offset)
+{
+	g_autofree char *path = NULL;
+	GMappedFile     *mapped_file;
+
+	if (! g_file_is_native (file))
+		return NULL;
+
+	path = g_file_get_path (file);
+	if ((path == NULL) || ! _path_can_be_mapped (path))
+		return NULL;
+
+	mapped_file = g_mapped_file_new (path, FALSE, NULL);
+	if (mapped_file == NULL)
+		return NULL;
+
+#ifdef MADV_SEQUENTIAL
+	if (offset < (goffset) g_mapped_file_get_length (mapped_file)) {
+		char  *contents = g_mapped_file_get_contents (mapped_file);
+		gsize  page_offset = offset - (offset % sysconf (_SC_PAGESIZE));
+
+		madvise (contents + page_offset, g_mapped_file_get_length (mapped_file) - page_offset, MADV_SEQUENTIAL);
+	}
+#endif
+
+	return mapped_file;
+}
+
+
+static int
+load_data_open (struct archive *a,
+		void           *client_data)
+{
+	LoadData *load_data = client_data;
+
+	if (load_data->error != NULL)
+		return ARCHIVE_FATAL;
+
+	if (g_simple_async_result_get_source_tag (load_data->result) == fr_archive_list) {
+		FrArchiveLibarchivePrivate *private = fr_archive_libarchive_get_instance_private (FR_ARCHIVE_LIBARCHIVE (load_data->archive));
+		private->compressed_size = 0;
+	}
+
+	_archive_journal_restore (fr_archive_get_file (load_data->archive), NULL, load_data->cancellable, NULL);
+
+	/* libarchive reads the local files directly from memory, the gzip
+	 * data is decompressed by gzip_reader from the stream. */
+
+	if (load_data->gzip_index == NULL) {
+		load_data->mapped_file = _g_file_map_for_reading (fr_archive_get_file (load_data->archive), load_data->range_start);
+		if (load_data->mapped_file != NULL) {
+			load_data->mapped_offset = load_data->range_start;
+			return ARCHIVE_OK;
+		}
+	}
+
+	load_data->istream = (GInputStream *) g_file_read (fr_archive_get_file (load_data->archive),
+							   load_data->cancellable,
+							   &load_data->error);
+	if ((load_data->error == NULL) && (load_data->gzip_index != NULL)) {
+		load_data->gzip_reader = gzip_reader_new (load_data->istream, load_data->gzip_index);
+		if (load_data->range_start > 0)
+			gzip_reader_seek (load_data->gzip_reader,
+					  load_data->range_start,
+					  load_data->cancellable,
+					  &load_data->error);
+	}
+	else if ((load_data->error == NULL) && (load_data->range_start > 0))
+		g_seekable_seek (G_SEEKABLE (load_data->istream),
+				 load_data->range_start,
+				 G_SEEK_SET,
+				 load_data->cancellable,
+				 &load_data->error);
+
+	return (load_data->error == NULL) ? ARCHIVE_OK : ARCHIVE_FATAL;
+}
+
+
+/* The current offset in the data read by libarchive. */
+static goffset
+_load_data_tell (LoadData *load_data)
+{
+	if (load_data->mapped_file != NULL)
+		return load_data->mapped_offset;
+	else if (load_data->gzip_reader != NULL)
+		return gzip_reader_tell (load_data->gzip_reader);
+	else
+		return g_seekable_tell (G_SEEKABLE (load_data->istream));
+}
+
+
+static ssize_t
+_load_data_read_mapped_file (LoadData    *load_data,
+			     const void **buff)
+{
+	goffset end;
+	gsize   size;
+
+	if (g_cancellable_set_error_if_cancelled (load_data->cancellable, &load_data->error))
+		return -1;
+
+	end = g_mapped_file_get_length (load_data->mapped_file);
+	if ((load_data->range_end > 0) && (load_data->range_end < end))
+		end = load_data->range_end;
+	if (load_data->mapped_offset >= end)
+		return 0;
+
+	size = MIN (end - load_data->mapped_offset, MAPPED_BLOCK_SIZE);
+	*buff = g_mapped_file_get_contents (load_data->mapped_file) + load_data->mapped_offset;
+	load_data->mapped_offset += size;
+
+	if (g_simple_async_result_get_source_tag (load_data->result) == fr_archive_list) {
+		FrArchiveLibarchivePrivate *private = fr_archive_libarchive_get_instance_private (FR_ARCHIVE_LIBARCHIVE (load_data->archive));
+		fr_archive_progress_set_completed_bytes (load_data->archive, load_data->mapped_offset);
+		private->compressed_size += size;
+	}
+
+	return size;
+}
+
+
+static ssize_t
+load_data_read (struct archive  *a,
+		void            *client_data,
+		const void     **buff)
+{
+	LoadData *load_data = client_data;
+	gssize    size;
+	gssize    bytes;
+
+	if (load_data->error != NULL)
+		return -1;
+
+	if (load_data->mapped_file != NULL)
+		return _load_data_read_mapped_file (load_data, buff);
+
+	size = load_data->buffer_size;
+	if (load_data->range_end > 0) {
+		goffset remaining = load_data->range_end - _load_data_tell (load_data);
+
+		if (remaining <= 0)
+			return 0;
+		if (remaining < size)
+			size = remaining;
+	}
+
+	*buff = load_data->buffer;
+	if (load_data->gzip_reader != NULL)
+		bytes = gzip_reader_read (load_data->gzip_reader,
+					  load_data->buffer,
+					  size,
+					  load_data->cancellable,
+					  &load_data->error);
+	else
+		bytes = g_input_stream_read (load_data->istream,
+					     load_data->buffer,
+					     size,
+					     load_data->cancellable,
+					     &load_data->error);
+
+	/* update the progress only if listing the content */
+	if (g_simple_async_result_get_source_tag (load_data->result) == fr_archive_list) {
+		FrArchiveLibarchivePrivate *private = fr_archive_libarchive_get_instance_private (FR_ARCHIVE_LIBARCHIVE (load_data->archive));
+		fr_archive_progress_set_completed_bytes (load_data->archive,
+							 g_seekable_tell (G_SEEKABLE (load_data->istream)));
+		private->compressed_size += bytes;
+	}
+
+	return bytes;
+}
+
+
+static gint64
+load_data_seek (struct archive *a,
+		void           *client_data,
+		gint64          request,
+		int             whence)
+{
+	GSeekable *seekable;
+	GSeekType  seektype;
+	off_t      new_offset;
+
+	LoadData *load_data = client_data;
+
+	if (load_data->error != NULL)
+		return -1;
+
+	if (load_data->mapped_file != NULL) {
+		goffset end = (load_data->range_end > 0) ? load_data->range_end : (goffset) g_mapped_file_get_length (load_data->mapped_file);
+		goffset offset;
+
+		switch (whence) {
+		case SEEK_SET:
+			offset = load_data->range_start + request;
+			break;
+		case SEEK_CUR:
+			offset = load_data->mapped_offset + request;
+			break;
+		case SEEK_END:
+			offset = end + request;
+			break;
+		default:
+			return -1;
+		}
+		if (offset < load_data->range_start)
+			return -1;
+
+		load_data->mapped_offset = offset;
+
+		return offset - load_data->range_start;
+	}
+
+	seekable = (GSeekable*)(load_data->istream);
+	if (load_data->istream == NULL)
+		return -1;
+
+	if (load_data->gzip_reader != NULL) {
+		/* the end of the uncompressed data is not known */
+		switch (whence) {
+		case SEEK_SET:
+			request += load_data->range_start;
+			break;
+		case SEEK_CUR:
+			request += gzip_reader_tell (load_data->gzip_reader);
+			break;
+		default:
+			return -1;
+		}
+
+		if (! gzip_reader_seek (load_data->gzip_reader, request, load_data->cancellable, &load_data->error))
+			return -1;
+
+		return gzip_reader_tell (load_data->gzip_reader) - load_data->range_start;
+	}
+
+	switch (whence) {
+	case SEEK_SET:
+		seektype = G_SEEK_SET;
+		request += load_data->range_start;
+		break;
+	case SEEK_CUR:
+		seektype = G_SEEK_CUR;
+		break;
+	case SEEK_END:
+		if (load_data->range_end > 0) {
+			seektype = G_SEEK_SET;
+			request += load_data->range_end;
+		}
+		else
+			seektype = G_SEEK_END;
+		break;
+	default:
+		return -1;
+	}
+
+	g_seekable_seek (seekable,
+			 request,
+			 seektype,
+			 load_data->cancellable,
+			 &load_data->error);
+	new_offset = g_seekable_tell (seekable);
+	if (load_data->error != NULL)
+		return -1;
+
+	return new_offset - load_data->range_start;
+}
+
+
+static gint64
+load_data_skip (struct archive *a,
+		void           *client_data,
+		gint64          request)
+{
+	off_t      old_offset, new_offset;
+
+	LoadData *load_data = client_data;
+
+	if (load_data->error != NULL || ((load_data->istream == NULL) && (load_data->mapped_file == NULL)))
+		return -1;
+
+	old_offset = _load_data_tell (load_data) - load_data->range_start;
+	new_offset = load_data_seek (a, client_data, request, SEEK_CUR);
+	if (new_offset > old_offset)
+		return (new_offset - old_offset);
+
+	return 0;
+}
+
+
+
+static int
+load_data_close (struct archive *a,
+		 void           *client_data)
+{
+	LoadData *load_data = client_data;
+
+	if (load_data->error != NULL)
+		return ARCHIVE_FATAL;
+
+	if (load_data->gzip_reader != NULL) {
+		gzip_reader_free (load_data->gzip_reader);
+		load_data->gzip_reader = NULL;
+	}
+	if (load_data->istream != NULL) {
+		_g_object_unref (load_data->istream);
+		load_data->istream = NULL;
+	}
+	if (load_data->mapped_file != NULL) {
+		g_mapped_file_unref (load_data->mapped_file);
+		load_data->mapped_file = NULL;
+	}
+
+	return ARCHIVE_OK;
+}
+
+
+static int
+create_read_object (LoadData        *load_data,
+                    _archive_read_ctx **a)
+{
+	*a = archive_read_new ();
+	if (load_data->gzip_index != NULL) {
+		/* the data is decompressed by gzip_reader */
+		archive_read_support_format_tar (*a);
+	}
+	else {
+		archive_read_support_filter_all (*a);
+		archive_read_support_format_all (*a);
+	}
+
+	archive_read_set_open_callback (*a, load_data_open);
+	archive_read_set_read_callback (*a, load_data_read);
+	archive_read_set_close_callback (*a, load_data_close);
+	archive_read_set_seek_callback (*a, load_data_seek);
+	archive_read_set_skip_callback (*a, load_data_skip);
+	archive_read_set_callback_data (*a, load_data);
+
+	return archive_read_open1 (*a);
+}
+
+
+/* Creates a reader for the zip entry stored in the load_data range, the
+ * range starts with the entry local header.  The header must be read with
+ * zip_entry_read_archive_header, to get the attributes stored in the central
+ * directory. */
+static int
+create_zip_entry_read_object (LoadData           *load_data,
+			      _archive_read_ctx **a)
+{
+	*a = archive_read_new ();
+	archive_read_support_format_zip_streamable (*a);
+
+	archive_read_set_open_callback (*a, load_data_open);
+	archive_read_set_read_callback (*a, load_data_read);
+	archive_read_set_close_callback (*a, load_data_close);
+	archive_read_set_skip_callback (*a, load_data_skip);
+	archive_read_set_callback_data (*a, load_data);
+
+	return archive_read_open1 (*a);
+}
+
+
+/* -- gzip index --
+ *
+ * Big tar.gz archives are decompressed by a GzipReader while listing, to save
+ * decompression checkpoints, and the offset of each member in the tar stream
+ * is recorded.  The index is saved in the cache folder, when extracting a
+ * few files the decompression restarts from the checkpoint before each of
+ * them. */
+
+
+#define GZIP_INDEX_MIN_ARCHIVE_SIZE (16 * 1024 * 1024)
+#define GZIP_INDEX_MIN_SPAN         (4 * 1024 * 1024)
+#define GZIP_INDEX_POINTS           256
+#define GZIP_INDEX_VARIANT_TYPE     "(ayva{st})"
+
+
+static gboolean
+_archive_is_gzip_tar (FrArchive *archive)
+{
+	return _g_str_equal (fr_archive_get_mime_type (archive), "application/x-compressed-tar");
+}
+
+
+static GFile *
+_gzip_index_get_file (GFile    *archive_file,
+		      gboolean  create_dir)
+{
+	g_autoptr (GFile) dir = NULL;
+	g_autofree char  *uri = NULL;
+	g_autofree char  *name = NULL;
+
+	dir = _g_file_new_user_cache_subdir ("file-roller/gzip-index", create_dir);
+	if (dir == NULL)
+		return NULL;
+
+	uri = g_file_get_uri (archive_file);
+	name = g_compute_checksum_for_string (G_CHECKSUM_SHA256, uri, -1);
+
+	return g_file_get_child (dir, name);
+}
+
+
+/* Saves the index and the tar members offsets, the index is valid for the
+ * archive identified by key, see fr_archive_cache_get_key. */
+static void
+_gzip_index_save (FrArchive    *archive,
+		  GBytes       *key,
+		  GzipIndex    *index,
+		  GVariant     *members,
+		  GCancellable *cancellable)
+{
+	g_autoptr (GFile)    file = NULL;
+	g_autoptr (GVariant) variant = NULL;
+
+	file = _gzip_index_get_file (fr_archive_get_file (archive), TRUE);
+	if (file == NULL)
+		return;
+
+	variant = g_variant_ref_sink (g_variant_new (GZIP_INDEX_VARIANT_TYPE,
+						     g_variant_new_from_bytes (G_VARIANT_TYPE_BYTESTRING, key, TRUE),
+						     gzip_index_to_variant (index),
+						     members));
+	g_file_replace_contents (file,
+				 g_variant_get_data (variant),
+				 g_variant_get_size (variant),
+				 NULL,
+				 FALSE,
+				 G_FILE_CREATE_PRIVATE,
+				 NULL,
+				 cancellable,
+				 NULL);
+}
+
+
+/* Returns the index if it is valid for the archive, members is set to the
+ * a{st} dictionary of the tar members offsets. */
+static GzipIndex *
+_gzip_index_load (FrArchive     *archive,
+		  GVariant     **members,
+		  GCancellable  *cancellable)
+{
+	g_autoptr (GBytes)   key = NULL;
+	g_autoptr (GFile)    file = NULL;
+	char                *contents;
+	gsize                size;
+	g_autoptr (GVariant) variant = NULL;
+	g_autoptr (GVariant) saved_key = NULL;
+	g_autoptr (GVariant) index_variant = NULL;
+	g_autoptr (GBytes)   saved_key_bytes = NULL;
+	GzipIndex           *index;
+
+	key = fr_archive_cache_get_key (archive, cancellable);
+	if (key == NULL)
+		return NULL;
+
+	file = _gzip_index_get_file (fr_archive_get_file (archive), FALSE);
+	if ((file == NULL) || ! g_file_load_contents (file, cancellable, &contents, &size, NULL, NULL))
+		return NULL;
+
+	variant = g_variant_ref_sink (g_variant_new_from_data (G_VARIANT_TYPE (GZIP_INDEX_VARIANT_TYPE),
+							       contents,
+							       size,
+							       FALSE,
+							       g_free,
+							       contents));
+	saved_key = g_variant_get_child_value (variant, 0);
+	saved_key_bytes = g_variant_get_data_as_bytes (saved_key);
+	if (! g_bytes_equal (key, saved_key_bytes))
+		return NULL;
+
+	g_variant_get_child (variant, 1, "v", &index_variant);
+	index = gzip_index_new_from_variant (index_variant);
+	if (index == NULL)
+		return NULL;
+
+	*members = g_variant_get_child_value (variant, 2);
+
+	return index;
+}
+
+
+/* -- list -- */
+
+
+static goffset
+_g_file_get_size (GFile        *file,
+		  GCancellable *cancellable)
+{
+	g_autoptr (GFileInfo) info = NULL;
+	goffset    size;
+
+	info = g_file_query_info (file,
+				  G_FILE_ATTRIBUTE_STANDARD_SIZE,
+				  G_FILE_QUERY_INFO_NONE,
+				  cancellable,
+				  NULL);
+	if (info == NULL)
+		return 0;
+
+	size = g_file_info_get_size (info);
+
+	return size;
+}
+
+
+/* The files can be loaded from the listing cache, so the size is computed
+ * from the file list instead of during the listing. */
+static goffset
+_fr_archive_get_uncompressed_size (FrArchive *archive)
+{
+	goffset size = 0;
+	guint   i;
+
+	for (i = 0; i < archive->files->len; i++) {
+		FrFileData *file_data = g_ptr_array_index (archive->files, i);
+		size += file_data->size;
+	}
+
+	return size;
+}
+
+
+static GError *
+_g_error_new_from_archive_error (const char *s)
+{
+	g_autofree char *msg = NULL;
+	GError *error;
+
+	msg = (s != NULL) ? g_locale_to_utf8 (s, -1, NULL, NULL, NULL) : NULL;
+	if (msg == NULL)
+		msg = g_strdup ("Fatal error");
+	error = g_error_new_literal (FR_ERROR, FR_ERROR_COMMAND_ERROR, msg);
+
+	return error;
+}
+
+
+static FrFileData *
+_fr_file_data_new_from_entry (struct archive_entry *entry)
+{
+	FrFileData *file_data;
+	const char *pathname;
+
+	file_data = fr_file_data_new ();
+
+	if (archive_entry_size_is_set (entry))
+		file_data->size = archive_entry_size (entry);
+
+	if (archive_entry_mtime_is_set (entry))
+		file_data->modified =  archive_entry_mtime (entry);
+
+	if (archive_entry_filetype (entry) == AE_IFLNK)
+		file_data->link = g_strdup (archive_entry_symlink (entry));
+
+	pathname = archive_entry_pathname (entry);
+	if (*pathname == '/') {
+		file_data->full_path = g_strdup (pathname);
+		file_data->original_path = file_data->full_path;
+	}
+	else {
+		file_data->full_path = g_strconcat ("/", pathname, NULL);
+		file_data->original_path = file_data->full_path + 1;
+	}
+
+	file_data->dir = (archive_entry_filetype (entry) == AE_IFDIR);
+	if (file_data->dir)
+		file_data->name = _g_path_get_dir_name (file_data->full_path);
+	else
+		file_data->name = g_strdup (_g_path_get_basename (file_data->full_path));
+	file_data->path = _g_path_remove_level (file_data->full_path);
+
+	/*
+	g_print ("%s\n", archive_entry_pathname (entry));
+	g_print ("\tfull_path: %s\n", file_data->full_path);
+	g_print ("\toriginal_path: %s\n", file_data->original_path);
+	g_print ("\tname: %s\n", file_data->name);
+	g_print ("\tpath: %s\n", file_data->path);
+	g_print ("\tlink: %s\n", file_data->link);
+	*/
+
+	return file_data;
+}
+
+
+static void
+list_archive_thread (GSimpleAsyncResult *result,
+		     GObject            *object,
+		     GCancellable       *cancellable)
+{
+	g_autoptr (LoadData) load_data = NULL;
+	g_autoptr (_archive_read_ctx) a = NULL;
+	struct archive_entry *entry;
+	int                   r;
+	goffset               archive_size;
+	g_autoptr (GBytes)    gzip_key = NULL;
+	g_autoptr (GVariantBuilder) gzip_members = NULL;
+
+	load_data = g_simple_async_result_get_op_res_gpointer (result);
+
+	archive_size = _g_file_get_size (fr_archive_get_file (load_data->archive), cancellable);
+	fr_archive_progress_set_total_bytes (load_data->archive, archive_size);
+
+	/* build the gzip index while listing */
+
+	if (_archive_is_gzip_tar (load_data->archive) && (archive_size >= GZIP_INDEX_MIN_ARCHIVE_SIZE))
+		gzip_key = fr_archive_cache_get_key (load_data->archive, cancellable);
+	if (gzip_key != NULL) {
+		/* the span is in uncompressed bytes: GZIP_INDEX_POINTS
+		 * checkpoints for stored data, more for compressible data. */
+		load_data->gzip_index = gzip_index_new (MAX (GZIP_INDEX_MIN_SPAN, archive_size / GZIP_INDEX_POINTS));
+		gzip_members = g_variant_builder_new (G_VARIANT_TYPE ("a{st}"));
+	}
+
+	r = create_read_object (load_data, &a);
+	if (r != ARCHIVE_OK) {
+		return;
+	}
+
+	while ((r = archive_read_next_header (a, &entry)) == ARCHIVE_OK) {
+		FrFileData *file_data;
+		const char *pathname;
+
+		if (g_cancellable_is_cancelled (cancellable))
+			break;
+
+		file_data = _fr_file_data_new_from_entry (entry);
+		pathname = archive_entry_pathname (entry);
+		fr_archive_add_file (load_data->archive, file_data);
+
+		if (gzip_members != NULL)
+			g_variant_builder_add (gzip_members, "{st}", pathname, (guint64) archive_read_header_position (a));
+
+		archive_read_data_skip (a);
+	}
+
+	if ((load_data->error == NULL) && (r != ARCHIVE_EOF) && (archive_error_string (a) != NULL))
+		load_data->error = _g_error_new_from_archive_error (archive_error_string (a));
+
+	if (gzip_members != NULL) {
+		GVariant *members = g_variant_builder_end (gzip_members);
+
+		if ((load_data->error == NULL) && (r == ARCHIVE_EOF))
+			_gzip_index_save (load_data->archive, gzip_key, load_data->gzip_index, members, cancellable);
+		else
+			g_variant_unref (g_variant_ref_sink (members));
+	}
+	if (load_data->error == NULL)
+		g_cancellable_set_error_if_cancelled (cancellable, &load_data->error);
+	if (load_data->error != NULL)
+		g_simple_async_result_set_from_error (result, load_data->error);
+}
+
+
+static void
+fr_archive_libarchive_list (FrArchive           *archive,
+			    const char          *password,
+			    GCancellable        *cancellable,
+			    GAsyncReadyCallback  callback,
+			    gpointer             user_data)
+{
+	LoadData *load_data;
+
+	load_data = g_new0 (LoadData, 1);
+	load_data_init (load_data);
+
+	load_data->archive = g_object_ref (archive);
+	load_data->cancellable = _g_object_ref (cancellable);
+	load_data->result = g_simple_async_result_new (G_OBJECT (archive),
+						       callback,
+						       user_data,
+						       fr_archive_list);
+
+	g_simple_async_result_set_op_res_gpointer (load_data->result, load_data, NULL);
+	g_simple_async_result_run_in_thread (load_data->result,
+					     list_archive_thread,
+					     G_PRIORITY_DEFAULT,
+					     cancellable);
 }
 
 
 /* -- extract -- */
 
 
-#define NULL_BUFFER_SIZE (16 * 1024)
+#define NULL_BUFFER_SIZE (16 * 1024)
+
+/* Regular files up to this size are decoded in memory and written by a pool
+ * of writer threads, while the decoder continues with the next entries.
+ * Bigger files are written by the decoder thread. */
+#define EXTRACT_JOB_MAX_FILE_SIZE (1024 * 1024)
+#define EXTRACT_MAX_QUEUED_BYTES  (32 * 1024 * 1024)
+#define EXTRACT_MAX_QUEUED_JOBS   1024
+#define EXTRACT_MAX_WRITERS       8
+
+/* With io_uring the writer threads receive the small files in batches of
+ * this size, each batch is written with two submissions: one to open all
+ * the files and one to write and close them. */
+#define EXTRACT_URING_BATCH_SIZE  64
+
+/* When extracting up to this number of files from a zip archive, or from a
+ * tar.gz archive with a gzip index, the entries are located with the
+ * central directory or the index and read directly, instead of scanning
+ * the whole archive. */
+#define EXTRACT_RANDOM_ACCESS_MAX_FILES 256
+
+
+typedef struct {
+	LoadData    parent;
+	GList      *file_list;
+	GFile      *destination;
+	char       *base_dir;
+	gboolean    skip_older;
+	gboolean    overwrite;
+	gboolean    junk_paths;
+	GHashTable *files_to_extract;
+	int         n_files_to_extract;
+	GHashTable *usernames;
+	GHashTable *groupnames;
+	char       *null_buffer;
+	gboolean    sparse;                     /* leave the holes of sparse
+						 * files unallocated */
+	DirfdCache *dirfd_cache;                /* for local destinations */
+	gboolean    use_uring;
+	GPtrArray  *batch;                      /* ExtractJob, the jobs not yet
+						 * sent to the writer threads */
+	GPtrArray  *zip_entries;                /* ZipEntry, the requested entries
+						 * in archive order, or NULL to
+						 * read the archive sequentially */
+	GArray     *tar_offsets;                /* goffset, the requested tar.gz
+						 * members in archive order */
+	guint       next_entry;
+
+	/* shared with the writer threads, protected by mutex */
+	GMutex      mutex;
+	GCond       job_done;
+	GHashTable *checked_folders;
+	GHashTable *created_folders;            /* GFile -> GFileInfo */
+	GHashTable *folders_created_during_extraction;
+	gsize       queued_bytes;
+	guint       queued_jobs;
+	GHashTable *queued_files;               /* GFile, the files of the jobs
+						 * not yet completed */
+	GQueue     *uring_writers;              /* UringWriter, the rings not
+						 * used by a writer thread */
+	GError     *writer_error;
+	int         stop;
+} ExtractData;
+
+
+static void
+extract_data_free (ExtractData *extract_data)
+{
+	g_free (extract_data->base_dir);
+	_g_object_unref (extract_data->destination);
+	_g_string_list_free (extract_data->file_list);
+	g_hash_table_unref (extract_data->files_to_extract);
+	g_hash_table_unref (extract_data->usernames);
+	g_hash_table_unref (extract_data->groupnames);
+	g_free (extract_data->null_buffer);
+	if (extract_data->zip_entries != NULL)
+		g_ptr_array_unref (extract_data->zip_entries);
+	if (extract_data->tar_offsets != NULL)
+		g_array_unref (extract_data->tar_offsets);
+	g_hash_table_unref (extract_data->checked_folders);
+	g_hash_table_unref (extract_data->created_folders);
+	g_hash_table_unref (extract_data->folders_created_during_extraction);
+	g_hash_table_unref (extract_data->queued_files);
+	g_queue_free_full (extract_data->uring_writers, (GDestroyNotify) uring_writer_free);
+	dirfd_cache_free (extract_data->dirfd_cache);
+	if (extract_data->batch != NULL)
+		g_ptr_array_unref (extract_data->batch);
+	_g_error_free (extract_data->writer_error);
+	g_cond_clear (&extract_data->job_done);
+	g_mutex_clear (&extract_data->mutex);
+	load_data_free (LOAD_DATA (extract_data));
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (ExtractData, extract_data_free)
+
+
+static gboolean
+extract_data_get_extraction_requested (ExtractData *extract_data,
+				       const char  *pathname)
+{
+	if (extract_data->file_list != NULL)
+		return g_hash_table_lookup (extract_data->files_to_extract, pathname) != NULL;
+	else
+		return TRUE;
+}
+
+
+static GFileInfo *
+_g_file_info_create_from_entry (struct archive_entry *entry,
+			        ExtractData          *extract_data)
+{
+	GFileInfo *info;
+
+	info = g_file_info_new ();
+
+	/* times */
+
+	if (archive_entry_mtime_is_set (entry))
+		g_file_info_set_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED, archive_entry_mtime (entry));
+
+	/* username */
+
+	if (archive_entry_uname (entry) != NULL) {
+		guint32 uid;
+
+		uid = GPOINTER_TO_INT (g_hash_table_lookup (extract_data->usernames, archive_entry_uname (entry)));
+		if (uid == 0) {
+			struct passwd *pwd = getpwnam (archive_entry_uname (entry));
+			if (pwd != NULL) {
+				uid = pwd->pw_uid;
+				g_hash_table_insert (extract_data->usernames, g_strdup (archive_entry_uname (entry)), GINT_TO_POINTER (uid));
+			}
+		}
+		if (uid != 0)
+			g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_UID, uid);
+	}
+
+	/* groupname */
+
+	if (archive_entry_gname (entry) != NULL) {
+		guint32 gid;
+
+		gid = GPOINTER_TO_INT (g_hash_table_lookup (extract_data->groupnames, archive_entry_gname (entry)));
+		if (gid == 0) {
+			struct group *grp = getgrnam (archive_entry_gname (entry));
+			if (grp != NULL) {
+				gid = grp->gr_gid;
+				g_hash_table_insert (extract_data->groupnames, g_strdup (archive_entry_gname (entry)), GINT_TO_POINTER (gid));
+			}
+		}
+		if (gid != 0)
+			g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_GID, gid);
+	}
+
+	/* permsissions */
+
+	g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_MODE, archive_entry_mode (entry));
+
+	return info;
+}
+
+
+static gboolean
+_g_file_set_attributes_from_info (GFile         *file,
+				  GFileInfo     *info,
+				  GCancellable  *cancellable,
+				  GError       **error)
+{
+	return g_file_set_attributes_from_info (file, info, G_FILE_QUERY_INFO_NONE, cancellable, error);
+}
+
+
+typedef struct {
+	GFile *folder;
+	gsize  uri_length;
+} FolderToRestore;
+
+
+static int
+folder_to_restore_cmp (gconstpointer a,
+		       gconstpointer b)
+{
+	const FolderToRestore *folder_a = a;
+	const FolderToRestore *folder_b = b;
+
+	if (folder_a->uri_length > folder_b->uri_length)
+		return -1;
+	if (folder_a->uri_length < folder_b->uri_length)
+		return 1;
+	return 0;
+}
+
+
+/* The attributes of the files are restored when they are written, the
+ * folders are restored at the end because adding a file changes the folder
+ * modification time.  The children are restored before their parents, the
+ * permissions of a parent could deny the access to them. */
+static void
+restore_original_folder_attributes (GHashTable    *created_folders,
+				    GCancellable  *cancellable)
+{
+	g_autoptr (GArray) folders = NULL;
+	GHashTableIter     iter;
+	gpointer           key;
+	guint              i;
+
+	folders = g_array_sized_new (FALSE, FALSE, sizeof (FolderToRestore), g_hash_table_size (created_folders));
+	g_hash_table_iter_init (&iter, created_folders);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		g_autofree char *uri = g_file_get_uri (key);
+		FolderToRestore  folder;
+
+		folder.folder = key;
+		folder.uri_length = strlen (uri);
+		g_array_append_val (folders, folder);
+	}
+	g_array_sort (folders, folder_to_restore_cmp);
+
+	for (i = 0; i < folders->len; i++) {
+		GFile *folder = g_array_index (folders, FolderToRestore, i).folder;
+
+		if (g_cancellable_is_cancelled (cancellable))
+			break;
+		_g_file_set_attributes_from_info (folder, g_hash_table_lookup (created_folders, folder), cancellable, NULL);
+	}
+}
+
+
+/* Restores the attributes read by _g_file_info_create_from_entry to the
+ * open file @fd, before it's closed: the file cannot be replaced with a
+ * symbolic link in the meantime.  As with _g_file_set_attributes_from_info
+ * the errors are not fatal. */
+static gboolean
+_fd_set_attributes_from_info (int        fd,
+			      GFileInfo *info)
+{
+	uid_t    uid = (uid_t) -1;
+	gid_t    gid = (gid_t) -1;
+	gboolean success = TRUE;
+
+	/* the owner first, changing it can reset the setuid and setgid bits */
+
+	if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_UNIX_UID))
+		uid = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_UID);
+	if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_UNIX_GID))
+		gid = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_GID);
+	if ((uid != (uid_t) -1) || (gid != (gid_t) -1)) {
+		if (fchown (fd, uid, gid) < 0)
+			success = FALSE;
+	}
+
+	if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_UNIX_MODE)) {
+		mode_t mode = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_MODE) & 07777;
+
+		if (fchmod (fd, mode) < 0)
+			success = FALSE;
+	}
+
+	if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_TIME_MODIFIED)) {
+		struct timespec times[2];
+
+		times[0].tv_sec = 0;
+		times[0].tv_nsec = UTIME_OMIT;
+		times[1].tv_sec = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+		times[1].tv_nsec = 0;
+		if (futimens (fd, times) < 0)
+			success = FALSE;
+	}
+
+	return success;
+}
+
+
+static gboolean
+_g_output_stream_add_padding (ExtractData    *extract_data,
+			      GOutputStream  *ostream,
+			      gssize          target_offset,
+			      gssize          actual_offset,
+			      GCancellable   *cancellable,
+			      GError        **error)
+{
+	gboolean success = TRUE;
+	gsize    count;
+	gsize    bytes_written;
+
+	while (target_offset > actual_offset) {
+		count = NULL_BUFFER_SIZE;
+		if (target_offset < actual_offset + NULL_BUFFER_SIZE)
+			count = target_offset - actual_offset;
+
+		success = g_output_stream_write_all (ostream, extract_data->null_buffer, count, &bytes_written, cancellable, error);
+		if (! success)
+			break;
+
+		actual_offset += bytes_written;
+	}
+
+	return success;
+}
+
+/* Moves over a hole without writing it, the hole at the end of the file is
+ * created by extending the file size.  Returns FALSE without an error if
+ * the stream doesn't support it. */
+static gboolean
+_g_output_stream_skip_hole (GOutputStream  *ostream,
+			    gint64          target_offset,
+			    gboolean        end_of_file,
+			    GCancellable   *cancellable,
+			    GError        **error)
+{
+	if (! G_IS_SEEKABLE (ostream)
+	    || ! g_seekable_can_seek (G_SEEKABLE (ostream))
+	    || (end_of_file && ! g_seekable_can_truncate (G_SEEKABLE (ostream))))
+	{
+		return FALSE;
+	}
+
+	if (! g_seekable_seek (G_SEEKABLE (ostream), target_offset, G_SEEK_SET, cancellable, error))
+		return FALSE;
+
+	return ! end_of_file || g_seekable_truncate (G_SEEKABLE (ostream), target_offset, cancellable, error);
+}
+
+
+static gboolean
+_fd_write_all (int           fd,
+	       const void   *buffer,
+	       gsize         size,
+	       GError      **error)
+{
+	const char *data = buffer;
+
+	while (size > 0) {
+		ssize_t n;
+
+		n = write (fd, data, size);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			_g_set_error_from_errno (error, errno, NULL);
+			return FALSE;
+		}
+		data += n;
+		size -= n;
+	}
+
+	return TRUE;
+}
+
+
+/* Writes a block of data read from the archive to @ostream, or to @fd if
+ * @ostream is NULL.  The holes of sparse files are skipped when extracting
+ * to a local folder, and filled with zeros otherwise. */
+static gboolean
+_extract_data_write_block (ExtractData    *extract_data,
+			   GOutputStream  *ostream,
+			   int             fd,
+			   const void     *buffer,
+			   gsize           buffer_size,
+			   gint64          target_offset,
+			   gint64         *actual_offset,
+			   GCancellable   *cancellable,
+			   GError        **error)
+{
+	LoadData *load_data = LOAD_DATA (extract_data);
+	gsize     bytes_written = 0;
+
+	if ((target_offset > *actual_offset) && (ostream == NULL)) {
+		if ((lseek (fd, target_offset, SEEK_SET) < 0)
+		    || ((buffer_size == 0) && (ftruncate (fd, target_offset) < 0)))
+		{
+			_g_set_error_from_errno (error, errno, NULL);
+			return FALSE;
+		}
+		fr_archive_progress_inc_completed_bytes (load_data->archive, target_offset - *actual_offset);
+		*actual_offset = target_offset;
+	}
+	else if (target_offset > *actual_offset) {
+		GError *local_error = NULL;
+
+		if (! extract_data->sparse
+		    || ! _g_output_stream_skip_hole (ostream, target_offset, buffer_size == 0, cancellable, &local_error))
+		{
+			if (local_error != NULL) {
+				g_propagate_error (error, local_error);
+				return FALSE;
+			}
+			if (! _g_output_stream_add_padding (extract_data, ostream, target_offset, *actual_offset, cancellable, error))
+				return FALSE;
+		}
+		fr_archive_progress_inc_completed_bytes (load_data->archive, target_offset - *actual_offset);
+		*actual_offset = target_offset;
+	}
+
+	if (ostream == NULL) {
+		if (! _fd_write_all (fd, buffer, buffer_size, error))
+			return FALSE;
+		bytes_written = buffer_size;
+	}
+	else if ((buffer_size > 0) && ! g_output_stream_write_all (ostream, buffer, buffer_size, &bytes_written, cancellable, error))
+		return FALSE;
+
+	*actual_offset += bytes_written;
+	fr_archive_progress_inc_completed_bytes (load_data->archive, bytes_written);
+
+	return TRUE;
+}
+
+
+/* Whether the existing file must not be overwritten, according to the
+ * skip_older and overwrite options. */
+static gboolean
+_extract_data_skip_existing_file (ExtractData   *extract_data,
+				  GFile         *file,
+				  time_t         mtime,
+				  GCancellable  *cancellable,
+				  GError       **error)
+{
+	g_autoptr (GFileInfo) info = NULL;
+	GError   *local_error = NULL;
+	gboolean  created_during_extraction;
+
+	if (! extract_data->skip_older && extract_data->overwrite)
+		return FALSE;
+
+	g_mutex_lock (&extract_data->mutex);
+	created_during_extraction = (g_hash_table_lookup (extract_data->folders_created_during_extraction, file) != NULL);
+	g_mutex_unlock (&extract_data->mutex);
+
+	if (created_during_extraction)
+		return FALSE;
+
+	info = g_file_query_info (file,
+				  G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME "," G_FILE_ATTRIBUTE_TIME_MODIFIED,
+				  G_FILE_QUERY_INFO_NONE,
+				  cancellable,
+				  &local_error);
+	if (info == NULL) {
+		if (! g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+			g_propagate_error (error, local_error);
+		else
+			g_error_free (local_error);
+		return FALSE;
+	}
+
+	if (! extract_data->overwrite)
+		return TRUE;
+
+	if (extract_data->skip_older) {
+		GTimeVal modification_time;
+
+		g_file_info_get_modification_time (info, &modification_time);
+		if (mtime < modification_time.tv_sec)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+
+static gboolean
+_extract_data_make_parents (ExtractData   *extract_data,
+			    GFile         *file,
+			    GCancellable  *cancellable,
+			    GError       **error)
+{
+	g_autoptr (GFile) parent = NULL;
+	GError *local_error = NULL;
+
+	parent = g_file_get_parent (file);
+	if (parent == NULL)
+		return TRUE;
+
+	/* the folders are created with the lock held, to avoid races
+	 * between the writer threads. */
+
+	g_mutex_lock (&extract_data->mutex);
+
+	if (g_hash_table_lookup (extract_data->checked_folders, parent) == NULL) {
+		if (! g_file_query_exists (parent, cancellable)
+		    && ! _g_file_make_directory_with_parents (parent,
+							     extract_data->folders_created_during_extraction,
+							     cancellable,
+							     &local_error))
+		{
+			if (g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_EXISTS))
+				g_clear_error (&local_error);
+		}
+
+		if (local_error == NULL) {
+			GFile *grandparent;
+
+			grandparent = g_object_ref (parent);
+			while (grandparent != NULL) {
+				GFile *next = g_file_get_parent (grandparent);
+
+				if (g_hash_table_lookup (extract_data->checked_folders, grandparent) == NULL)
+					g_hash_table_insert (extract_data->checked_folders, grandparent, GINT_TO_POINTER (1));
+				else
+					g_object_unref (grandparent);
+				grandparent = next;
+			}
+		}
+	}
+
+	g_mutex_unlock (&extract_data->mutex);
+
+	if (local_error != NULL) {
+		g_propagate_error (error, local_error);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+static void
+_extract_data_add_created_folder (ExtractData *extract_data,
+				  GFile       *folder,
+				  GFileInfo   *info)
+{
+	g_mutex_lock (&extract_data->mutex);
+	g_hash_table_insert (extract_data->created_folders, g_object_ref (folder), info);
+	g_mutex_unlock (&extract_data->mutex);
+}
+
+
+/* -- local destinations --
+ *
+ * When the destination is a local folder the files are created with the *at
+ * functions relative to the folders kept open by a DirfdCache, instead of
+ * resolving the full path of every entry. */
+
+
+static void
+_extract_data_folder_created (const char *relative_path,
+			      gpointer    user_data)
+{
+	ExtractData *extract_data = user_data;
+	GFile       *folder;
+
+	folder = g_file_get_child (extract_data->destination, relative_path);
+	g_mutex_lock (&extract_data->mutex);
+	if (g_hash_table_lookup (extract_data->folders_created_during_extraction, folder) == NULL)
+		g_hash_table_insert (extract_data->folders_created_during_extraction, g_object_ref (folder), GINT_TO_POINTER (1));
+	g_mutex_unlock (&extract_data->mutex);
+	g_object_unref (folder);
+}
+
+
+/* Whether the error means that a parent folder is a symbolic link, the file
+ * is skipped in this case, see dirfd_cache_open_parent.  A file where a
+ * folder is expected is a real error. */
+static gboolean
+_g_error_is_symlink_in_path (GError *error)
+{
+	return g_error_matches (error, G_IO_ERROR, G_IO_ERROR_TOO_MANY_LINKS);
+}
+
+
+/* Returns a file descriptor open for writing, an existing file is removed
+ * first, to avoid writing into a file hard linked elsewhere. */
+static int
+_extract_data_create_file_at (ExtractData  *extract_data,
+			      const char   *relative_path,
+			      GError      **error)
+{
+	g_autofree char *name = NULL;
+	int              dir_fd;
+	int              fd;
+
+	dir_fd = dirfd_cache_open_parent (extract_data->dirfd_cache, relative_path, &name, error);
+	if (dir_fd < 0)
+		return -1;
+
+	fd = openat (dir_fd, name, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0666);
+	if ((fd < 0) && (errno == EEXIST) && (unlinkat (dir_fd, name, 0) == 0))
+		fd = openat (dir_fd, name, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0666);
+	if (fd < 0)
+		_g_set_error_from_errno (error, errno, relative_path);
+	close (dir_fd);
+
+	return fd;
+}
+
+
+static gboolean
+_extract_data_close_file (int          fd,
+			  const char  *relative_path,
+			  GError     **error)
+{
+	if (close (fd) < 0) {
+		_g_set_error_from_errno (error, errno, relative_path);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+static gboolean
+_extract_data_make_directory_at (ExtractData  *extract_data,
+				 const char   *relative_path,
+				 GError      **error)
+{
+	g_autofree char *name = NULL;
+	int              dir_fd;
+	gboolean         success = TRUE;
+
+	dir_fd = dirfd_cache_open_parent (extract_data->dirfd_cache, relative_path, &name, error);
+	if (dir_fd < 0)
+		return FALSE;
+
+	if ((mkdirat (dir_fd, name, 0777) < 0) && (errno != EEXIST)) {
+		_g_set_error_from_errno (error, errno, relative_path);
+		success = FALSE;
+	}
+	close (dir_fd);
+
+	return success;
+}
+
+
+/* Replaces an existing file or empty folder. */
+static gboolean
+_extract_data_make_symbolic_link_at (ExtractData  *extract_data,
+				     const char   *relative_path,
+				     const char   *target,
+				     GError      **error)
+{
+	g_autofree char *name = NULL;
+	int              dir_fd;
+	int              r;
+
+	dir_fd = dirfd_cache_open_parent (extract_data->dirfd_cache, relative_path, &name, error);
+	if (dir_fd < 0)
+		return FALSE;
+
+	r = symlinkat (target, dir_fd, name);
+	if ((r < 0) && (errno == EEXIST)) {
+		gboolean removed;
+
+		removed = (unlinkat (dir_fd, name, 0) == 0);
+		if (! removed) {
+			/* the folder fd must not be used after the folder
+			 * is removed */
+			dirfd_cache_remove (extract_data->dirfd_cache, relative_path);
+			removed = (unlinkat (dir_fd, name, AT_REMOVEDIR) == 0);
+		}
+		if (removed)
+			r = symlinkat (target, dir_fd, name);
+		else
+			errno = EEXIST;
+	}
+	if (r < 0)
+		_g_set_error_from_errno (error, errno, relative_path);
+	close (dir_fd);
+
+	return r == 0;
+}
+
+
+static gboolean
+_extract_data_make_hard_link_at (ExtractData  *extract_data,
+				 const char   *relative_path,
+				 const char   *target_relative_path,
+				 GError      **error)
+{
+	g_autofree char *name = NULL;
+	g_autofree char *target_name = NULL;
+	int              dir_fd;
+	int              target_dir_fd;
+	int              r;
+
+	target_dir_fd = dirfd_cache_open_parent (extract_data->dirfd_cache, target_relative_path, &target_name, error);
+	if (target_dir_fd < 0)
+		return FALSE;
+
+	dir_fd = dirfd_cache_open_parent (extract_data->dirfd_cache, relative_path, &name, error);
+	if (dir_fd < 0) {
+		close (target_dir_fd);
+		return FALSE;
+	}
+
+	r = linkat (target_dir_fd, target_name, dir_fd, name, 0);
+	if (r < 0)
+		_g_set_error_from_errno (error, errno, relative_path);
+	close (dir_fd);
+	close (target_dir_fd);
+
+	return r == 0;
+}
+
+
+/* ExtractJob: a small file decoded in memory, written by the writer
+ * threads. */
+
+
+typedef struct {
+	GFile     *file;
+	char      *relative_path;
+	GBytes    *data;
+	GFileInfo *info;
+	time_t     mtime;
+} ExtractJob;
+
+
+static ExtractJob *
+extract_job_new (GFile      *file,
+		 const char *relative_path,
+		 GBytes     *data,
+		 GFileInfo  *info,
+		 time_t      mtime)
+{
+	ExtractJob *job;
+
+	job = g_new (ExtractJob, 1);
+	job->file = g_object_ref (file);
+	job->relative_path = g_strdup (relative_path);
+	job->data = g_bytes_ref (data);
+	job->info = info;
+	job->mtime = mtime;
+
+	return job;
+}
+
+
+static void
+extract_job_free (ExtractJob *job)
+{
+	g_object_unref (job->file);
+	g_free (job->relative_path);
+	g_bytes_unref (job->data);
+	_g_object_unref (job->info);
+	g_free (job);
+}
+
+
+static void
+extract_job_write (ExtractJob   *job,
+		   ExtractData  *extract_data,
+		   GError      **error)
+{
+	LoadData     *load_data = LOAD_DATA (extract_data);
+	GCancellable *cancellable = load_data->cancellable;
+	gsize         size = g_bytes_get_size (job->data);
+
+	if (_extract_data_skip_existing_file (extract_data, job->file, job->mtime, cancellable, error)) {
+		fr_archive_progress_inc_completed_bytes (load_data->archive, size);
+		return;
+	}
+	if (*error != NULL)
+		return;
+
+	fr_archive_progress_inc_completed_files (load_data->archive, 1);
+
+	if (extract_data->dirfd_cache != NULL) {
+		gint64 actual_offset = 0;
+		int    fd;
+
+		fd = _extract_data_create_file_at (extract_data, job->relative_path, error);
+		if (fd >= 0) {
+			gboolean written;
+
+			written = _extract_data_write_block (extract_data, NULL, fd, g_bytes_get_data (job->data, NULL), size, 0, &actual_offset, cancellable, error);
+			if (written)
+				_fd_set_attributes_from_info (fd, job->info);
+			_extract_data_close_file (fd, job->relative_path, written ? error : NULL);
+		}
+		else if (_g_error_is_symlink_in_path (*error)) {
+			g_warning ("Skipping '%s' file as it has symlink in parents.", job->relative_path);
+			g_clear_error (error);
+		}
+	}
+	else if (_extract_data_make_parents (extract_data, job->file, cancellable, error)) {
+		g_autoptr (GOutputStream) ostream = NULL;
+		gint64 actual_offset = 0;
+
+		ostream = (GOutputStream *) g_file_replace (job->file, NULL, FALSE, G_FILE_CREATE_REPLACE_DESTINATION, cancellable, error);
+		if ((ostream != NULL)
+		    && _extract_data_write_block (extract_data, ostream, -1, g_bytes_get_data (job->data, NULL), size, 0, &actual_offset, cancellable, error)
+		    && g_output_stream_close (ostream, cancellable, error))
+		{
+			_g_file_set_attributes_from_info (job->file, job->info, cancellable, NULL);
+		}
+	}
+}
+
+
+static void
+_extract_job_written_cb (UringFile *file,
+			 int        fd)
+{
+	ExtractJob *job = file->user_data;
+
+	_fd_set_attributes_from_info (fd, job->info);
+}
+
+
+/* Writes the files of the batch with io_uring, the ring is reused by the
+ * next batches.  Returns FALSE if a ring is not available. */
+static gboolean
+_extract_data_write_batch_with_uring (ExtractData  *extract_data,
+				      GPtrArray    *batch,
+				      GError      **error)
+{
+	LoadData              *load_data = LOAD_DATA (extract_data);
+	GCancellable          *cancellable = load_data->cancellable;
+	UringWriter           *writer;
+	g_autoptr (GPtrArray)  names = NULL;
+	g_autofree UringFile  *files = NULL;
+	guint                  n_files = 0;
+	guint                  i;
+
+	g_mutex_lock (&extract_data->mutex);
+	writer = g_queue_pop_head (extract_data->uring_writers);
+	g_mutex_unlock (&extract_data->mutex);
+
+	if (writer == NULL)
+		writer = uring_writer_new (EXTRACT_URING_BATCH_SIZE);
+	if (writer == NULL)
+		return FALSE;
+
+	names = g_ptr_array_new_with_free_func (g_free);
+	files = g_new0 (UringFile, batch->len);
+
+	for (i = 0; i < batch->len; i++) {
+		ExtractJob *job = g_ptr_array_index (batch, i);
+		char       *name = NULL;
+		int         dir_fd;
+
+		if (_extract_data_skip_existing_file (extract_data, job->file, job->mtime, cancellable, error)) {
+			fr_archive_progress_inc_completed_bytes (load_data->archive, g_bytes_get_size (job->data));
+			continue;
+		}
+		if (*error != NULL)
+			break;
+
+		fr_archive_progress_inc_completed_files (load_data->archive, 1);
+
+		dir_fd = dirfd_cache_open_parent (extract_data->dirfd_cache, job->relative_path, &name, error);
+		if (dir_fd < 0) {
+			if (! _g_error_is_symlink_in_path (*error))
+				break;
+			g_warning ("Skipping '%s' file as it has symlink in parents.", job->relative_path);
+			g_clear_error (error);
+			continue;
+		}
+
+		g_ptr_array_add (names, name);
+		files[n_files].dir_fd = dir_fd;
+		files[n_files].name = name;
+		files[n_files].mode = 0666;
+		files[n_files].data = g_bytes_get_data (job->data, &files[n_files].size);
+		files[n_files].user_data = job;
+		n_files++;
+	}
+
+	/* the attributes are set on the open files, before they are closed */
+
+	if (*error == NULL)
+		uring_writer_write_files (writer, files, n_files, _extract_job_written_cb);
+
+	for (i = 0; i < n_files; i++) {
+		if (*error == NULL) {
+			ExtractJob *job = files[i].user_data;
+
+			if (files[i].result == 0)
+				fr_archive_progress_inc_completed_bytes (load_data->archive, files[i].size);
+			else
+				_g_set_error_from_errno (error, -files[i].result, job->relative_path);
+		}
+		close (files[i].dir_fd);
+	}
+
+	g_mutex_lock (&extract_data->mutex);
+	g_queue_push_head (extract_data->uring_writers, writer);
+	g_mutex_unlock (&extract_data->mutex);
+
+	return TRUE;
+}
+
+
+static void
+extract_batch_run (GPtrArray   *batch,
+		   ExtractData *extract_data)
+{
+	GCancellable *cancellable = LOAD_DATA (extract_data)->cancellable;
+	gsize         size = 0;
+	GError       *error = NULL;
+	guint         i;
+
+	for (i = 0; i < batch->len; i++) {
+		ExtractJob *job = g_ptr_array_index (batch, i);
+		size += g_bytes_get_size (job->data);
+	}
 
+	if (! g_atomic_int_get (&extract_data->stop) && ! g_cancellable_is_cancelled (cancellable)) {
+		if (! extract_data->use_uring || ! _extract_data_write_batch_with_uring (extract_data, batch, &error)) {
+			for (i = 0; (i < batch->len) && (error == NULL); i++)
+				extract_job_write (g_ptr_array_index (batch, i), extract_data, &error);
+		}
+	}
 
-typedef struct {
-	LoadData    parent;
-	GList      *file_list;
-	GFile      *destination;
-	char       *base_dir;
-	gboolean    skip_older;
-	gboolean    overwrite;
-	gboolean    junk_paths;
-	GHashTable *files_to_extract;
-	int         n_files_to_extract;
-	GHashTable *usernames;
-	GHashTable *groupnames;
-	char       *null_buffer;
-} ExtractData;
+	g_mutex_lock (&extract_data->mutex);
+	if (error != NULL) {
+		if (extract_data->writer_error == NULL)
+			extract_data->writer_error = g_steal_pointer (&error);
+		g_atomic_int_set (&extract_data->stop, TRUE);
+	}
+	extract_data->queued_bytes -= size;
+	extract_data->queued_jobs -= batch->len;
+	for (i = 0; i < batch->len; i++) {
+		ExtractJob *job = g_ptr_array_index (batch, i);
+		g_hash_table_remove (extract_data->queued_files, job->file);
+	}
+	g_cond_broadcast (&extract_data->job_done);
+	g_mutex_unlock (&extract_data->mutex);
+
+	_g_error_free (error);
+	g_ptr_array_unref (batch);
+}
 
 
 static void
-extract_data_free (ExtractData *extract_data)
+_extract_data_flush_batch (ExtractData *extract_data,
+			   GThreadPool *pool)
 {
-	g_free (extract_data->base_dir);
-	_g_object_unref (extract_data->destination);
-	_g_string_list_free (extract_data->file_list);
-	g_hash_table_unref (extract_data->files_to_extract);
-	g_hash_table_unref (extract_data->usernames);
-	g_hash_table_unref (extract_data->groupnames);
-	g_free (extract_data->null_buffer);
-	load_data_free (LOAD_DATA (extract_data));
-}
+	if (extract_data->batch->len == 0)
+		return;
 
-G_DEFINE_AUTOPTR_CLEANUP_FUNC (ExtractData, extract_data_free)
+	g_thread_pool_push (pool, extract_data->batch, NULL);
+	extract_data->batch = g_ptr_array_new_with_free_func ((GDestroyNotify) extract_job_free);
+}
 
 
-static gboolean
-extract_data_get_extraction_requested (ExtractData *extract_data,
-				       const char  *pathname)
+/* Waits until there is room in the queue, this limits the memory used by the
+ * decoded files. */
+static void
+_extract_data_queue_job (ExtractData *extract_data,
+			 GThreadPool *pool,
+			 ExtractJob  *job)
 {
-	if (extract_data->file_list != NULL)
-		return g_hash_table_lookup (extract_data->files_to_extract, pathname) != NULL;
-	else
-		return TRUE;
+	gsize size = g_bytes_get_size (job->data);
+	guint batch_size = extract_data->use_uring ? EXTRACT_URING_BATCH_SIZE : 1;
+
+	g_mutex_lock (&extract_data->mutex);
+	while ((extract_data->queued_jobs >= EXTRACT_MAX_QUEUED_JOBS)
+	       || ((extract_data->queued_jobs > 0) && (extract_data->queued_bytes + size > EXTRACT_MAX_QUEUED_BYTES)))
+	{
+		/* the jobs in the pending batch are counted as queued */
+		if (extract_data->batch->len > 0) {
+			g_mutex_unlock (&extract_data->mutex);
+			_extract_data_flush_batch (extract_data, pool);
+			g_mutex_lock (&extract_data->mutex);
+			continue;
+		}
+		g_cond_wait (&extract_data->job_done, &extract_data->mutex);
+	}
+	extract_data->queued_jobs++;
+	extract_data->queued_bytes += size;
+	g_hash_table_add (extract_data->queued_files, g_object_ref (job->file));
+	g_mutex_unlock (&extract_data->mutex);
+
+	g_ptr_array_add (extract_data->batch, job);
+	if (extract_data->batch->len >= batch_size)
+		_extract_data_flush_batch (extract_data, pool);
 }
 
 
-static GFileInfo *
-_g_file_info_create_from_entry (struct archive_entry *entry,
-			        ExtractData          *extract_data)
+static void
+_extract_data_wait_for_jobs (ExtractData *extract_data,
+			     GThreadPool *pool)
 {
-	GFileInfo *info;
+	_extract_data_flush_batch (extract_data, pool);
 
-	info = g_file_info_new ();
+	g_mutex_lock (&extract_data->mutex);
+	while (extract_data->queued_jobs > 0)
+		g_cond_wait (&extract_data->job_done, &extract_data->mutex);
+	g_mutex_unlock (&extract_data->mutex);
+}
 
-	/* times */
 
-	if (archive_entry_mtime_is_set (entry))
-		g_file_info_set_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED, archive_entry_mtime (entry));
+static gboolean
+_extract_data_is_queued (ExtractData *extract_data,
+			 GFile       *file)
+{
+	gboolean queued;
 
-	/* username */
+	g_mutex_lock (&extract_data->mutex);
+	queued = g_hash_table_contains (extract_data->queued_files, file);
+	g_mutex_unlock (&extract_data->mutex);
 
-	if (archive_entry_uname (entry) != NULL) {
-		guint32 uid;
+	return queued;
+}
 
-		uid = GPOINTER_TO_INT (g_hash_table_lookup (extract_data->usernames, archive_entry_uname (entry)));
-		if (uid == 0) {
-			struct passwd *pwd = getpwnam (archive_entry_uname (entry));
-			if (pwd != NULL) {
-				uid = pwd->pw_uid;
-				g_hash_table_insert (extract_data->usernames, g_strdup (archive_entry_uname (entry)), GINT_TO_POINTER (uid));
-			}
+
+/* Reads the whole entry data, the holes of sparse files are filled with
+ * zeros. */
+static GBytes *
+_archive_read_data_to_bytes (struct archive *a,
+			     gint64          size,
+			     int            *r)
+{
+	GByteArray   *data;
+	const void   *buffer;
+	size_t        buffer_size;
+	__LA_INT64_T  offset = 0;
+
+	data = g_byte_array_sized_new (size);
+	while ((*r = archive_read_data_block (a, &buffer, &buffer_size, &offset)) == ARCHIVE_OK) {
+		if ((offset < 0) || (offset + (gint64) buffer_size > size)) {
+			*r = ARCHIVE_FATAL;
+			break;
 		}
-		if (uid != 0)
-			g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_UID, uid);
-	}
+		if (offset > data->len) {
+			guint len = data->len;
 
-	/* groupname */
+			g_byte_array_set_size (data, offset);
+			memset (data->data + len, 0, offset - len);
+		}
+		else
+			g_byte_array_set_size (data, offset);
+		g_byte_array_append (data, buffer, buffer_size);
+	}
 
-	if (archive_entry_gname (entry) != NULL) {
-		guint32 gid;
+	if ((*r == ARCHIVE_EOF) && (offset > data->len) && (offset <= size)) {
+		guint len = data->len;
 
-		gid = GPOINTER_TO_INT (g_hash_table_lookup (extract_data->groupnames, archive_entry_gname (entry)));
-		if (gid == 0) {
-			struct group *grp = getgrnam (archive_entry_gname (entry));
-			if (grp != NULL) {
-				gid = grp->gr_gid;
-				g_hash_table_insert (extract_data->groupnames, g_strdup (archive_entry_gname (entry)), GINT_TO_POINTER (gid));
-			}
-		}
-		if (gid != 0)
-			g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_GID, gid);
+		g_byte_array_set_size (data, offset);
+		memset (data->data + len, 0, offset - len);
 	}
 
-	/* permsissions */
+	return g_byte_array_free_to_bytes (data);
+}
 
-	g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_MODE, archive_entry_mode (entry));
 
-	return info;
+static int
+_zip_entry_cmp_offset (gconstpointer a,
+		       gconstpointer b)
+{
+	ZipEntry *entry_a = * (ZipEntry **) a;
+	ZipEntry *entry_b = * (ZipEntry **) b;
+
+	if (entry_a->local_header_offset < entry_b->local_header_offset)
+		return -1;
+	if (entry_a->local_header_offset > entry_b->local_header_offset)
+		return 1;
+	return 0;
 }
 
 
-static gboolean
-_g_file_set_attributes_from_info (GFile         *file,
-				  GFileInfo     *info,
-				  GCancellable  *cancellable,
-				  GError       **error)
+/* Looks up the requested entries in the zip central directory, sets
+ * extract_data->zip_entries only if all of them are found. */
+static void
+_extract_data_locate_zip_entries (ExtractData  *extract_data,
+				  GCancellable *cancellable)
 {
-	return g_file_set_attributes_from_info (file, info, G_FILE_QUERY_INFO_NONE, cancellable, error);
+	LoadData   *load_data = LOAD_DATA (extract_data);
+	const char *mime_type;
+	g_autoptr (GInputStream) istream = NULL;
+	g_autoptr (ZipDirectory) zip_dir = NULL;
+	GPtrArray  *entries;
+	guint       i;
+
+	if ((extract_data->file_list == NULL) || (extract_data->n_files_to_extract > EXTRACT_RANDOM_ACCESS_MAX_FILES))
+		return;
+
+	mime_type = fr_archive_get_mime_type (load_data->archive);
+	if (! _g_str_equal (mime_type, "application/zip") && ! _g_str_equal (mime_type, "application/x-cbz"))
+		return;
+
+	_archive_journal_restore (fr_archive_get_file (load_data->archive), NULL, cancellable, NULL);
+
+	istream = (GInputStream *) g_file_read (fr_archive_get_file (load_data->archive), cancellable, NULL);
+	if (istream == NULL)
+		return;
+
+	/* the names must be the ones reported by libarchive */
+
+	zip_dir = zip_directory_read (istream, cancellable, NULL);
+	if ((zip_dir == NULL) || ! zip_directory_names_are_utf8 (zip_dir))
+		return;
+
+	entries = g_ptr_array_new_with_free_func ((GDestroyNotify) zip_entry_free);
+	for (i = 0; i < zip_dir->entries->len; i++) {
+		ZipEntry *entry = g_ptr_array_index (zip_dir->entries, i);
+
+		if (g_hash_table_lookup (extract_data->files_to_extract, entry->name) != NULL)
+			g_ptr_array_add (entries, zip_entry_copy (entry));
+	}
+
+	if (entries->len != (guint) extract_data->n_files_to_extract) {
+		g_ptr_array_unref (entries);
+		return;
+	}
+
+	g_ptr_array_sort (entries, _zip_entry_cmp_offset);
+	extract_data->zip_entries = entries;
+	extract_data->next_entry = 0;
+}
+
+
+static int
+_goffset_cmp (gconstpointer a,
+	      gconstpointer b)
+{
+	goffset offset_a = * (goffset *) a;
+	goffset offset_b = * (goffset *) b;
+
+	if (offset_a < offset_b)
+		return -1;
+	if (offset_a > offset_b)
+		return 1;
+	return 0;
 }
 
 
+/* Looks up the requested members in the gzip index, sets
+ * extract_data->tar_offsets only if all of them are found. */
 static void
-restore_original_file_attributes (GHashTable    *created_files,
-				  GCancellable  *cancellable)
+_extract_data_locate_tar_entries (ExtractData  *extract_data,
+				  GCancellable *cancellable)
 {
-	GHashTableIter iter;
-	gpointer       key, value;
+	LoadData             *load_data = LOAD_DATA (extract_data);
+	g_autoptr (GVariant)  members = NULL;
+	GzipIndex            *index;
+	GArray               *offsets;
+	GVariantIter          iter;
+	const char           *pathname;
+	guint64               offset;
+
+	if ((extract_data->file_list == NULL)
+	    || (extract_data->n_files_to_extract > EXTRACT_RANDOM_ACCESS_MAX_FILES)
+	    || ! _archive_is_gzip_tar (load_data->archive))
+	{
+		return;
+	}
+
+	index = _gzip_index_load (load_data->archive, &members, cancellable);
+	if (index == NULL)
+		return;
 
-	g_hash_table_iter_init (&iter, created_files);
-	while (g_hash_table_iter_next (&iter, &key, &value)) {
-		GFile     *file = key;
-		GFileInfo *info = value;
+	offsets = g_array_new (FALSE, FALSE, sizeof (goffset));
+	g_variant_iter_init (&iter, members);
+	while (g_variant_iter_next (&iter, "{&st}", &pathname, &offset)) {
+		if (g_hash_table_lookup (extract_data->files_to_extract, pathname) != NULL) {
+			goffset value = offset;
+			g_array_append_val (offsets, value);
+		}
+	}
 
-		_g_file_set_attributes_from_info (file, info, cancellable, NULL);
+	if (offsets->len != (guint) extract_data->n_files_to_extract) {
+		g_array_unref (offsets);
+		gzip_index_free (index);
+		return;
 	}
+
+	g_array_sort (offsets, _goffset_cmp);
+	extract_data->tar_offsets = offsets;
+	extract_data->next_entry = 0;
+	load_data->gzip_index = index;
 }
 
 
-static gboolean
-_g_output_stream_add_padding (ExtractData    *extract_data,
-			      GOutputStream  *ostream,
-			      gssize          target_offset,
-			      gssize          actual_offset,
-			      GCancellable   *cancellable,
-			      GError        **error)
+/* Reads the next header sequentially, or, if the requested entries were
+ * located, creates a reader for the next requested entry. */
+static int
+_extract_data_read_next_header (ExtractData           *extract_data,
+				_archive_read_ctx    **a,
+				struct archive_entry **entry)
 {
-	gboolean success = TRUE;
-	gsize    count;
-	gsize    bytes_written;
+	LoadData *load_data = LOAD_DATA (extract_data);
+	int       r;
 
-	if (extract_data->null_buffer == NULL)
-		extract_data->null_buffer = g_malloc0 (NULL_BUFFER_SIZE);
+	if (extract_data->zip_entries != NULL) {
+		ZipEntry *zip_entry;
 
-	while (target_offset > actual_offset) {
-		count = NULL_BUFFER_SIZE;
-		if (target_offset < actual_offset + NULL_BUFFER_SIZE)
-			count = target_offset - actual_offset;
+		if (extract_data->next_entry >= extract_data->zip_entries->len)
+			return ARCHIVE_EOF;
 
-		success = g_output_stream_write_all (ostream, extract_data->null_buffer, count, &bytes_written, cancellable, error);
-		if (! success)
-			break;
+		zip_entry = g_ptr_array_index (extract_data->zip_entries, extract_data->next_entry++);
+		load_data->range_start = zip_entry->local_header_offset;
+		load_data->range_end = zip_entry->data_end;
 
-		actual_offset += bytes_written;
+		g_clear_pointer (a, _archive_read_ctx_free);
+		r = create_zip_entry_read_object (load_data, a);
+		if (r == ARCHIVE_OK)
+			r = zip_entry_read_archive_header (zip_entry, *a, entry);
+
+		return r;
 	}
+	else if (extract_data->tar_offsets != NULL) {
+		if (extract_data->next_entry >= extract_data->tar_offsets->len)
+			return ARCHIVE_EOF;
 
-	return success;
+		load_data->range_start = g_array_index (extract_data->tar_offsets, goffset, extract_data->next_entry++);
+		load_data->range_end = 0;
+
+		g_clear_pointer (a, _archive_read_ctx_free);
+		r = create_read_object (load_data, a);
+	}
+	else
+		return archive_read_next_header (*a, entry);
+
+	if (r == ARCHIVE_OK)
+		r = archive_read_next_header (*a, entry);
+
+	return r;
 }
 
+
 static gboolean
 _g_file_contains_symlinks_in_path (const char *relative_path,
 				   GFile      *destination,
@@ -774,43 +2805,65 @@ extract_archive_thread (GSimpleAsyncResult *result,
 {
 	g_autoptr (ExtractData) extract_data = NULL;
 	LoadData             *load_data;
-	g_autoptr (GHashTable) checked_folders = NULL;
-	g_autoptr (GHashTable) created_files = NULL;
-	g_autoptr (GHashTable) folders_created_during_extraction = NULL;
 	g_autoptr (GHashTable) symlinks = NULL;
 	g_autoptr (_archive_read_ctx) a = NULL;
+	GThreadPool          *pool;
 	struct archive_entry *entry;
 	int                   r;
 
 	extract_data = g_simple_async_result_get_op_res_gpointer (result);
 	load_data = LOAD_DATA (extract_data);
 
-	r = create_read_object (load_data, &a);
-	if (r != ARCHIVE_OK) {
-		return;
+	_extract_data_locate_zip_entries (extract_data, cancellable);
+	if (extract_data->zip_entries == NULL)
+		_extract_data_locate_tar_entries (extract_data, cancellable);
+
+	if ((extract_data->zip_entries == NULL) && (extract_data->tar_offsets == NULL)) {
+		r = create_read_object (load_data, &a);
+		if (r != ARCHIVE_OK) {
+			return;
+		}
+	}
+	else
+		a = archive_read_new (); /* replaced by a reader for each entry */
+
+	if (g_file_is_native (extract_data->destination)) {
+		g_autofree char *destination_path = g_file_get_path (extract_data->destination);
+
+		if (destination_path != NULL)
+			extract_data->dirfd_cache = dirfd_cache_new (destination_path, _extract_data_folder_created, extract_data, NULL);
 	}
 
-	checked_folders = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal, g_object_unref, NULL);
-	created_files = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal, g_object_unref, g_object_unref);
-	folders_created_during_extraction = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal, g_object_unref, NULL);
 	symlinks = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal, g_object_unref, NULL);
 	fr_archive_progress_set_total_files (load_data->archive, extract_data->n_files_to_extract);
 
-	while ((r = archive_read_next_header (a, &entry)) == ARCHIVE_OK) {
+	/* this thread decodes the archive, the small files are written by a
+	 * pool of writer threads. */
+
+	extract_data->use_uring = (extract_data->dirfd_cache != NULL) && uring_is_available ();
+	extract_data->batch = g_ptr_array_new_with_free_func ((GDestroyNotify) extract_job_free);
+	pool = g_thread_pool_new ((GFunc) extract_batch_run,
+				  extract_data,
+				  CLAMP (g_get_num_processors (), 1, EXTRACT_MAX_WRITERS),
+				  FALSE,
+				  NULL);
+
+	while ((r = _extract_data_read_next_header (extract_data, &a, &entry)) == ARCHIVE_OK) {
 		const char    *pathname;
 		g_autofree char * fullpath = NULL;
 		const char    *relative_path;
 		g_autoptr (GFile) file = NULL;
-		g_autoptr (GFile) parent = NULL;
 		g_autoptr (GOutputStream) ostream = NULL;
 		const void    *buffer;
 		size_t         buffer_size;
 		int64_t target_offset = 0;
 		int64_t actual_offset = 0;
+		int            fd = -1;
 		GError        *local_error = NULL;
 		__LA_MODE_T    filetype;
+		const char    *linkname;
 
-		if (g_cancellable_is_cancelled (cancellable))
+		if (g_cancellable_is_cancelled (cancellable) || g_atomic_int_get (&extract_data->stop))
 			break;
 
 		pathname = archive_entry_pathname (entry);
@@ -834,7 +2887,9 @@ extract_archive_thread (GSimpleAsyncResult *result,
 		 * those files here for sure. This is most probably malicious,
 		 * or corrupted archive.
 		 */
-		if (_g_file_contains_symlinks_in_path (relative_path, extract_data->destination, symlinks)) {
+		if ((extract_data->dirfd_cache == NULL)
+		    && _g_file_contains_symlinks_in_path (relative_path, extract_data->destination, symlinks))
+		{
 			g_warning ("Skipping '%s' file as it has symlink in parents.", relative_path);
 			fr_archive_progress_inc_completed_files (load_data->archive, 1);
 			fr_archive_progress_inc_completed_bytes (load_data->archive, archive_entry_size_is_set (entry) ? archive_entry_size (entry) : 0);
@@ -843,111 +2898,93 @@ extract_archive_thread (GSimpleAsyncResult *result,
 		}
 
 		file = g_file_get_child (extract_data->destination, relative_path);
+		filetype = archive_entry_filetype (entry);
+		linkname = archive_entry_hardlink (entry);
 
-		/* honor the skip_older and overwrite options */
+		/* Links depend on the files extracted before them, and the
+		 * same file can be stored more than once, the last one wins:
+		 * wait for the writer threads in these cases. */
+		if ((linkname != NULL) || (filetype == AE_IFLNK) || _extract_data_is_queued (extract_data, file))
+			_extract_data_wait_for_jobs (extract_data, pool);
 
-		if ((g_hash_table_lookup (folders_created_during_extraction, file) == NULL)
-		    && (extract_data->skip_older || ! extract_data->overwrite))
-		{
-			g_autoptr (GFileInfo) info = NULL;
-
-			info = g_file_query_info (file,
-						  G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME "," G_FILE_ATTRIBUTE_TIME_MODIFIED,
-						  G_FILE_QUERY_INFO_NONE,
-						  cancellable,
-						  &local_error);
-			if (info != NULL) {
-				gboolean skip = FALSE;
-
-				if (! extract_data->overwrite) {
-					skip = TRUE;
-				}
-				else if (extract_data->skip_older) {
-					GTimeVal modification_time;
+		/* small regular files are written by the writer threads */
 
-					g_file_info_get_modification_time (info, &modification_time);
-					if (archive_entry_mtime (entry) < modification_time.tv_sec)
-						skip = TRUE;
-				}
+		if ((filetype == AE_IFREG)
+		    && (linkname == NULL)
+		    && archive_entry_size_is_set (entry)
+		    && (archive_entry_size (entry) <= EXTRACT_JOB_MAX_FILE_SIZE))
+		{
+			g_autoptr (GBytes) data = NULL;
 
-				if (skip) {
-					archive_read_data_skip (a);
-					fr_archive_progress_inc_completed_bytes (load_data->archive, archive_entry_size_is_set (entry) ? archive_entry_size (entry) : 0);
+			data = _archive_read_data_to_bytes (a, archive_entry_size (entry), &r);
+			if (r != ARCHIVE_EOF) {
+				load_data->error = _g_error_new_from_archive_error (archive_error_string (a));
+				break;
+			}
 
-					if ((extract_data->file_list != NULL) && (--extract_data->n_files_to_extract == 0)) {
-						r = ARCHIVE_EOF;
-						break;
-					}
+			_extract_data_queue_job (extract_data,
+						 pool,
+						 extract_job_new (file,
+								  relative_path,
+								  data,
+								  _g_file_info_create_from_entry (entry, extract_data),
+								  archive_entry_mtime (entry)));
 
-					continue;
-				}
-			}
-			else {
-				if (! g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
-					load_data->error = local_error;
-					break;
-				}
-				g_clear_error (&local_error);
+			if ((extract_data->file_list != NULL) && (--extract_data->n_files_to_extract == 0)) {
+				r = ARCHIVE_EOF;
+				break;
 			}
-		}
 
-		fr_archive_progress_inc_completed_files (load_data->archive, 1);
+			continue;
+		}
 
-		/* create the file parents */
+		/* honor the skip_older and overwrite options */
 
-		parent = g_file_get_parent (file);
+		if (_extract_data_skip_existing_file (extract_data, file, archive_entry_mtime (entry), cancellable, &load_data->error)) {
+			archive_read_data_skip (a);
+			fr_archive_progress_inc_completed_bytes (load_data->archive, archive_entry_size_is_set (entry) ? archive_entry_size (entry) : 0);
 
-		if ((parent != NULL)
-		    && (g_hash_table_lookup (checked_folders, parent) == NULL)
-		    && ! g_file_query_exists (parent, cancellable))
-		{
-			if (! _g_file_make_directory_with_parents (parent,
-								   folders_created_during_extraction,
-								   cancellable,
-								   &local_error))
-			{
-				if (! g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_EXISTS))
-					load_data->error = local_error;
-				else
-					g_clear_error (&local_error);
+			if ((extract_data->file_list != NULL) && (--extract_data->n_files_to_extract == 0)) {
+				r = ARCHIVE_EOF;
+				break;
 			}
 
-			if (load_data->error == NULL) {
-				GFile *grandparent;
-
-				grandparent = g_object_ref (parent);
-				while (grandparent != NULL) {
-					if (g_hash_table_lookup (checked_folders, grandparent) == NULL)
-						g_hash_table_insert (checked_folders, grandparent, GINT_TO_POINTER (1));
-					grandparent = g_file_get_parent (grandparent);
-				}
-			}
+			continue;
 		}
+		if (load_data->error != NULL)
+			break;
 
-		/* create the file */
+		fr_archive_progress_inc_completed_files (load_data->archive, 1);
 
-		filetype = archive_entry_filetype (entry);
+		/* create the file parents, done by the DirfdCache for local
+		 * destinations */
 
-		if (load_data->error == NULL) {
-			const char  *linkname;
-
-			linkname = archive_entry_hardlink (entry);
-			if (linkname != NULL) {
-				g_autofree char *link_fullpath = NULL;
-				const char *relative_path;
-				g_autoptr (GFile) link_file = NULL;
-				g_autofree char *oldname = NULL;
-				g_autofree char *newname = NULL;
-				int          r;
-
-				link_fullpath = (*linkname == '/') ? g_strdup (linkname) : g_strconcat ("/", linkname, NULL);
-				relative_path = _g_path_get_relative_basename_safe (link_fullpath, extract_data->base_dir, extract_data->junk_paths);
-				if (relative_path == NULL) {
-					archive_read_data_skip (a);
-					continue;
-				}
+		if (extract_data->dirfd_cache == NULL)
+			_extract_data_make_parents (extract_data, file, cancellable, &load_data->error);
+
+		/* create the file */
 
-				link_file = g_file_get_child (extract_data->destination, relative_path);
+		if ((load_data->error == NULL) && (linkname != NULL)) {
+			g_autofree char *link_fullpath = NULL;
+			const char *link_relative_path;
+			g_autoptr (GFile) link_file = NULL;
+			g_autofree char *oldname = NULL;
+			g_autofree char *newname = NULL;
+			int          r;
+
+			link_fullpath = (*linkname == '/') ? g_strdup (linkname) : g_strconcat ("/", linkname, NULL);
+			link_relative_path = _g_path_get_relative_basename_safe (link_fullpath, extract_data->base_dir, extract_data->junk_paths);
+			if (link_relative_path == NULL) {
+				archive_read_data_skip (a);
+				continue;
+			}
+
+			if (extract_data->dirfd_cache != NULL) {
+				r = _extract_data_make_hard_link_at (extract_data, relative_path, link_relative_path, &local_error) ? 0 : -1;
+				g_clear_error (&local_error);
+			}
+			else {
+				link_file = g_file_get_child (extract_data->destination, link_relative_path);
 				oldname = g_file_get_path (link_file);
 				newname = g_file_get_path (file);
 
@@ -955,72 +2992,85 @@ extract_archive_thread (GSimpleAsyncResult *result,
 					r = link (oldname, newname);
 				else
 					r = -1;
+			}
 
-				if (r == 0) {
-					__LA_INT64_T filesize;
+			if (r == 0) {
+				__LA_INT64_T filesize;
 
-					if (archive_entry_size_is_set (entry))
-						filesize = archive_entry_size (entry);
-					else
-						filesize = -1;
+				if (archive_entry_size_is_set (entry))
+					filesize = archive_entry_size (entry);
+				else
+					filesize = -1;
 
-					if (filesize > 0)
-						filetype = AE_IFREG; /* treat as a regular file to save the data */
-				}
-				else {
-					g_autofree char *uri = g_file_get_uri (file);
-					g_autofree char *msg = g_strdup_printf ("Could not create the hard link %s", uri);
-					load_data->error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_FAILED, msg);
-				}
+				if (filesize > 0)
+					filetype = AE_IFREG; /* treat as a regular file to save the data */
+			}
+			else {
+				g_autofree char *uri = g_file_get_uri (file);
+				g_autofree char *msg = g_strdup_printf ("Could not create the hard link %s", uri);
+				load_data->error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_FAILED, msg);
 			}
 		}
 
 		if (load_data->error == NULL) {
 			switch (filetype) {
 			case AE_IFDIR:
-				if (! g_file_make_directory (file, cancellable, &local_error)) {
-					if (! g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_EXISTS))
-						load_data->error = g_error_copy (local_error);
-					g_clear_error (&local_error);
+				if (extract_data->dirfd_cache != NULL)
+					_extract_data_make_directory_at (extract_data, relative_path, &load_data->error);
+				else {
+					g_mutex_lock (&extract_data->mutex);
+					if (! g_file_make_directory (file, cancellable, &local_error)) {
+						if (! g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_EXISTS))
+							load_data->error = g_error_copy (local_error);
+						g_clear_error (&local_error);
+					}
+					g_mutex_unlock (&extract_data->mutex);
 				}
 				if (load_data->error == NULL)
-					g_hash_table_insert (created_files, g_object_ref (file), _g_file_info_create_from_entry (entry, extract_data));
+					_extract_data_add_created_folder (extract_data, file, _g_file_info_create_from_entry (entry, extract_data));
 				archive_read_data_skip (a);
 				break;
 
 			case AE_IFREG:
-				ostream = (GOutputStream *) g_file_replace (file, NULL, FALSE, G_FILE_CREATE_REPLACE_DESTINATION, cancellable, &load_data->error);
-				if (ostream == NULL)
+				if (extract_data->dirfd_cache != NULL)
+					fd = _extract_data_create_file_at (extract_data, relative_path, &load_data->error);
+				else
+					ostream = (GOutputStream *) g_file_replace (file, NULL, FALSE, G_FILE_CREATE_REPLACE_DESTINATION, cancellable, &load_data->error);
+				if ((ostream == NULL) && (fd < 0))
 					break;
 
 				while ((r = archive_read_data_block (a, &buffer, &buffer_size, &target_offset)) == ARCHIVE_OK) {
-					gsize bytes_written;
-
-					if (target_offset > actual_offset) {
-						if (! _g_output_stream_add_padding (extract_data, ostream, target_offset, actual_offset, cancellable, &load_data->error))
-							break;
-						fr_archive_progress_inc_completed_bytes (load_data->archive, target_offset - actual_offset);
-						actual_offset = target_offset;
-					}
-
-					if (! g_output_stream_write_all (ostream, buffer, buffer_size, &bytes_written, cancellable, &load_data->error))
+					if (! _extract_data_write_block (extract_data, ostream, fd, buffer, buffer_size, target_offset, &actual_offset, cancellable, &load_data->error))
 						break;
-
-					actual_offset += bytes_written;
-					fr_archive_progress_inc_completed_bytes (load_data->archive, bytes_written);
 				}
 
 				if ((r == ARCHIVE_EOF) && (target_offset > actual_offset))
-					_g_output_stream_add_padding (extract_data, ostream, target_offset, actual_offset, cancellable, &load_data->error);
+					_extract_data_write_block (extract_data, ostream, fd, NULL, 0, target_offset, &actual_offset, cancellable, &load_data->error);
 
-				if (r != ARCHIVE_EOF)
+				if ((r != ARCHIVE_EOF) && (load_data->error == NULL))
 					load_data->error = _g_error_new_from_archive_error (archive_error_string (a));
-				else
-					g_hash_table_insert (created_files, g_object_ref (file), _g_file_info_create_from_entry (entry, extract_data));
+
+				/* restore the attributes as soon as the file is
+				 * written, only the folders are restored at the
+				 * end */
+
+				if (fd >= 0) {
+					if (load_data->error == NULL) {
+						g_autoptr (GFileInfo) info = _g_file_info_create_from_entry (entry, extract_data);
+						_fd_set_attributes_from_info (fd, info);
+					}
+					_extract_data_close_file (fd, relative_path, (load_data->error == NULL) ? &load_data->error : NULL);
+				}
+				else if ((load_data->error == NULL) && g_output_stream_close (ostream, cancellable, &load_data->error)) {
+					g_autoptr (GFileInfo) info = _g_file_info_create_from_entry (entry, extract_data);
+					_g_file_set_attributes_from_info (file, info, cancellable, NULL);
+				}
 				break;
 
 			case AE_IFLNK:
-				if (! g_file_make_symbolic_link (file, archive_entry_symlink (entry), cancellable, &local_error)) {
+				if (extract_data->dirfd_cache != NULL)
+					_extract_data_make_symbolic_link_at (extract_data, relative_path, archive_entry_symlink (entry), &load_data->error);
+				else if (! g_file_make_symbolic_link (file, archive_entry_symlink (entry), cancellable, &local_error)) {
 					if (g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_EXISTS)) {
 						g_clear_error (&local_error);
 						if (g_file_delete (file, cancellable, &local_error)) {
@@ -1046,6 +3096,11 @@ extract_archive_thread (GSimpleAsyncResult *result,
 			}
 		}
 
+		if ((extract_data->dirfd_cache != NULL) && _g_error_is_symlink_in_path (load_data->error)) {
+			g_warning ("Skipping '%s' file as it has symlink in parents.", relative_path);
+			g_clear_error (&load_data->error);
+		}
+
 		if (load_data->error != NULL)
 			break;
 
@@ -1055,8 +3110,20 @@ extract_archive_thread (GSimpleAsyncResult *result,
 		}
 	}
 
+	/* wait for the writer threads */
+
+	if (load_data->error != NULL)
+		g_atomic_int_set (&extract_data->stop, TRUE);
+	_extract_data_flush_batch (extract_data, pool);
+	g_thread_pool_free (pool, FALSE, TRUE);
+	g_queue_foreach (extract_data->uring_writers, (GFunc) uring_writer_free, NULL);
+	g_queue_clear (extract_data->uring_writers);
+
+	if ((load_data->error == NULL) && (extract_data->writer_error != NULL))
+		load_data->error = g_steal_pointer (&extract_data->writer_error);
+
 	if (load_data->error == NULL)
-		restore_original_file_attributes (created_files, cancellable);
+		restore_original_folder_attributes (extract_data->created_folders, cancellable);
 
 	if ((load_data->error == NULL) && (r != ARCHIVE_EOF))
 		load_data->error = _g_error_new_from_archive_error (archive_error_string (a));
@@ -1106,6 +3173,15 @@ fr_archive_libarchive_extract_files (FrArchive           *archive,
 	extract_data->n_files_to_extract = 0;
 	extract_data->usernames = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 	extract_data->groupnames = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	extract_data->checked_folders = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal, g_object_unref, NULL);
+	extract_data->created_folders = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal, g_object_unref, g_object_unref);
+	extract_data->folders_created_during_extraction = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal, g_object_unref, NULL);
+	extract_data->uring_writers = g_queue_new ();
+	extract_data->queued_files = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal, g_object_unref, NULL);
+	extract_data->null_buffer = g_malloc0 (NULL_BUFFER_SIZE);
+	extract_data->sparse = g_file_is_native (destination);
+	g_mutex_init (&extract_data->mutex);
+	g_cond_init (&extract_data->job_done);
 
 	for (scan = extract_data->file_list; scan; scan = scan->next) {
 		g_hash_table_insert (extract_data->files_to_extract, scan->data, GINT_TO_POINTER (1));
@@ -1124,20 +3200,23 @@ fr_archive_libarchive_extract_files (FrArchive           *archive,
 
 
 typedef struct {
-	GFile *file;
-	char  *pathname;
+	GFile     *file;
+	char      *pathname;
+	GFileInfo *info;        /* the info read by the scan, can be NULL */
 } AddFile;
 
 
 static AddFile *
 add_file_new (GFile      *file,
-	      const char *archive_pathname)
+	      const char *archive_pathname,
+	      GFileInfo  *info)
 {
 	AddFile *add_file;
 
 	add_file = g_new (AddFile, 1);
 	add_file->file = g_object_ref (file);
 	add_file->pathname = g_strdup (archive_pathname);
+	add_file->info = _g_object_ref (info);
 
 	return add_file;
 }
@@ -1148,10 +3227,34 @@ add_file_free (AddFile *add_file)
 {
 	g_object_unref (add_file->file);
 	g_free (add_file->pathname);
+	_g_object_unref (add_file->info);
 	g_free (add_file);
 }
 
 
+/* Returns the info read by the scan if it describes the file as requested
+ * by @follow_link, otherwise queries the file. */
+static GFileInfo *
+_add_file_query_info (AddFile       *add_file,
+		      gboolean       follow_link,
+		      GCancellable  *cancellable,
+		      GError       **error)
+{
+	if ((add_file->info != NULL)
+	    && (! g_file_info_get_is_symlink (add_file->info)
+		|| (follow_link == (g_file_info_get_file_type (add_file->info) != G_FILE_TYPE_SYMBOLIC_LINK))))
+	{
+		return g_object_ref (add_file->info);
+	}
+
+	return g_file_query_info (add_file->file,
+				  FILE_ATTRIBUTES_NEEDED_BY_ARCHIVE_ENTRY,
+				  (! follow_link ? G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS : 0),
+				  cancellable,
+				  error);
+}
+
+
 /* -- _fr_archive_libarchive_save -- */
 
 
@@ -1181,6 +3284,7 @@ struct _SaveData {
 	gboolean         encrypt_header;
 	FrCompression    compression;
 	guint            volume_size;
+	gboolean         append;
 	void            *buffer;
 	gsize            buffer_size;
 	SaveDataFunc     begin_operation;
@@ -1189,9 +3293,24 @@ struct _SaveData {
 	gpointer         user_data;
 	GDestroyNotify   user_data_notify;
 	struct archive  *b;
+	GFile           *additions_file;
+	GOutputStream   *additions_ostream;
+	GFileIOStream   *iostream;
+	GzipWriter      *gzip_writer;
+	archive_write_callback *write_func;
+	archive_close_callback *close_func;
+	ZipWriter       *zip_writer;
+	GThreadPool     *zip_pool;
+	GQueue          *zip_jobs;
+	goffset          zip_spilled_size;
+	GMutex           zip_mutex;
+	GCond            zip_cond;
 };
 
 
+static void _save_data_stop_zip_jobs (SaveData *save_data);
+
+
 static void
 save_data_init (SaveData *save_data)
 {
@@ -1200,6 +3319,8 @@ save_data_init (SaveData *save_data)
 	save_data->buffer = g_new (char, save_data->buffer_size);
 	save_data->usernames = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, g_free);
 	save_data->groupnames = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, g_free);
+	g_mutex_init (&save_data->zip_mutex);
+	g_cond_init (&save_data->zip_cond);
 }
 
 
@@ -1214,30 +3335,48 @@ save_data_free (SaveData *save_data)
 	g_hash_table_unref (save_data->usernames);
 	_g_object_unref (save_data->ostream);
 	_g_object_unref (save_data->tmp_file);
+	_g_object_unref (save_data->additions_ostream);
+	_g_object_unref (save_data->additions_file);
+	if (save_data->gzip_writer != NULL)
+		gzip_writer_free (save_data->gzip_writer);
+	_save_data_stop_zip_jobs (save_data);
+	g_mutex_clear (&save_data->zip_mutex);
+	g_cond_clear (&save_data->zip_cond);
 	load_data_free (LOAD_DATA (save_data));
 }
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (SaveData, save_data_free)
 
 
+static GOutputStream *
+_save_data_create_tmp_file (SaveData  *save_data,
+			    GFile    **tmp_file)
+{
+	LoadData *load_data = LOAD_DATA (save_data);
+	g_autoptr (GFile) parent = NULL;
+	g_autofree char * basename = NULL;
+	g_autofree char * tmpname = NULL;
+
+	parent = g_file_get_parent (fr_archive_get_file (load_data->archive));
+	basename = g_file_get_basename (fr_archive_get_file (load_data->archive));
+	tmpname = _g_filename_get_random (16, basename);
+	*tmp_file = g_file_get_child (parent, tmpname);
+
+	return (GOutputStream *) g_file_create (*tmp_file, G_FILE_CREATE_NONE, load_data->cancellable, &load_data->error);
+}
+
+
 static int
 save_data_open (struct archive *a,
 	        void           *client_data)
 {
 	SaveData *save_data = client_data;
 	LoadData *load_data = LOAD_DATA (save_data);
-	g_autoptr (GFile) parent = NULL;
-	g_autofree char * basename = NULL;
-	g_autofree char * tmpname = NULL;
 
 	if (load_data->error != NULL)
 		return ARCHIVE_FATAL;
 
-	parent = g_file_get_parent (fr_archive_get_file (load_data->archive));
-	basename = g_file_get_basename (fr_archive_get_file (load_data->archive));
-	tmpname = _g_filename_get_random (16, basename);
-	save_data->tmp_file = g_file_get_child (parent, tmpname);
-	save_data->ostream = (GOutputStream *) g_file_create (save_data->tmp_file, G_FILE_CREATE_NONE, load_data->cancellable, &load_data->error);
+	save_data->ostream = _save_data_create_tmp_file (save_data, &save_data->tmp_file);
 
 	return (save_data->ostream != NULL) ? ARCHIVE_OK : ARCHIVE_FATAL;
 }
@@ -1291,6 +3430,157 @@ save_data_close (struct archive *a,
 }
 
 
+/* The zip entries added or updated while copying the other entries verbatim
+ * are written to a separate temporary archive, see save_zip_archive_raw. */
+
+
+static int
+additions_data_open (struct archive *a,
+		     void           *client_data)
+{
+	SaveData *save_data = client_data;
+	LoadData *load_data = LOAD_DATA (save_data);
+
+	if (load_data->error != NULL)
+		return ARCHIVE_FATAL;
+
+	save_data->additions_ostream = _save_data_create_tmp_file (save_data, &save_data->additions_file);
+
+	return (save_data->additions_ostream != NULL) ? ARCHIVE_OK : ARCHIVE_FATAL;
+}
+
+
+static ssize_t
+additions_data_write (struct archive *a,
+		      void           *client_data,
+		      const void     *buff,
+		      size_t          n)
+{
+	SaveData *save_data = client_data;
+	LoadData *load_data = LOAD_DATA (save_data);
+
+	if (load_data->error != NULL)
+		return -1;
+
+	return g_output_stream_write (save_data->additions_ostream, buff, n, load_data->cancellable, &load_data->error);
+}
+
+
+static int
+additions_data_close (struct archive *a,
+		      void           *client_data)
+{
+	SaveData *save_data = client_data;
+	LoadData *load_data = LOAD_DATA (save_data);
+
+	if (save_data->additions_ostream != NULL) {
+		GError *error = NULL;
+
+		g_output_stream_close (save_data->additions_ostream, load_data->cancellable, &error);
+		if (load_data->error == NULL && error != NULL)
+			load_data->error = g_error_copy (error);
+
+		_g_error_free (error);
+	}
+
+	return ARCHIVE_OK;
+}
+
+
+/* Gzip archives are compressed in parallel by a GzipWriter placed between
+ * libarchive, that writes an uncompressed tar, and the write callback. */
+
+
+static gboolean
+_save_data_write_compressed (const void  *buffer,
+			     gsize        size,
+			     gpointer     user_data,
+			     GError     **error)
+{
+	SaveData     *save_data = user_data;
+	const guchar *data = buffer;
+
+	while (size > 0) {
+		ssize_t n;
+
+		n = save_data->write_func (save_data->b, save_data, data, size);
+		if (n <= 0) {
+			g_set_error_literal (error, FR_ERROR, FR_ERROR_COMMAND_ERROR, "Write failed");
+			return FALSE;
+		}
+		data += n;
+		size -= n;
+	}
+
+	return TRUE;
+}
+
+
+static void
+_save_data_set_error (SaveData *save_data,
+		      GError   *error)
+{
+	LoadData *load_data = LOAD_DATA (save_data);
+
+	if (load_data->error == NULL)
+		load_data->error = error;
+	else
+		_g_error_free (error);
+}
+
+
+static ssize_t
+gzip_data_write (struct archive *a,
+		 void           *client_data,
+		 const void     *buff,
+		 size_t          n)
+{
+	SaveData *save_data = client_data;
+	GError   *error = NULL;
+
+	if (LOAD_DATA (save_data)->error != NULL)
+		return -1;
+
+	if (! gzip_writer_write (save_data->gzip_writer, buff, n, &error)) {
+		_save_data_set_error (save_data, error);
+		return -1;
+	}
+
+	return n;
+}
+
+
+static int
+gzip_data_close (struct archive *a,
+		 void           *client_data)
+{
+	SaveData *save_data = client_data;
+	GError   *error = NULL;
+
+	if ((LOAD_DATA (save_data)->error == NULL) && ! gzip_writer_close (save_data->gzip_writer, &error))
+		_save_data_set_error (save_data, error);
+
+	return (save_data->close_func != NULL) ? save_data->close_func (a, client_data) : ARCHIVE_OK;
+}
+
+
+static int
+_archive_write_open (struct archive         *a,
+		     SaveData               *save_data,
+		     archive_open_callback  *open_func,
+		     archive_write_callback *write_func,
+		     archive_close_callback *close_func)
+{
+	if (save_data->gzip_writer == NULL)
+		return archive_write_open (a, save_data, open_func, write_func, close_func);
+
+	save_data->write_func = write_func;
+	save_data->close_func = close_func;
+
+	return archive_write_open (a, save_data, open_func, gzip_data_write, gzip_data_close);
+}
+
+
 static void
 _archive_write_set_format_from_context (struct archive *a,
 					SaveData       *save_data)
@@ -1365,7 +3655,11 @@ _archive_write_set_format_from_context (struct archive *a,
 	/* set the filter */
 
 	if (archive_filter != ARCHIVE_FILTER_NONE) {
-		char *compression_level = NULL;
+		char             *compression_level = NULL;
+		g_autofree char  *threads = NULL;
+
+		threads = fr_get_thread_count ();
+		g_clear_pointer (&save_data->gzip_writer, gzip_writer_free);
 
 		switch (archive_filter) {
 		case ARCHIVE_FILTER_BZIP2:
@@ -1375,7 +3669,12 @@ _archive_write_set_format_from_context (struct archive *a,
 			archive_write_add_filter_compress (a);
 			break;
 		case ARCHIVE_FILTER_GZIP:
-			archive_write_add_filter_gzip (a);
+			/* with more than one thread the data is compressed
+			 * by the gzip_writer, see _archive_write_open. */
+			if (g_ascii_strtoull (threads, NULL, 10) > 1)
+				archive_write_add_filter_none (a);
+			else
+				archive_write_add_filter_gzip (a);
 			break;
 		case ARCHIVE_FILTER_LRZIP:
 			archive_write_add_filter_lrzip (a);
@@ -1439,14 +3738,24 @@ _archive_write_set_format_from_context (struct archive *a,
 				break;
 			}
 		}
+		if ((archive_filter == ARCHIVE_FILTER_GZIP) && (g_ascii_strtoull (threads, NULL, 10) > 1)) {
+			save_data->gzip_writer = gzip_writer_new ((compression_level != NULL) ? atoi (compression_level) : -1,
+								  g_ascii_strtoull (threads, NULL, 10),
+								  _save_data_write_compressed,
+								  save_data);
+			compression_level = NULL;
+		}
 		if (compression_level != NULL)
 			archive_write_set_filter_option (a, NULL, "compression-level", compression_level);
 
 		/* set the amount of threads */
 
-		if (archive_filter == ARCHIVE_FILTER_XZ) {
-			archive_write_set_filter_option (a, NULL, "threads", fr_get_thread_count());
-                }
+		if (archive_filter == ARCHIVE_FILTER_XZ)
+			archive_write_set_filter_option (a, NULL, "threads", threads);
+#if (ARCHIVE_VERSION_NUMBER >= 3006000)
+		if (archive_filter == ARCHIVE_FILTER_ZSTD)
+			archive_write_set_filter_option (a, NULL, "threads", threads);
+#endif
 	}
 }
 
@@ -1541,7 +3850,305 @@ _archive_entry_copy_file_info (struct archive_entry *entry,
 	if (groupname != NULL)
 		archive_entry_set_gname (entry, groupname);
 
-	return TRUE;
+	return TRUE;
+}
+
+
+/* -- parallel zip compression --
+ *
+ * Zip entries are compressed independently: when adding files to a zip
+ * archive every entry is compressed by a pool of threads into a separate
+ * single-entry zip, kept in memory or, for the larger files, in a temporary
+ * file next to the archive.  The save thread copies the entries in order into
+ * the output with a ZipWriter, that writes the central directory at the end. */
+
+
+#define ZIP_JOB_MAX_MEMORY_SIZE (4 * 1024 * 1024)
+#define ZIP_MAX_SPILLED_SIZE (512 * 1024 * 1024)
+#define ZIP_MAX_QUEUED_JOBS_PER_THREAD 4
+
+
+typedef struct {
+	SaveData             *save_data;
+	GFile                *file;
+	struct archive_entry *entry;
+	GOutputStream        *ostream;
+	GFile                *spill_file;
+	GFileIOStream        *spill_stream;
+	goffset               spill_size;
+	GError               *error;
+	gboolean              done;
+} ZipJob;
+
+
+static ZipJob *
+zip_job_new (SaveData             *save_data,
+	     GFile                *file,
+	     struct archive_entry *entry,
+	     GFileInfo            *info)
+{
+	ZipJob *job;
+
+	job = g_new0 (ZipJob, 1);
+	job->save_data = save_data;
+	job->file = g_object_ref (file);
+	job->entry = entry;
+
+	if (g_file_info_get_size (info) > ZIP_JOB_MAX_MEMORY_SIZE) {
+		g_autoptr (GFile) parent = NULL;
+		g_autofree char  *name = NULL;
+
+		/* not in the temporary folder, that can be in memory */
+		parent = g_file_get_parent (fr_archive_get_file (LOAD_DATA (save_data)->archive));
+		name = _g_filename_get_random (16, ".zip");
+		job->spill_file = g_file_get_child (parent, name);
+		job->spill_stream = g_file_create_readwrite (job->spill_file, G_FILE_CREATE_PRIVATE, LOAD_DATA (save_data)->cancellable, &job->error);
+		if (job->spill_stream != NULL) {
+			job->ostream = g_object_ref (g_io_stream_get_output_stream (G_IO_STREAM (job->spill_stream)));
+			job->spill_size = g_file_info_get_size (info);
+		}
+		else
+			g_clear_object (&job->spill_file);
+	}
+	else
+		job->ostream = g_memory_output_stream_new_resizable ();
+
+	return job;
+}
+
+
+static void
+zip_job_free (ZipJob *job)
+{
+	_g_object_unref (job->ostream);
+	if (job->spill_stream != NULL) {
+		g_io_stream_close (G_IO_STREAM (job->spill_stream), NULL, NULL);
+		g_object_unref (job->spill_stream);
+	}
+	if (job->spill_file != NULL) {
+		g_file_delete (job->spill_file, NULL, NULL);
+		g_object_unref (job->spill_file);
+	}
+	archive_entry_free (job->entry);
+	g_object_unref (job->file);
+	_g_error_free (job->error);
+	g_free (job);
+}
+
+
+static ssize_t
+zip_job_write (struct archive *a,
+	       void           *client_data,
+	       const void     *buff,
+	       size_t          n)
+{
+	ZipJob *job = client_data;
+
+	if (job->error != NULL)
+		return -1;
+
+	return g_output_stream_write (job->ostream, buff, n, LOAD_DATA (job->save_data)->cancellable, &job->error);
+}
+
+
+static void
+zip_job_run (ZipJob   *job,
+	     SaveData *save_data)
+{
+	LoadData *load_data = LOAD_DATA (save_data);
+	g_autoptr (_archive_write_ctx) b = NULL;
+	int       rb;
+
+	if ((job->error == NULL) && ! g_cancellable_set_error_if_cancelled (load_data->cancellable, &job->error)) {
+		b = archive_write_new ();
+		_archive_write_set_format_from_context (b, save_data);
+		archive_write_open (b, job, NULL, zip_job_write, NULL);
+		archive_write_set_bytes_in_last_block (b, 1);
+
+		rb = archive_write_header (b, job->entry);
+		if ((rb > ARCHIVE_FAILED) && (archive_entry_filetype (job->entry) == AE_IFREG)) {
+			g_autoptr (GInputStream) istream = NULL;
+			g_autofree void *buffer = NULL;
+
+			istream = (GInputStream *) g_file_read (job->file, load_data->cancellable, &job->error);
+			if (istream != NULL) {
+				gssize bytes_read;
+
+				buffer = g_malloc (BUFFER_SIZE);
+				while ((bytes_read = g_input_stream_read (istream, buffer, BUFFER_SIZE, load_data->cancellable, &job->error)) > 0) {
+					if (archive_write_data (b, buffer, bytes_read) < 0)
+						break;
+					fr_archive_progress_inc_completed_bytes (load_data->archive, bytes_read);
+				}
+			}
+		}
+		if (rb > ARCHIVE_FAILED)
+			rb = archive_write_finish_entry (b);
+		if (rb > ARCHIVE_FAILED)
+			rb = archive_write_close (b);
+
+		if ((job->error == NULL) && (rb <= ARCHIVE_FAILED))
+			job->error = _g_error_new_from_archive_error (archive_error_string (b));
+		if ((job->error == NULL) && (job->spill_stream == NULL))
+			g_output_stream_close (job->ostream, load_data->cancellable, &job->error);
+	}
+
+	g_mutex_lock (&save_data->zip_mutex);
+	job->done = TRUE;
+	g_cond_broadcast (&save_data->zip_cond);
+	g_mutex_unlock (&save_data->zip_mutex);
+}
+
+
+static gboolean
+_save_data_copy_zip_job (SaveData  *save_data,
+			 ZipJob    *job,
+			 GError   **error)
+{
+	LoadData *load_data = LOAD_DATA (save_data);
+	g_autoptr (GInputStream) istream = NULL;
+	g_autoptr (ZipDirectory) zip_dir = NULL;
+
+	if (job->error != NULL) {
+		*error = g_error_copy (job->error);
+		return FALSE;
+	}
+
+	if (job->spill_stream != NULL)
+		istream = g_object_ref (g_io_stream_get_input_stream (G_IO_STREAM (job->spill_stream)));
+	else {
+		g_autoptr (GBytes) bytes = NULL;
+
+		bytes = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (job->ostream));
+		istream = g_memory_input_stream_new_from_bytes (bytes);
+	}
+
+	zip_dir = zip_directory_read (istream, load_data->cancellable, error);
+	if (zip_dir == NULL)
+		return FALSE;
+	if (zip_dir->entries->len != 1) {
+		g_set_error_literal (error, FR_ERROR, FR_ERROR_COMMAND_ERROR, "Invalid zip entry");
+		return FALSE;
+	}
+
+	return zip_writer_copy_entry (save_data->zip_writer,
+				      istream,
+				      g_ptr_array_index (zip_dir->entries, 0),
+				      NULL,
+				      load_data->cancellable,
+				      error);
+}
+
+
+/* Copies the compressed entries in order, waiting for the compression to
+ * finish until there are at most @max_jobs jobs in the queue. */
+static void
+_save_data_write_zip_jobs (SaveData *save_data,
+			   guint     max_jobs)
+{
+	LoadData *load_data = LOAD_DATA (save_data);
+
+	for (;;) {
+		ZipJob *job;
+
+		g_mutex_lock (&save_data->zip_mutex);
+		job = g_queue_peek_head (save_data->zip_jobs);
+		while ((job != NULL) && ! job->done && (g_queue_get_length (save_data->zip_jobs) > max_jobs))
+			g_cond_wait (&save_data->zip_cond, &save_data->zip_mutex);
+		if ((job == NULL) || ! job->done) {
+			g_mutex_unlock (&save_data->zip_mutex);
+			return;
+		}
+		g_queue_pop_head (save_data->zip_jobs);
+		g_mutex_unlock (&save_data->zip_mutex);
+
+		if (load_data->error == NULL)
+			_save_data_copy_zip_job (save_data, job, &load_data->error);
+		save_data->zip_spilled_size -= job->spill_size;
+		zip_job_free (job);
+	}
+}
+
+
+static void
+_save_data_start_zip_jobs (SaveData *save_data)
+{
+	g_autofree char *threads = NULL;
+
+	save_data->zip_writer = zip_writer_new (save_data->additions_ostream, 0);
+	save_data->zip_jobs = g_queue_new ();
+	threads = fr_get_thread_count ();
+	save_data->zip_pool = g_thread_pool_new ((GFunc) zip_job_run,
+						 save_data,
+						 MAX (g_ascii_strtoull (threads, NULL, 10), 1),
+						 FALSE,
+						 NULL);
+}
+
+
+static void
+_save_data_stop_zip_jobs (SaveData *save_data)
+{
+	if (save_data->zip_pool != NULL) {
+		g_thread_pool_free (save_data->zip_pool, FALSE, TRUE);
+		save_data->zip_pool = NULL;
+	}
+	if (save_data->zip_jobs != NULL) {
+		g_queue_free_full (save_data->zip_jobs, (GDestroyNotify) zip_job_free);
+		save_data->zip_jobs = NULL;
+	}
+	g_clear_pointer (&save_data->zip_writer, zip_writer_free);
+}
+
+
+static WriteAction
+_save_data_add_zip_job (SaveData             *save_data,
+			GFile                *file,
+			struct archive_entry *entry,
+			GFileInfo            *info)
+{
+	LoadData *load_data = LOAD_DATA (save_data);
+	goffset   size = g_file_info_get_size (info);
+	ZipJob   *job;
+
+	/* limit the size of the temporary files: wait for the queued jobs if
+	 * the new one would exceed it. */
+	if ((size > ZIP_JOB_MAX_MEMORY_SIZE) && (save_data->zip_spilled_size + size > ZIP_MAX_SPILLED_SIZE))
+		_save_data_write_zip_jobs (save_data, 0);
+	else
+		_save_data_write_zip_jobs (save_data, g_thread_pool_get_max_threads (save_data->zip_pool) * ZIP_MAX_QUEUED_JOBS_PER_THREAD - 1);
+	if (load_data->error != NULL)
+		return WRITE_ACTION_ABORT;
+
+	job = zip_job_new (save_data, file, entry, info);
+	save_data->zip_spilled_size += job->spill_size;
+	g_mutex_lock (&save_data->zip_mutex);
+	g_queue_push_tail (save_data->zip_jobs, job);
+	g_mutex_unlock (&save_data->zip_mutex);
+	g_thread_pool_push (save_data->zip_pool, job, NULL);
+
+	return WRITE_ACTION_SKIP_ENTRY;
+}
+
+
+/* Reports the new entry to the archive, the folders are listed with the
+ * ending separator added by the tar and zip writers. */
+static void
+_save_data_report_added_entry (SaveData             *save_data,
+			       struct archive_entry *w_entry)
+{
+	LoadData   *load_data = LOAD_DATA (save_data);
+	const char *pathname = archive_entry_pathname (w_entry);
+
+	if ((archive_entry_filetype (w_entry) == AE_IFDIR) && ! g_str_has_suffix (pathname, "/")) {
+		g_autoptr (_archive_entry_ctx) dir_entry = archive_entry_clone (w_entry);
+		g_autofree char *dir_pathname = g_strconcat (pathname, "/", NULL);
+
+		archive_entry_set_pathname (dir_entry, dir_pathname);
+		fr_archive_change_add_file (load_data->archive, _fr_file_data_new_from_entry (dir_entry));
+	}
+	else
+		fr_archive_change_add_file (load_data->archive, _fr_file_data_new_from_entry (w_entry));
 }
 
 
@@ -1560,16 +4167,14 @@ _archive_write_file (struct archive       *b,
 
 	/* write the file header */
 
-	info = g_file_query_info (add_file->file,
-				  FILE_ATTRIBUTES_NEEDED_BY_ARCHIVE_ENTRY,
-				  (! follow_link ? G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS : 0),
-				  cancellable,
-				  &load_data->error);
+	info = _add_file_query_info (add_file, follow_link, cancellable, &load_data->error);
 	if (info == NULL)
 		return WRITE_ACTION_ABORT;
 
 	w_entry = archive_entry_new ();
 	if (! _archive_entry_copy_file_info (w_entry, info, save_data)) {
+		if (r_entry != NULL)
+			fr_archive_change_remove_file (load_data->archive, add_file->pathname);
 		return WRITE_ACTION_SKIP_ENTRY;
 	}
 
@@ -1580,6 +4185,10 @@ _archive_write_file (struct archive       *b,
 	}
 
 	archive_entry_set_pathname (w_entry, add_file->pathname);
+	_save_data_report_added_entry (save_data, w_entry);
+	if (save_data->zip_pool != NULL)
+		return _save_data_add_zip_job (save_data, add_file->file, g_steal_pointer (&w_entry), info);
+
 	rb = archive_write_header (b, w_entry);
 
 	/* write the file data */
@@ -1607,6 +4216,479 @@ _archive_write_file (struct archive       *b,
 }
 
 
+/* -- modify in place -- */
+
+
+static ssize_t
+append_data_write (struct archive *a,
+		   void           *client_data,
+		   const void     *buff,
+		   size_t          n)
+{
+	SaveData *save_data = client_data;
+	LoadData *load_data = LOAD_DATA (save_data);
+
+	if (load_data->error != NULL)
+		return -1;
+
+	return g_output_stream_write (g_io_stream_get_output_stream (G_IO_STREAM (save_data->iostream)), buff, n, load_data->cancellable, &load_data->error);
+}
+
+
+/* Saves the journal with the regions already added to @journal and the tail
+ * of the archive starting at @offset, then moves to @offset. */
+static gboolean
+_append_in_place_begin (SaveData      *save_data,
+			GFileIOStream *iostream,
+			GByteArray    *journal,
+			guint64        offset,
+			GCancellable  *cancellable)
+{
+	LoadData *load_data = LOAD_DATA (save_data);
+	GFile    *file = fr_archive_get_file (load_data->archive);
+	goffset   archive_size;
+
+	if (! g_seekable_seek (G_SEEKABLE (iostream), 0, G_SEEK_END, cancellable, NULL))
+		return FALSE;
+
+	archive_size = g_seekable_tell (G_SEEKABLE (iostream));
+	if (offset > (guint64) archive_size)
+		return FALSE;
+
+	if (! _archive_journal_add_region (journal, iostream, offset, archive_size - offset, cancellable, NULL)
+	    || ! _archive_journal_save (journal, file, cancellable, NULL))
+	{
+		_archive_journal_remove (file);
+		return FALSE;
+	}
+
+	if (! g_seekable_seek (G_SEEKABLE (iostream), offset, G_SEEK_SET, cancellable, NULL)) {
+		_archive_journal_remove (file);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+/* Truncates the archive after the appended data, or restores the saved
+ * regions if an error occurred. */
+static void
+_append_in_place_end (SaveData      *save_data,
+		      GFileIOStream *iostream,
+		      GCancellable  *cancellable)
+{
+	LoadData *load_data = LOAD_DATA (save_data);
+	GFile    *file = fr_archive_get_file (load_data->archive);
+
+	if (load_data->error == NULL)
+		g_cancellable_set_error_if_cancelled (cancellable, &load_data->error);
+
+	if (load_data->error == NULL)
+		g_seekable_truncate (G_SEEKABLE (iostream),
+				     g_seekable_tell (G_SEEKABLE (iostream)),
+				     cancellable,
+				     &load_data->error);
+
+	/* the modified regions must be on the disk before the journal is
+	 * removed. */
+	if (load_data->error == NULL)
+		_archive_sync (file, &load_data->error);
+
+	if (load_data->error == NULL) {
+		if (g_io_stream_close (G_IO_STREAM (iostream), cancellable, &load_data->error))
+			_archive_journal_remove (file);
+	}
+
+	if (load_data->error != NULL) {
+		/* if the restore fails the journal is kept and applied the
+		 * next time the archive is loaded. */
+		if (_archive_journal_restore (file, iostream, NULL, NULL))
+			_archive_journal_remove (file);
+		g_io_stream_close (G_IO_STREAM (iostream), NULL, NULL);
+	}
+
+	_archive_journal_set_active (file, FALSE);
+}
+
+
+/* Appends the new entries after the last entry of an uncompressed tar
+ * archive, overwriting only the end-of-archive blocks.  Requires that no
+ * existing entry is modified, see _add_data_can_append.
+ * Returns FALSE if the archive cannot be saved this way, without modifying
+ * anything. */
+static gboolean
+save_tar_archive_append (GSimpleAsyncResult *result,
+			 SaveData           *save_data,
+			 GCancellable       *cancellable)
+{
+	LoadData             *load_data = LOAD_DATA (save_data);
+	g_autoptr (GFileIOStream) iostream = NULL;
+	g_autoptr (GByteArray) journal = NULL;
+	g_autoptr (_archive_write_ctx) b = NULL;
+	guint64               offset;
+	int                   rb;
+
+	iostream = g_file_open_readwrite (fr_archive_get_file (load_data->archive), cancellable, NULL);
+	if (iostream == NULL)
+		return FALSE;
+
+	if (! tar_find_end_of_entries (g_io_stream_get_input_stream (G_IO_STREAM (iostream)), &offset, cancellable, NULL)
+	    || ((journal = _archive_journal_new (iostream, cancellable, NULL)) == NULL)
+	    || ! _append_in_place_begin (save_data, iostream, journal, offset, cancellable))
+	{
+		g_io_stream_close (G_IO_STREAM (iostream), NULL, NULL);
+		return FALSE;
+	}
+
+	save_data->iostream = iostream;
+	save_data->b = b = archive_write_new ();
+	_archive_write_set_format_from_context (b, save_data);
+	_archive_write_open (b, save_data, NULL, append_data_write, NULL);
+	archive_write_set_bytes_in_last_block (b, 1);
+
+	/* all the files are new, so they are written by end_operation */
+
+	if (save_data->begin_operation != NULL)
+		save_data->begin_operation (save_data, save_data->user_data);
+	if (save_data->end_operation != NULL)
+		save_data->end_operation (save_data, save_data->user_data);
+
+	rb = archive_write_close (b);
+	if ((load_data->error == NULL) && (rb <= ARCHIVE_FAILED))
+		load_data->error = _g_error_new_from_archive_error (archive_error_string (b));
+
+	_append_in_place_end (save_data, iostream, cancellable);
+	save_data->iostream = NULL;
+
+	if (load_data->error != NULL)
+		g_simple_async_result_set_from_error (result, load_data->error);
+
+	return TRUE;
+}
+
+
+/* -- save_zip_archive_raw -- */
+
+
+typedef struct {
+	ZipEntry *entry;
+	char     *name;
+} RawCopy;
+
+
+static RawCopy *
+raw_copy_new (ZipEntry   *entry,
+	      const char *name)
+{
+	RawCopy *raw_copy;
+
+	raw_copy = g_new (RawCopy, 1);
+	raw_copy->entry = entry;
+	raw_copy->name = (g_strcmp0 (name, entry->name) != 0) ? g_strdup (name) : NULL;
+
+	return raw_copy;
+}
+
+
+static void
+raw_copy_free (RawCopy *raw_copy)
+{
+	g_free (raw_copy->name);
+	g_free (raw_copy);
+}
+
+
+static gboolean
+_save_data_can_copy_raw_entries (SaveData *save_data)
+{
+	const char *mime_type;
+
+	/* zip entries are compressed independently, the ones that are not
+	 * modified can be copied without recompressing them. */
+
+	mime_type = fr_archive_get_mime_type (LOAD_DATA (save_data)->archive);
+	return (save_data->volume_size == 0)
+		&& (_g_str_equal (mime_type, "application/zip")
+		    || _g_str_equal (mime_type, "application/x-cbz"));
+}
+
+
+static struct archive_entry *
+_archive_entry_new_from_zip_entry (ZipEntry *zip_entry)
+{
+	struct archive_entry *entry;
+
+	entry = archive_entry_new ();
+	archive_entry_set_pathname (entry, zip_entry->name);
+	archive_entry_set_mode (entry, zip_entry_get_mode (zip_entry));
+	archive_entry_set_size (entry, zip_entry->uncompressed_size);
+	archive_entry_set_mtime (entry, zip_entry_get_mtime (zip_entry), 0);
+
+	return entry;
+}
+
+
+static gboolean
+_zip_writer_copy_all_entries (ZipWriter     *writer,
+			      GFile         *file,
+			      GCancellable  *cancellable,
+			      GError       **error)
+{
+	g_autoptr (GInputStream) istream = NULL;
+	g_autoptr (ZipDirectory) zip_dir = NULL;
+	guint i;
+
+	istream = (GInputStream *) g_file_read (file, cancellable, error);
+	if (istream == NULL)
+		return FALSE;
+
+	zip_dir = zip_directory_read (istream, cancellable, error);
+	if (zip_dir == NULL)
+		return FALSE;
+
+	for (i = 0; i < zip_dir->entries->len; i++) {
+		if (! zip_writer_copy_entry (writer, istream, g_ptr_array_index (zip_dir->entries, i), NULL, cancellable, error))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+/* Renames the entries patching their local headers in place, then writes
+ * the new entries where the central directory starts, followed by the
+ * updated central directory.  Requires that no entry was removed.
+ * The original local headers are saved in the journal with the central
+ * directory, all the patched regions are synced by _append_in_place_end
+ * before the journal is removed.
+ * Returns FALSE if the archive cannot be modified in place, for example
+ * when a new name doesn't fit in the space of the original local header. */
+static gboolean
+_zip_archive_update_in_place (SaveData      *save_data,
+			      GInputStream  *istream,
+			      ZipDirectory  *zip_dir,
+			      GPtrArray     *raw_copies,
+			      GCancellable  *cancellable)
+{
+	LoadData  *load_data = LOAD_DATA (save_data);
+	g_autoptr (GFileIOStream) iostream = NULL;
+	g_autoptr (GByteArray) journal = NULL;
+	g_autoptr (GPtrArray) headers = NULL;
+	g_autoptr (ZipWriter) writer = NULL;
+	guint      i;
+
+	headers = g_ptr_array_new_full (raw_copies->len, (GDestroyNotify) _g_bytes_unref);
+	for (i = 0; i < raw_copies->len; i++) {
+		RawCopy *raw_copy = g_ptr_array_index (raw_copies, i);
+		GBytes  *header = NULL;
+
+		if ((raw_copy->name != NULL)
+		    && (! zip_entry_get_renamed_local_header (raw_copy->entry, istream, raw_copy->name, &header, cancellable, NULL)
+			|| (header == NULL)))
+		{
+			return FALSE;
+		}
+		g_ptr_array_add (headers, header);
+	}
+
+	iostream = g_file_open_readwrite (fr_archive_get_file (load_data->archive), cancellable, NULL);
+	if (iostream == NULL)
+		return FALSE;
+
+	journal = _archive_journal_new (iostream, cancellable, NULL);
+	for (i = 0; (journal != NULL) && (i < raw_copies->len); i++) {
+		RawCopy *raw_copy = g_ptr_array_index (raw_copies, i);
+		GBytes  *header = g_ptr_array_index (headers, i);
+
+		if ((header != NULL)
+		    && ! _archive_journal_add_region (journal, iostream, raw_copy->entry->local_header_offset, g_bytes_get_size (header), cancellable, NULL))
+		{
+			g_clear_pointer (&journal, g_byte_array_unref);
+		}
+	}
+
+	if ((journal == NULL) || ! _append_in_place_begin (save_data, iostream, journal, zip_dir->cd_offset, cancellable)) {
+		g_io_stream_close (G_IO_STREAM (iostream), NULL, NULL);
+		return FALSE;
+	}
+
+	/* local headers */
+
+	for (i = 0; (load_data->error == NULL) && (i < raw_copies->len); i++) {
+		RawCopy *raw_copy = g_ptr_array_index (raw_copies, i);
+		GBytes  *header = g_ptr_array_index (headers, i);
+
+		if (header == NULL)
+			continue;
+
+		if (g_seekable_seek (G_SEEKABLE (iostream), raw_copy->entry->local_header_offset, G_SEEK_SET, cancellable, &load_data->error))
+			g_output_stream_write_all (g_io_stream_get_output_stream (G_IO_STREAM (iostream)),
+						   g_bytes_get_data (header, NULL),
+						   g_bytes_get_size (header),
+						   NULL,
+						   cancellable,
+						   &load_data->error);
+		fr_archive_progress_inc_completed_bytes (load_data->archive, raw_copy->entry->uncompressed_size);
+	}
+
+	/* new entries and central directory */
+
+	if (load_data->error == NULL)
+		g_seekable_seek (G_SEEKABLE (iostream), zip_dir->cd_offset, G_SEEK_SET, cancellable, &load_data->error);
+
+	if (load_data->error == NULL) {
+		writer = zip_writer_new (g_io_stream_get_output_stream (G_IO_STREAM (iostream)), zip_dir->cd_offset);
+		for (i = 0; i < raw_copies->len; i++) {
+			RawCopy  *raw_copy = g_ptr_array_index (raw_copies, i);
+			ZipEntry *entry = zip_entry_copy (raw_copy->entry);
+
+			if (raw_copy->name != NULL)
+				zip_entry_set_name (entry, raw_copy->name);
+			zip_writer_keep_entry (writer, entry);
+			zip_entry_free (entry);
+		}
+
+		if (_zip_writer_copy_all_entries (writer, save_data->additions_file, cancellable, &load_data->error))
+			zip_writer_finish (writer, zip_dir->comment, cancellable, &load_data->error);
+	}
+
+	_append_in_place_end (save_data, iostream, cancellable);
+
+	return TRUE;
+}
+
+
+static void
+_zip_archive_rewrite (SaveData      *save_data,
+		      GInputStream  *istream,
+		      ZipDirectory  *zip_dir,
+		      GPtrArray     *raw_copies,
+		      GCancellable  *cancellable)
+{
+	LoadData  *load_data = LOAD_DATA (save_data);
+	g_autoptr (ZipWriter) writer = NULL;
+	guint      i;
+
+	save_data_open (NULL, save_data);
+	if (save_data->ostream == NULL)
+		return;
+
+	writer = zip_writer_new (save_data->ostream, 0);
+
+	for (i = 0; (load_data->error == NULL) && (i < raw_copies->len); i++) {
+		RawCopy *raw_copy = g_ptr_array_index (raw_copies, i);
+
+		if (zip_writer_copy_entry (writer, istream, raw_copy->entry, raw_copy->name, cancellable, &load_data->error))
+			fr_archive_progress_inc_completed_bytes (load_data->archive, raw_copy->entry->uncompressed_size);
+	}
+
+	if (load_data->error == NULL)
+		_zip_writer_copy_all_entries (writer, save_data->additions_file, cancellable, &load_data->error);
+
+	if (load_data->error == NULL)
+		zip_writer_finish (writer, zip_dir->comment, cancellable, &load_data->error);
+
+	save_data_close (NULL, save_data);
+}
+
+
+/* Saves a zip archive copying the compressed data of the unchanged entries,
+ * only the new or modified entries are compressed, see _save_data_add_zip_job.
+ * Also used to create a new zip archive.
+ * Returns FALSE if the archive cannot be saved this way, without modifying
+ * anything. */
+static gboolean
+save_zip_archive_raw (GSimpleAsyncResult *result,
+		      SaveData           *save_data,
+		      GCancellable       *cancellable)
+{
+	LoadData             *load_data = LOAD_DATA (save_data);
+	g_autoptr (GInputStream) istream = NULL;
+	g_autoptr (ZipDirectory) zip_dir = NULL;
+	g_autoptr (GPtrArray) raw_copies = NULL;
+	g_autoptr (GError) error = NULL;
+	gboolean              removed;
+	guint                 i;
+
+	istream = (GInputStream *) g_file_read (fr_archive_get_file (load_data->archive), cancellable, &error);
+	if (istream != NULL) {
+		if (! g_seekable_can_seek (G_SEEKABLE (istream)))
+			return FALSE;
+
+		zip_dir = zip_directory_read (istream, cancellable, NULL);
+		if ((zip_dir == NULL) || ! zip_directory_names_are_utf8 (zip_dir))
+			return FALSE;
+	}
+	else if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+		zip_dir = zip_directory_new ();
+	else
+		return FALSE;
+
+	/* new and updated entries, compressed in parallel */
+
+	if (additions_data_open (NULL, save_data) != ARCHIVE_OK) {
+		g_simple_async_result_set_from_error (result, load_data->error);
+		return TRUE;
+	}
+	_save_data_start_zip_jobs (save_data);
+
+	if (save_data->begin_operation != NULL)
+		save_data->begin_operation (save_data, save_data->user_data);
+
+	raw_copies = g_ptr_array_new_with_free_func ((GDestroyNotify) raw_copy_free);
+	removed = FALSE;
+	for (i = 0; (load_data->error == NULL) && (i < zip_dir->entries->len); i++) {
+		ZipEntry *zip_entry = g_ptr_array_index (zip_dir->entries, i);
+		g_autoptr (_archive_entry_ctx) w_entry = NULL;
+		WriteAction action;
+
+		if (g_cancellable_is_cancelled (cancellable))
+			break;
+
+		action = WRITE_ACTION_WRITE_ENTRY;
+		w_entry = _archive_entry_new_from_zip_entry (zip_entry);
+		if (save_data->entry_action != NULL)
+			action = save_data->entry_action (save_data, w_entry, save_data->user_data);
+
+		if (action == WRITE_ACTION_WRITE_ENTRY)
+			g_ptr_array_add (raw_copies, raw_copy_new (zip_entry, archive_entry_pathname (w_entry)));
+		else {
+			removed = TRUE;
+			if (action == WRITE_ACTION_SKIP_ENTRY)
+				fr_archive_progress_inc_completed_bytes (load_data->archive, zip_entry->uncompressed_size);
+		}
+	}
+
+	if (save_data->end_operation != NULL)
+		save_data->end_operation (save_data, save_data->user_data);
+
+	_save_data_write_zip_jobs (save_data, 0);
+	if (load_data->error == NULL)
+		zip_writer_finish (save_data->zip_writer, NULL, cancellable, &load_data->error);
+	_save_data_stop_zip_jobs (save_data);
+	additions_data_close (NULL, save_data);
+
+	/* if no entry was removed the archive is modified in place, otherwise
+	 * copy the unchanged entries and then the new ones */
+
+	if ((load_data->error == NULL) && ! g_cancellable_is_cancelled (cancellable)) {
+		if (removed || (istream == NULL) || ! _zip_archive_update_in_place (save_data, istream, zip_dir, raw_copies, cancellable))
+			_zip_archive_rewrite (save_data, istream, zip_dir, raw_copies, cancellable);
+	}
+
+	if (save_data->additions_file != NULL)
+		g_file_delete (save_data->additions_file, NULL, NULL);
+
+	if (load_data->error == NULL)
+		g_cancellable_set_error_if_cancelled (cancellable, &load_data->error);
+	if (load_data->error != NULL)
+		g_simple_async_result_set_from_error (result, load_data->error);
+
+	return TRUE;
+}
+
+
 static void
 save_archive_thread (GSimpleAsyncResult *result,
 		     GObject            *object,
@@ -1622,9 +4704,25 @@ save_archive_thread (GSimpleAsyncResult *result,
 	save_data = g_simple_async_result_get_op_res_gpointer (result);
 	load_data = LOAD_DATA (save_data);
 
+	_archive_journal_restore (fr_archive_get_file (load_data->archive), NULL, cancellable, NULL);
+
+	if (save_data->append
+	    && (save_data->volume_size == 0)
+	    && _g_str_equal (fr_archive_get_mime_type (load_data->archive), "application/x-tar")
+	    && save_tar_archive_append (result, save_data, cancellable))
+	{
+		return;
+	}
+
+	if (_save_data_can_copy_raw_entries (save_data)
+	    && save_zip_archive_raw (result, save_data, cancellable))
+	{
+		return;
+	}
+
 	save_data->b = b = archive_write_new ();
 	_archive_write_set_format_from_context (b, save_data);
-	archive_write_open (b, save_data, save_data_open, save_data_write, save_data_close);
+	_archive_write_open (b, save_data, save_data_open, save_data_write, save_data_close);
 	archive_write_set_bytes_in_last_block (b, 1);
 
 	create_read_object (load_data, &a);
@@ -1704,6 +4802,7 @@ _fr_archive_libarchive_save (FrArchive          *archive,
 			     gboolean            encrypt_header,
 			     FrCompression       compression,
 			     guint               volume_size,
+			     gboolean            append,
 			     GCancellable       *cancellable,
 			     GSimpleAsyncResult *result,
 			     SaveDataFunc        begin_operation,
@@ -1728,6 +4827,7 @@ _fr_archive_libarchive_save (FrArchive          *archive,
 	save_data->encrypt_header = encrypt_header;
 	save_data->compression = compression;
 	save_data->volume_size = volume_size;
+	save_data->append = append;
 	save_data->begin_operation = begin_operation;
 	save_data->end_operation = end_operation;
 	save_data->entry_action = entry_action;
@@ -1774,6 +4874,26 @@ add_data_free (AddData *add_data)
 }
 
 
+/* Whether the files can be appended to the archive, that is no file
+ * replaces an existing entry.  Called before starting the operation, the
+ * archive file list is not accessed from the save thread. */
+static gboolean
+_add_data_can_append (AddData   *add_data,
+		      FrArchive *archive)
+{
+	GHashTableIter iter;
+	gpointer       key;
+
+	g_hash_table_iter_init (&iter, add_data->files_to_add);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		if (g_hash_table_lookup (archive->files_hash, key) != NULL)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+
 static void
 _add_files_begin (SaveData *save_data,
 		  gpointer  user_data)
@@ -1798,8 +4918,7 @@ _add_files_begin (SaveData *save_data,
 		}
 	}
 
-	FrArchiveLibarchivePrivate *private = fr_archive_libarchive_get_instance_private (FR_ARCHIVE_LIBARCHIVE (load_data->archive));
-	fr_archive_progress_set_total_bytes (load_data->archive, private->uncompressed_size + load_data->archive->files_to_add_size);
+	fr_archive_progress_set_total_bytes (load_data->archive, _fr_archive_get_uncompressed_size (load_data->archive) + load_data->archive->files_to_add_size);
 }
 
 
@@ -1905,7 +5024,9 @@ fr_archive_libarchive_add_files (FrArchive           *archive,
 		g_autofree char *archive_pathname = g_build_filename (dest_dir, relative_pathname, NULL);
 		g_hash_table_insert (add_data->files_to_add,
 				     g_strdup (archive_pathname),
-				     add_file_new (file, archive_pathname));
+				     add_file_new (file,
+						   archive_pathname,
+						   (archive->files_to_add_info != NULL) ? g_hash_table_lookup (archive->files_to_add_info, file) : NULL));
 		add_data->n_files_to_add++;
 	}
 
@@ -1915,6 +5036,7 @@ fr_archive_libarchive_add_files (FrArchive           *archive,
 				     encrypt_header,
 				     compression,
 				     volume_size,
+				     _add_data_can_append (add_data, archive),
 				     cancellable,
 				     g_simple_async_result_new (G_OBJECT (archive),
 				     				callback,
@@ -1953,10 +5075,9 @@ _remove_files_begin (SaveData *save_data,
 {
 	LoadData   *load_data = LOAD_DATA (save_data);
 	RemoveData *remove_data = user_data;
-	FrArchiveLibarchivePrivate *private = fr_archive_libarchive_get_instance_private (FR_ARCHIVE_LIBARCHIVE (load_data->archive));
 
 	fr_archive_progress_set_total_files (load_data->archive, remove_data->n_files_to_remove);
-	fr_archive_progress_set_total_bytes (load_data->archive, private->uncompressed_size);
+	fr_archive_progress_set_total_bytes (load_data->archive, _fr_archive_get_uncompressed_size (load_data->archive));
 }
 
 
@@ -1970,12 +5091,15 @@ _remove_files_entry_action (SaveData             *save_data,
 	WriteAction  action;
 	const char  *pathname;
 
-	if (remove_data->remove_all_files)
+	pathname = archive_entry_pathname (w_entry);
+	if (remove_data->remove_all_files) {
+		fr_archive_change_remove_file (load_data->archive, pathname);
 		return WRITE_ACTION_SKIP_ENTRY;
+	}
 
 	action = WRITE_ACTION_WRITE_ENTRY;
-	pathname = archive_entry_pathname (w_entry);
 	if (g_hash_table_lookup (remove_data->files_to_remove, pathname) != NULL) {
+		fr_archive_change_remove_file (load_data->archive, pathname);
 		action = WRITE_ACTION_SKIP_ENTRY;
 		remove_data->n_files_to_remove--;
 		fr_archive_progress_inc_completed_files (load_data->archive, 1);
@@ -2016,6 +5140,7 @@ fr_archive_libarchive_remove_files (FrArchive           *archive,
 				     archive->encrypt_header,
 				     compression,
 				     0,
+				     FALSE,
 				     cancellable,
 				     g_simple_async_result_new (G_OBJECT (archive),
 				     				callback,
@@ -2054,8 +5179,7 @@ _rename_files_begin (SaveData *save_data,
 	RenameData *rename_data = user_data;
 
 	fr_archive_progress_set_total_files (load_data->archive, rename_data->n_files_to_rename);
-	FrArchiveLibarchivePrivate *private = fr_archive_libarchive_get_instance_private (FR_ARCHIVE_LIBARCHIVE (load_data->archive));
-	fr_archive_progress_set_total_bytes (load_data->archive, private->uncompressed_size);
+	fr_archive_progress_set_total_bytes (load_data->archive, _fr_archive_get_uncompressed_size (load_data->archive));
 }
 
 
@@ -2074,6 +5198,7 @@ _rename_files_entry_action (SaveData             *save_data,
 	pathname = archive_entry_pathname (w_entry);
 	new_pathname = g_hash_table_lookup (rename_data->files_to_rename, pathname);
 	if (new_pathname != NULL) {
+		fr_archive_change_rename_file (load_data->archive, pathname, new_pathname);
 		archive_entry_set_pathname (w_entry, new_pathname);
 		rename_data->n_files_to_rename--;
 		g_hash_table_remove (rename_data->files_to_rename, pathname);
@@ -2133,6 +5258,7 @@ fr_archive_libarchive_rename (FrArchive           *archive,
 				     archive->encrypt_header,
 				     archive->compression,
 				     0,
+				     FALSE,
 				     cancellable,
 				     g_simple_async_result_new (G_OBJECT (archive),
 				     				callback,
@@ -2180,7 +5306,7 @@ fr_archive_libarchive_paste_clipboard (FrArchive           *archive,
 
 		new_name = g_build_filename (current_dir, old_name + strlen (base_dir) - 1, NULL);
 		file = _g_file_append_path (tmp_dir, old_name, NULL);
-		g_hash_table_insert (add_data->files_to_add, new_name, add_file_new (file, new_name));
+		g_hash_table_insert (add_data->files_to_add, new_name, add_file_new (file, new_name, NULL));
 		add_data->n_files_to_add++;
 	}
 
@@ -2190,6 +5316,7 @@ fr_archive_libarchive_paste_clipboard (FrArchive           *archive,
 				     encrypt_header,
 				     compression,
 				     volume_size,
+				     _add_data_can_append (add_data, archive),
 				     cancellable,
 				     g_simple_async_result_new (G_OBJECT (archive),
 				     				callback,
@@ -2233,7 +5360,7 @@ fr_archive_libarchive_add_dropped_files (FrArchive           *archive,
 
 		g_hash_table_insert (add_data->files_to_add,
 				     g_strdup (archive_pathname),
-				     add_file_new (file, archive_pathname));
+				     add_file_new (file, archive_pathname, NULL));
 	}
 
 	_fr_archive_libarchive_save (archive,
@@ -2242,6 +5369,7 @@ fr_archive_libarchive_add_dropped_files (FrArchive           *archive,
 				     encrypt_header,
 				     compression,
 				     volume_size,
+				     _add_data_can_append (add_data, archive),
 				     cancellable,
 				     g_simple_async_result_new (G_OBJECT (archive),
 				     				callback,
@@ -2283,7 +5411,7 @@ fr_archive_libarchive_update_open_files (FrArchive           *archive,
 		GFile *temp_dir = G_FILE (scan_dir->data);
 		GFile *extracted_file = G_FILE (scan_file->data);
 		g_autofree char *archive_pathname = g_file_get_relative_path (temp_dir, extracted_file);
-		g_hash_table_insert (add_data->files_to_add, g_strdup (archive_pathname), add_file_new (extracted_file, archive_pathname));
+		g_hash_table_insert (add_data->files_to_add, g_strdup (archive_pathname), add_file_new (extracted_file, archive_pathname, NULL));
 		add_data->n_files_to_add++;
 	}
 
@@ -2293,6 +5421,7 @@ fr_archive_libarchive_update_open_files (FrArchive           *archive,
 				     encrypt_header,
 				     compression,
 				     volume_size,
+				     _add_data_can_append (add_data, archive),
 				     cancellable,
 				     g_simple_async_result_new (G_OBJECT (archive),
 				     				callback,
@@ -33,6 +33,7 @@
 #include "gio-utils.h"
 #include "fr-file-data.h"
 #include "fr-archive.h"
+#include "fr-archive-cache.h"
 #include "fr-command.h"
 #include "fr-enum-types.h"
 #include "fr-error.h"
@@ -82,6 +83,13 @@ typedef struct {
 	GMutex         progress_mutex;
 	gulong         progress_event;
 
+	/* progressive listing, protected by progress_mutex */
+
+	gboolean       listing;
+	GPtrArray     *listed_files;               /* FrFileData added since
+						    * the last "files-added"
+						    * signal. */
+
 	/* others */
 
 	gboolean       creating_archive;
@@ -90,6 +98,25 @@ typedef struct {
 						    * permissions to write the
 						    * file. */
 	DroppedItemsData *dropped_items_data;
+
+	/* the strings of the files */
+
+	FrFileDataStore *file_data_store;
+
+	/* the changes reported by the last operation, protected by
+	 * progress_mutex */
+
+	GPtrArray     *file_changes;               /* FileChange, NULL if the
+						    * operation didn't report
+						    * its changes. */
+	gboolean       files_updated;
+
+	/* listing cache */
+
+	GBytes        *cache_key;
+	gboolean       files_from_cache;
+	gint64         list_start_time;
+	GThread       *cache_save_thread;          /* reads archive->files */
 } FrArchivePrivate;
 
 
@@ -102,6 +129,7 @@ enum {
 	MESSAGE,
 	STOPPABLE,
 	WORKING_ARCHIVE,
+	FILES_ADDED,
 	LAST_SIGNAL
 };
 
@@ -230,6 +258,19 @@ fr_archive_get_property (GObject    *object,
 static void dropped_items_data_free (DroppedItemsData *data);
 
 
+/* The file list must not be changed while the cache is saved. */
+static void
+_fr_archive_wait_cache_save (FrArchive *archive)
+{
+	FrArchivePrivate *private = fr_archive_get_instance_private (archive);
+
+	if (private->cache_save_thread != NULL) {
+		g_thread_join (private->cache_save_thread);
+		private->cache_save_thread = NULL;
+	}
+}
+
+
 static void
 fr_archive_finalize (GObject *object)
 {
@@ -241,18 +282,27 @@ fr_archive_finalize (GObject *object)
 	archive = FR_ARCHIVE (object);
 	FrArchivePrivate *private = fr_archive_get_instance_private (archive);
 
+	_fr_archive_wait_cache_save (archive);
+
 	_fr_archive_set_uri (archive, NULL);
 	if (private->progress_event != 0) {
 		g_source_remove (private->progress_event);
 		private->progress_event = 0;
 	}
 	g_mutex_clear (&private->progress_mutex);
+	g_ptr_array_unref (private->listed_files);
+	if (private->file_changes != NULL)
+		g_ptr_array_unref (private->file_changes);
 	g_hash_table_unref (archive->files_hash);
 	g_ptr_array_unref (archive->files);
+	fr_file_data_store_free (private->file_data_store);
+	if (archive->files_to_add_info != NULL)
+		g_hash_table_unref (archive->files_to_add_info);
 	if (private->dropped_items_data != NULL) {
 		dropped_items_data_free (private->dropped_items_data);
 		private->dropped_items_data = NULL;
 	}
+	_g_bytes_unref (private->cache_key);
 
 	/* Chain up */
 
@@ -313,6 +363,7 @@ fr_archive_class_init (FrArchiveClass *klass)
 	klass->message = NULL;
 	klass->stoppable = NULL;
 	klass->working_archive = NULL;
+	klass->files_added = NULL;
 
 	klass->get_mime_types = fr_archive_base_get_mime_types;
 	klass->get_capabilities = fr_archive_base_get_capabilities;
@@ -425,6 +476,15 @@ fr_archive_class_init (FrArchiveClass *klass)
 			      fr_marshal_VOID__STRING,
 			      G_TYPE_NONE, 1,
 			      G_TYPE_STRING);
+	fr_archive_signals[FILES_ADDED] =
+		g_signal_new ("files-added",
+			      G_TYPE_FROM_CLASS (klass),
+			      G_SIGNAL_RUN_LAST,
+			      G_STRUCT_OFFSET (FrArchiveClass, files_added),
+			      NULL, NULL,
+			      fr_marshal_VOID__POINTER,
+			      G_TYPE_NONE, 1,
+			      G_TYPE_POINTER);
 }
 
 
@@ -470,6 +530,9 @@ fr_archive_init (FrArchive *self)
 	private->total_bytes = 0;
 	private->dropped_items_data = NULL;
 	g_mutex_init (&private->progress_mutex);
+	private->listing = FALSE;
+	private->listed_files = g_ptr_array_new ();
+	private->file_data_store = fr_file_data_store_new ();
 }
 
 
@@ -831,11 +894,35 @@ fr_archive_open_finish (GFile         *file,
 }
 
 
+/* Emits the files added by the listing thread since the last call, the
+ * files are owned by archive->files. */
+static void
+_fr_archive_emit_listed_files (FrArchive *archive)
+{
+	FrArchivePrivate    *private = fr_archive_get_instance_private (archive);
+	g_autoptr (GPtrArray) files = NULL;
+
+	g_mutex_lock (&private->progress_mutex);
+	if (private->listed_files->len > 0) {
+		files = private->listed_files;
+		private->listed_files = g_ptr_array_new ();
+	}
+	g_mutex_unlock (&private->progress_mutex);
+
+	if (files != NULL)
+		g_signal_emit (archive,
+			       fr_archive_signals[FILES_ADDED],
+			       0,
+			       files);
+}
+
+
 static gboolean
 _fr_archive_update_progress_cb (gpointer user_data)
 {
 	FrArchive *archive = user_data;
 	fr_archive_progress (archive, fr_archive_progress_get_fraction (archive));
+	_fr_archive_emit_listed_files (archive);
 	return TRUE;
 }
 
@@ -849,6 +936,79 @@ _fr_archive_activate_progress_update (FrArchive *archive)
 }
 
 
+/* -- fr_archive_list -- */
+
+
+/* Listings that take less time are not saved in the cache. */
+#define CACHE_MIN_LIST_TIME (G_USEC_PER_SEC / 2)
+
+
+typedef struct {
+	FrArchive           *archive;
+	GCancellable        *cancellable;
+	GAsyncReadyCallback  callback;
+	gpointer             user_data;
+} ListData;
+
+
+static void
+list_data_free (ListData *list_data)
+{
+	_g_object_unref (list_data->archive);
+	_g_object_unref (list_data->cancellable);
+	g_free (list_data);
+}
+
+
+static void
+load_cached_list_thread (GSimpleAsyncResult *result,
+			 GObject            *object,
+			 GCancellable       *cancellable)
+{
+	FrArchive        *archive = FR_ARCHIVE (object);
+	FrArchivePrivate *private = fr_archive_get_instance_private (archive);
+	gboolean          loaded = FALSE;
+
+	private->cache_key = fr_archive_cache_get_key (archive, cancellable);
+	if (private->cache_key != NULL)
+		loaded = fr_archive_cache_load (archive, private->cache_key, cancellable);
+	g_simple_async_result_set_op_res_gboolean (result, loaded);
+}
+
+
+static void
+load_cached_list_ready_cb (GObject      *source_object,
+			   GAsyncResult *result,
+			   gpointer      user_data)
+{
+	ListData         *list_data = user_data;
+	FrArchive        *archive = list_data->archive;
+	FrArchivePrivate *private = fr_archive_get_instance_private (archive);
+
+	if (g_simple_async_result_get_op_res_gboolean (G_SIMPLE_ASYNC_RESULT (result))) {
+		GSimpleAsyncResult *list_result;
+
+		private->files_from_cache = TRUE;
+		list_result = g_simple_async_result_new (G_OBJECT (archive),
+							 list_data->callback,
+							 list_data->user_data,
+							 fr_archive_list);
+		g_simple_async_result_complete_in_idle (list_result);
+		g_object_unref (list_result);
+	}
+	else {
+		private->list_start_time = g_get_monotonic_time ();
+		FR_ARCHIVE_GET_CLASS (archive)->list (archive,
+						      NULL,
+						      list_data->cancellable,
+						      list_data->callback,
+						      list_data->user_data);
+	}
+
+	list_data_free (list_data);
+}
+
+
 void
 fr_archive_list (FrArchive           *archive,
 		 const char          *password,
@@ -856,18 +1016,276 @@ fr_archive_list (FrArchive           *archive,
 		 GAsyncReadyCallback  callback,
 		 gpointer             user_data)
 {
+	FrArchivePrivate   *private;
+	ListData           *list_data;
+	GSimpleAsyncResult *result;
+
 	g_return_if_fail (archive != NULL);
 
 	_fr_archive_activate_progress_update (archive);
 
+	private = fr_archive_get_instance_private (archive);
+
+	_fr_archive_wait_cache_save (archive);
 	if (archive->files != NULL) {
 		g_hash_table_remove_all (archive->files_hash);
 		g_ptr_array_unref (archive->files);
 		archive->files = g_ptr_array_new_full (FILE_ARRAY_INITIAL_SIZE, (GDestroyNotify) fr_file_data_free);
 		archive->n_regular_files = 0;
+
+		fr_file_data_store_free (private->file_data_store);
+		private->file_data_store = fr_file_data_store_new ();
 	}
 
-	FR_ARCHIVE_GET_CLASS (archive)->list (archive, password, cancellable, callback, user_data);
+	private->files_from_cache = FALSE;
+	g_clear_pointer (&private->cache_key, g_bytes_unref);
+
+	g_mutex_lock (&private->progress_mutex);
+	g_clear_pointer (&private->file_changes, g_ptr_array_unref);
+	private->listing = TRUE;
+	g_ptr_array_set_size (private->listed_files, 0);
+	g_mutex_unlock (&private->progress_mutex);
+
+	/* the content of encrypted archives is not cached */
+
+	if (password != NULL) {
+		private->list_start_time = g_get_monotonic_time ();
+		FR_ARCHIVE_GET_CLASS (archive)->list (archive, password, cancellable, callback, user_data);
+		return;
+	}
+
+	list_data = g_new0 (ListData, 1);
+	list_data->archive = g_object_ref (archive);
+	list_data->cancellable = _g_object_ref (cancellable);
+	list_data->callback = callback;
+	list_data->user_data = user_data;
+
+	result = g_simple_async_result_new (G_OBJECT (archive),
+					    load_cached_list_ready_cb,
+					    list_data,
+					    load_cached_list_thread);
+	g_simple_async_result_run_in_thread (result,
+					     load_cached_list_thread,
+					     G_PRIORITY_DEFAULT,
+					     cancellable);
+	g_object_unref (result);
+}
+
+
+/* -- file changes -- */
+
+
+typedef enum {
+	FILE_CHANGE_ADDED,
+	FILE_CHANGE_REMOVED,
+	FILE_CHANGE_RENAMED
+} FileChangeType;
+
+
+typedef struct {
+	FileChangeType  type;
+	char           *path;
+	char           *new_path;
+	FrFileData     *file_data;
+} FileChange;
+
+
+static void
+file_change_free (FileChange *change)
+{
+	g_free (change->path);
+	g_free (change->new_path);
+	fr_file_data_free (change->file_data);
+	g_free (change);
+}
+
+
+static void
+_fr_archive_add_file_change (FrArchive      *archive,
+			     FileChangeType  type,
+			     const char     *path,
+			     const char     *new_path,
+			     FrFileData     *file_data)
+{
+	FrArchivePrivate *private = fr_archive_get_instance_private (archive);
+	FileChange       *change;
+
+	change = g_new0 (FileChange, 1);
+	change->type = type;
+	change->path = g_strdup (path);
+	change->new_path = g_strdup (new_path);
+	change->file_data = file_data;
+
+	g_mutex_lock (&private->progress_mutex);
+	if (private->file_changes == NULL)
+		private->file_changes = g_ptr_array_new_with_free_func ((GDestroyNotify) file_change_free);
+	g_ptr_array_add (private->file_changes, change);
+	g_mutex_unlock (&private->progress_mutex);
+}
+
+
+/* Takes ownership of @file_data, replaces the file with the same path if
+ * present. */
+void
+fr_archive_change_add_file (FrArchive  *archive,
+			    FrFileData *file_data)
+{
+	_fr_archive_add_file_change (archive, FILE_CHANGE_ADDED, file_data->original_path, NULL, file_data);
+}
+
+
+void
+fr_archive_change_remove_file (FrArchive  *archive,
+			       const char *original_path)
+{
+	_fr_archive_add_file_change (archive, FILE_CHANGE_REMOVED, original_path, NULL, NULL);
+}
+
+
+void
+fr_archive_change_rename_file (FrArchive  *archive,
+			       const char *original_path,
+			       const char *new_path)
+{
+	_fr_archive_add_file_change (archive, FILE_CHANGE_RENAMED, original_path, new_path, NULL);
+}
+
+
+static FrFileData *
+_fr_file_data_new_renamed (FrFileData *src,
+			   const char *new_path)
+{
+	FrFileData *file_data;
+
+	file_data = fr_file_data_new ();
+	if (*new_path == '/') {
+		file_data->full_path = g_strdup (new_path);
+		file_data->original_path = file_data->full_path;
+	}
+	else {
+		file_data->full_path = g_strconcat ("/", new_path, NULL);
+		file_data->original_path = file_data->full_path + 1;
+	}
+	file_data->dir = src->dir;
+	if (file_data->dir)
+		file_data->name = _g_path_get_dir_name (file_data->full_path);
+	else
+		file_data->name = g_strdup (_g_path_get_basename (file_data->full_path));
+	file_data->path = _g_path_remove_level (file_data->full_path);
+	file_data->link = g_strdup (src->link);
+	file_data->size = src->size;
+	file_data->modified = src->modified;
+	file_data->encrypted = src->encrypted;
+
+	return file_data;
+}
+
+
+/* Sorts the files by path and updates the file_data hash. */
+static void
+_fr_archive_sort_files (FrArchive *archive)
+{
+	g_ptr_array_sort (archive->files, fr_file_data_compare_by_path);
+
+	g_hash_table_remove_all (archive->files_hash);
+	for (guint i = 0; i < archive->files->len; i++) {
+		FrFileData *file_data = g_ptr_array_index (archive->files, i);
+		g_hash_table_insert (archive->files_hash, file_data->original_path, file_data);
+	}
+}
+
+
+/* Updates the file list with the changes reported by the operation instead
+ * of listing the archive again. */
+static void
+_fr_archive_apply_file_changes (FrArchive *archive,
+				GPtrArray *changes)
+{
+	g_autoptr (GHashTable) removed = NULL;
+	g_autoptr (GPtrArray) added = NULL;
+	GPtrArray *files;
+
+	_fr_archive_wait_cache_save (archive);
+
+	removed = g_hash_table_new (g_direct_hash, g_direct_equal);
+	added = g_ptr_array_new ();
+
+	for (guint i = 0; i < changes->len; i++) {
+		FileChange *change = g_ptr_array_index (changes, i);
+		FrFileData *old_file_data;
+		FrFileData *new_file_data;
+
+		old_file_data = g_hash_table_lookup (archive->files_hash, change->path);
+		if (old_file_data != NULL) {
+			g_hash_table_remove (archive->files_hash, change->path);
+			g_hash_table_add (removed, old_file_data);
+		}
+
+		switch (change->type) {
+		case FILE_CHANGE_ADDED:
+			new_file_data = g_steal_pointer (&change->file_data);
+			break;
+		case FILE_CHANGE_RENAMED:
+			new_file_data = (old_file_data != NULL) ? _fr_file_data_new_renamed (old_file_data, change->new_path) : NULL;
+			break;
+		default:
+			new_file_data = NULL;
+			break;
+		}
+
+		if (new_file_data != NULL) {
+			/* a file added before by the same operation */
+			old_file_data = g_hash_table_lookup (archive->files_hash, new_file_data->original_path);
+			if (old_file_data != NULL)
+				g_hash_table_add (removed, old_file_data);
+
+			g_ptr_array_add (added, new_file_data);
+			g_hash_table_insert (archive->files_hash, new_file_data->original_path, new_file_data);
+		}
+	}
+
+	/* the removed files are freed, the FrFileData of the other files
+	 * don't change */
+
+	files = g_ptr_array_new_full (archive->files->len + added->len, (GDestroyNotify) fr_file_data_free);
+	archive->n_regular_files = 0;
+	for (guint i = 0; i < archive->files->len; i++) {
+		FrFileData *file_data = g_ptr_array_index (archive->files, i);
+
+		if (g_hash_table_contains (removed, file_data)) {
+			fr_file_data_free (file_data);
+			continue;
+		}
+
+		g_ptr_array_add (files, file_data);
+		if (! file_data->dir)
+			archive->n_regular_files++;
+	}
+	g_ptr_array_set_free_func (archive->files, NULL);
+	g_ptr_array_unref (archive->files);
+	archive->files = files;
+
+	for (guint i = 0; i < added->len; i++) {
+		FrFileData *file_data = g_ptr_array_index (added, i);
+
+		if (g_hash_table_contains (removed, file_data))
+			fr_file_data_free (file_data);
+		else
+			fr_archive_add_file (archive, file_data);
+	}
+
+	_fr_archive_sort_files (archive);
+}
+
+
+/* Whether the last operation updated the file list with the changes made to
+ * the archive, so that the archive doesn't need to be listed again. */
+gboolean
+fr_archive_get_files_updated (FrArchive *archive)
+{
+	FrArchivePrivate *private = fr_archive_get_instance_private (archive);
+
+	return private->files_updated;
 }
 
 
@@ -876,7 +1294,8 @@ fr_archive_operation_finish (FrArchive     *archive,
 			     GAsyncResult  *result,
 			     GError       **error)
 {
-	gboolean success;
+	gboolean   success;
+	GPtrArray *file_changes;
 	FrArchivePrivate *private = fr_archive_get_instance_private (archive);
 
 	if (private->progress_event != 0) {
@@ -884,21 +1303,40 @@ fr_archive_operation_finish (FrArchive     *archive,
 		private->progress_event = 0;
 	}
 
+	/* the whole list is available now */
+
+	g_mutex_lock (&private->progress_mutex);
+	private->listing = FALSE;
+	g_ptr_array_set_size (private->listed_files, 0);
+	file_changes = g_steal_pointer (&private->file_changes);
+	g_mutex_unlock (&private->progress_mutex);
+
 	success = ! g_simple_async_result_propagate_error (G_SIMPLE_ASYNC_RESULT (result), error);
 
+	private->files_updated = FALSE;
+	if (success && (file_changes != NULL)) {
+		_fr_archive_apply_file_changes (archive, file_changes);
+		private->files_updated = TRUE;
+	}
+	if (file_changes != NULL)
+		g_ptr_array_unref (file_changes);
+
 	if (success && (g_simple_async_result_get_source_tag (G_SIMPLE_ASYNC_RESULT (result)) == fr_archive_list)) {
 		/* order the list by name to speed up search */
-		g_ptr_array_sort (archive->files, fr_file_data_compare_by_path);
-
-		/* update the file_data hash */
-		g_hash_table_remove_all (archive->files_hash);
-		for (guint i = 0; i < archive->files->len; i++) {
-			FrFileData *file_data = g_ptr_array_index (archive->files, i);
-			g_hash_table_insert (archive->files_hash, file_data->original_path, file_data);
+		_fr_archive_wait_cache_save (archive);
+		_fr_archive_sort_files (archive);
+
+		if (! private->files_from_cache
+		    && ! archive->multi_volume
+		    && (private->cache_key != NULL)
+		    && (g_get_monotonic_time () - private->list_start_time >= CACHE_MIN_LIST_TIME))
+		{
+			private->cache_save_thread = fr_archive_cache_save (archive, private->cache_key);
 		}
 	}
 
 	archive->files_to_add_size = 0;
+	g_clear_pointer (&archive->files_to_add_info, g_hash_table_unref);
 
 	if (! success && (error != NULL) && g_error_matches (*error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
 		g_error_free (*error);
@@ -912,6 +1350,24 @@ fr_archive_operation_finish (FrArchive     *archive,
 /* -- fr_archive_add_files -- */
 
 
+/* The scan reads the attributes needed to create the archive entries as
+ * well, so that the files are not queried again when added. */
+#define FILE_ATTRIBUTES_NEEDED_FOR_ADD \
+	(G_FILE_ATTRIBUTE_STANDARD_NAME "," \
+	 G_FILE_ATTRIBUTE_STANDARD_SIZE "," \
+	 G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN "," \
+	 G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP "," \
+	 G_FILE_ATTRIBUTE_STANDARD_IS_SYMLINK "," \
+	 G_FILE_ATTRIBUTE_STANDARD_SYMLINK_TARGET "," \
+	 G_FILE_ATTRIBUTE_TIME_ACCESS "," \
+	 G_FILE_ATTRIBUTE_TIME_ACCESS_USEC "," \
+	 G_FILE_ATTRIBUTE_TIME_CREATED "," \
+	 G_FILE_ATTRIBUTE_TIME_CREATED_USEC "," \
+	 G_FILE_ATTRIBUTE_TIME_MODIFIED "," \
+	 G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC "," \
+	 "unix::*")
+
+
 typedef struct {
 	FrArchive           *archive;
 	GFile               *base_dir;
@@ -968,6 +1424,8 @@ fr_archive_add_files_ready_cb (GList    *file_info_list, /* FileInfo list */
 		GList *scan;
 
 		archive->files_to_add_size = 0;
+		g_clear_pointer (&archive->files_to_add_info, g_hash_table_unref);
+		archive->files_to_add_info = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal, g_object_unref, g_object_unref);
 
 		file_list = NULL;
 		for (scan = file_info_list; scan; scan = scan->next) {
@@ -987,6 +1445,7 @@ fr_archive_add_files_ready_cb (GList    *file_info_list, /* FileInfo list */
 
 			file_list = g_list_prepend (file_list, g_object_ref (data->file));
 			archive->files_to_add_size += g_file_info_get_size (data->info);
+			g_hash_table_insert (archive->files_to_add_info, g_object_ref (data->file), g_object_ref (data->info));
 		}
 		file_list = g_list_reverse (file_list);
 
@@ -1055,10 +1514,7 @@ fr_archive_add_files (FrArchive           *archive,
 
 	_g_file_list_query_info_async (file_list,
 				       FILE_LIST_RECURSIVE | FILE_LIST_NO_BACKUP_FILES,
-				       (G_FILE_ATTRIBUTE_STANDARD_NAME ","
-					G_FILE_ATTRIBUTE_STANDARD_SIZE ","
-					G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN ","
-					G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP),
+				       FILE_ATTRIBUTES_NEEDED_FOR_ADD,
 				       cancellable,
 				       NULL,
 				       NULL,
@@ -1144,10 +1600,7 @@ fr_archive_add_files_with_filter (FrArchive           *archive,
 		flags |= FILE_LIST_NO_FOLLOW_LINKS;
 	_g_file_list_query_info_async (file_list,
 				       flags,
-				       (G_FILE_ATTRIBUTE_STANDARD_NAME ","
-					G_FILE_ATTRIBUTE_STANDARD_SIZE ","
-					G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN ","
-					G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP),
+				       FILE_ATTRIBUTES_NEEDED_FOR_ADD,
 				       cancellable,
 				       directory_filter_cb,
 				       file_filter_cb,
@@ -2157,10 +2610,17 @@ void
 fr_archive_add_file (FrArchive *self,
 		     FrFileData *file_data)
 {
-	fr_file_data_update_content_type (file_data);
+	FrArchivePrivate *private = fr_archive_get_instance_private (self);
+
+	fr_file_data_store_add (private->file_data_store, file_data);
 	g_ptr_array_add (self->files, file_data);
 	if (! file_data->dir)
 		self->n_regular_files++;
+
+	g_mutex_lock (&private->progress_mutex);
+	if (private->listing)
+		g_ptr_array_add (private->listed_files, file_data);
+	g_mutex_unlock (&private->progress_mutex);
 }
 
 
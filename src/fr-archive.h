@@ -90,6 +90,9 @@ struct _FrArchive {
 	/*<protected>*/
 
 	gssize         files_to_add_size;
+	GHashTable    *files_to_add_info;          /* GFile -> GFileInfo, the
+						    * info read while scanning
+						    * the files to add. */
 
 	/* features. */
 
@@ -242,6 +245,8 @@ struct _FrArchiveClass {
 			           	    gboolean             value);
 	void          (*working_archive)   (FrArchive           *archive,
 			           	    const char          *uri);
+	void          (*files_added)       (FrArchive           *archive,
+					    GPtrArray           *files);
 
 	/*< virtual functions >*/
 
@@ -397,6 +402,7 @@ void          fr_archive_list                    (FrArchive           *archive,
 gboolean      fr_archive_operation_finish        (FrArchive           *archive,
 						  GAsyncResult        *result,
 						  GError             **error);
+gboolean      fr_archive_get_files_updated       (FrArchive           *archive);
 
 /**
  * fr_archive_add_files:
@@ -586,6 +592,13 @@ double        fr_archive_progress_inc_completed_bytes
 double        fr_archive_progress_get_fraction   (FrArchive           *archive);
 void          fr_archive_add_file                (FrArchive           *archive,
 						  FrFileData *file_data);
+void          fr_archive_change_add_file         (FrArchive           *archive,
+						  FrFileData          *file_data);
+void          fr_archive_change_remove_file      (FrArchive           *archive,
+						  const char          *original_path);
+void          fr_archive_change_rename_file      (FrArchive           *archive,
+						  const char          *original_path,
+						  const char          *new_path);
 
 /* utilities */
 
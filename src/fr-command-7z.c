@@ -229,7 +229,7 @@ fr_command_7z_list (FrCommand *command)
 {
 	rar_check_multi_volume (command);
 
-	fr_process_set_out_line_func (command->process, list__process_line, command);
+	fr_process_set_out_thread_line_func (command->process, list__process_line, command);
 
 	fr_command_7z_begin_command (command);
 	fr_process_set_begin_func (command->process, list__begin, command);
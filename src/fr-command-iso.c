@@ -188,6 +188,7 @@ fr_command_iso_extract (FrCommand  *comm,
 
 		fr_process_begin_command (comm->process, "sh");
 		fr_process_set_working_dir (comm->process, temp_dest_dir);
+		fr_process_set_parallel (comm->process, TRUE);
 		fr_process_add_arg (comm->process, SHDIR "isoinfo.sh");
 		fr_process_add_arg (comm->process, "-i");
 		fr_process_add_arg (comm->process, comm->filename);
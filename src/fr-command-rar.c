@@ -394,7 +394,7 @@ fr_command_rar_list (FrCommand  *comm)
 {
 	rar_check_multi_volume (comm);
 
-	fr_process_set_out_line_func (comm->process, process_line, comm);
+	fr_process_set_out_thread_line_func (comm->process, process_line, comm);
 
 	if (have_rar ())
 		fr_process_begin_command (comm->process, "rar");
@@ -269,7 +269,7 @@ begin_tar_command (FrCommand *comm)
 static gboolean
 fr_command_tar_list (FrCommand *comm)
 {
-	fr_process_set_out_line_func (comm->process, process_line, comm);
+	fr_process_set_out_thread_line_func (comm->process, process_line, comm);
 
 	begin_tar_command (comm);
 	fr_process_add_arg (comm->process, "--force-local");
@@ -185,7 +185,7 @@ list__begin (gpointer data)
 static gboolean
 fr_command_zip_list (FrCommand  *comm)
 {
-	fr_process_set_out_line_func (comm->process, list__process_line, comm);
+	fr_process_set_out_thread_line_func (comm->process, list__process_line, comm);
 
 	fr_process_begin_command (comm->process, "unzip");
 	fr_process_set_begin_func (comm->process, list__begin, comm);
@@ -1702,6 +1702,31 @@ _fr_command_remove (FrCommand     *self,
 }
 
 
+/* Some commands remove the content of a folder together with the folder,
+ * the removed files are reported only when no folder is removed, otherwise
+ * the archive is listed again. */
+static void
+_fr_command_report_removed_files (FrCommand *self,
+				  GList     *file_list)
+{
+	FrArchive *archive = FR_ARCHIVE (self);
+	GList     *scan;
+
+	if (file_list == NULL)
+		return;
+
+	for (scan = file_list; scan; scan = scan->next) {
+		FrFileData *file_data = g_hash_table_lookup (archive->files_hash, scan->data);
+
+		if ((file_data == NULL) || file_data->dir)
+			return;
+	}
+
+	for (scan = file_list; scan; scan = scan->next)
+		fr_archive_change_remove_file (archive, scan->data);
+}
+
+
 static void
 fr_command_remove_files (FrArchive           *archive,
 		  	 GList               *file_list,
@@ -1725,6 +1750,7 @@ fr_command_remove_files (FrArchive           *archive,
 	g_object_set (self, "filename", private->local_copy, NULL);
 	fr_process_clear (self->process);
 	_fr_command_remove (self, file_list, compression);
+	_fr_command_report_removed_files (self, file_list);
 
 	fr_process_execute (self->process,
 			    cancellable,
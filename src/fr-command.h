@@ -85,7 +85,7 @@ GType    fr_command_get_type         (void);
 
 /**
  * fr_command_get_last_output:
- * Returns: (element-type guint8*) (transfer none): List of raw stderr (or stdout, if stderr is not present) lines of the last execution of the command, in their original encoding.
+ * Returns: (element-type guint8*) (transfer none): List of the first and the last raw stderr (or stdout, if stderr is not present) lines of the last execution of the command, in their original encoding.
  */
 GList *  fr_command_get_last_output  (FrCommand *command);
 
@@ -0,0 +1,177 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  File-Roller
+ *
+ *  Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+#include "fr-dir-index.h"
+
+
+struct _FrDirIndex {
+	FrDirIndexNode *root;
+	GHashTable     *folders; /* folder path => FrDirIndexNode */
+};
+
+
+static FrDirIndexNode *
+fr_dir_index_node_new (char           *path,
+		       const char     *name,
+		       FrDirIndexNode *parent)
+{
+	FrDirIndexNode *node;
+
+	node = g_new0 (FrDirIndexNode, 1);
+	node->path = path;
+	node->name = g_strdup (name);
+	node->parent = parent;
+	node->folders = g_ptr_array_new ();
+	node->files = g_ptr_array_new ();
+
+	return node;
+}
+
+
+static void
+fr_dir_index_node_free (FrDirIndexNode *node)
+{
+	g_ptr_array_free (node->folders, TRUE);
+	g_ptr_array_free (node->files, TRUE);
+	g_free (node->name);
+	g_free (node->path);
+	g_free (node);
+}
+
+
+/* Returns the folder with the given path, creating it and its parents if
+ * needed.  @path must end with a '/', the function takes its ownership. */
+static FrDirIndexNode *
+_fr_dir_index_add_folder (FrDirIndex *index,
+			  char       *path)
+{
+	FrDirIndexNode *node;
+	FrDirIndexNode *parent;
+	size_t          path_len;
+	size_t          name_start;
+
+	node = g_hash_table_lookup (index->folders, path);
+	if (node != NULL) {
+		g_free (path);
+		return node;
+	}
+
+	path_len = strlen (path);
+	name_start = path_len - 1;
+	while ((name_start > 0) && (path[name_start - 1] != '/'))
+		name_start--;
+	if (name_start == 0) {
+		/* not an absolute path */
+		g_free (path);
+		return index->root;
+	}
+
+	parent = _fr_dir_index_add_folder (index, g_strndup (path, name_start));
+	path[path_len - 1] = '\0';
+	node = fr_dir_index_node_new (path, path + name_start, parent);
+	path[path_len - 1] = '/';
+	g_ptr_array_add (parent->folders, node);
+	g_hash_table_insert (index->folders, node->path, node);
+
+	return node;
+}
+
+
+FrDirIndex *
+fr_dir_index_new (GPtrArray *files)
+{
+	FrDirIndex *index;
+
+	index = g_new0 (FrDirIndex, 1);
+	index->folders = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) fr_dir_index_node_free);
+	index->root = fr_dir_index_node_new (g_strdup ("/"), "", NULL);
+	g_hash_table_insert (index->folders, index->root->path, index->root);
+
+	for (guint i = 0; i < files->len; i++) {
+		FrFileData     *fdata = g_ptr_array_index (files, i);
+		const char     *full_path = fdata->full_path;
+		size_t          full_path_len = strlen (full_path);
+		const char     *name;
+		FrDirIndexNode *folder;
+
+		name = strrchr (full_path, '/');
+		if (fdata->dir || (name == NULL) || (name[1] == '\0')) {
+			/* the folder entry is part of the folder itself */
+			if ((full_path_len > 0) && (full_path[full_path_len - 1] == '/'))
+				folder = _fr_dir_index_add_folder (index, g_strdup (full_path));
+			else
+				folder = _fr_dir_index_add_folder (index, g_strconcat (full_path, "/", NULL));
+		}
+		else {
+			folder = _fr_dir_index_add_folder (index, g_strndup (full_path, name - full_path + 1));
+			g_ptr_array_add (folder->files, fdata);
+		}
+
+		for (FrDirIndexNode *node = folder; node != NULL; node = node->parent) {
+			if (node->file_data == NULL)
+				node->file_data = fdata;
+			node->size += fdata->size;
+			if (! fdata->dir)
+				node->n_files++;
+		}
+	}
+
+	return index;
+}
+
+
+void
+fr_dir_index_free (FrDirIndex *index)
+{
+	if (index == NULL)
+		return;
+
+	g_hash_table_destroy (index->folders);
+	g_free (index);
+}
+
+
+FrDirIndexNode *
+fr_dir_index_get_folder (FrDirIndex *index,
+			 const char *path)
+{
+	size_t          path_len;
+	char           *folder_path;
+	FrDirIndexNode *node;
+
+	g_return_val_if_fail (index != NULL, NULL);
+
+	if ((path == NULL) || (*path == '\0'))
+		return index->root;
+
+	path_len = strlen (path);
+	if (path[path_len - 1] == '/')
+		return g_hash_table_lookup (index->folders, path);
+
+	folder_path = g_strconcat (path, "/", NULL);
+	node = g_hash_table_lookup (index->folders, folder_path);
+	g_free (folder_path);
+
+	return node;
+}
@@ -0,0 +1,57 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  File-Roller
+ *
+ *  Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FR_DIR_INDEX_H
+#define FR_DIR_INDEX_H
+
+#include <glib.h>
+#include "fr-file-data.h"
+
+/* FrDirIndex: the folder tree of an archive, built once from the file list
+ * to browse the folders without scanning all the files. */
+typedef struct _FrDirIndex FrDirIndex;
+
+typedef struct _FrDirIndexNode FrDirIndexNode;
+struct _FrDirIndexNode {
+	char           *name;       /* The folder name, "" for the root. */
+	char           *path;       /* The folder path, with the ending '/'. */
+	FrDirIndexNode *parent;
+	GPtrArray      *folders;    /* (element-type FrDirIndexNode) The
+				     * sub-folders, in archive order. */
+	GPtrArray      *files;      /* (element-type FrFileData) The files
+				     * directly inside the folder. */
+	FrFileData     *file_data;  /* The entry used to show the folder: the
+				     * first entry inside the folder or the
+				     * folder entry itself. */
+	goffset         size;       /* The size of all the files inside,
+				     * recursively. */
+	guint           n_files;    /* The number of files inside,
+				     * recursively. */
+};
+
+FrDirIndex *     fr_dir_index_new        (GPtrArray  *files);
+void             fr_dir_index_free       (FrDirIndex *index);
+FrDirIndexNode * fr_dir_index_get_folder (FrDirIndex *index,
+					  const char *path);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (FrDirIndex, fr_dir_index_free)
+
+#endif /* FR_DIR_INDEX_H */
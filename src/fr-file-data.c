@@ -20,6 +20,7 @@
  */
 
 #include <config.h>
+#include <string.h>
 #include <glib/gi18n.h>
 #include <gio/gio.h>
 #include "glib-utils.h"
@@ -51,10 +52,11 @@ fr_file_data_free (FrFileData *fdata)
 		return;
 	if (fdata->free_original_path)
 		g_free (fdata->original_path);
-	g_free (fdata->full_path);
-	g_free (fdata->name);
-	g_free (fdata->path);
-	g_free (fdata->content_type);
+	if (! fdata->in_store) {
+		g_free (fdata->full_path);
+		g_free (fdata->name);
+		g_free (fdata->path);
+	}
 	g_free (fdata->link);
 	g_free (fdata->list_name);
 	g_free (fdata->sort_key);
@@ -78,7 +80,7 @@ fr_file_data_copy (FrFileData *src)
 	fdata->modified = src->modified;
 	fdata->name = g_strdup (src->name);
 	fdata->path = g_strdup (src->path);
-	fdata->content_type = g_strdup (src->content_type);
+	fdata->content_type = src->content_type;
 	fdata->encrypted = src->encrypted;
 	fdata->dir = src->dir;
 	fdata->dir_size = src->dir_size;
@@ -91,15 +93,126 @@ fr_file_data_copy (FrFileData *src)
 }
 
 
+/* The content type is guessed from the file name only, the result is
+ * usually the same for all the names with the same extension.  The cache is
+ * shared by all the archives. */
+#define CONTENT_TYPE_CACHE_MAX_SIZE 4096
+
+
+G_LOCK_DEFINE_STATIC (content_type_cache);
+static GHashTable *content_type_cache = NULL;
+static GHashTable *description_cache = NULL;
+
+
+/* The part of the name used as cache key: the extensions, including compound
+ * ones as in 'archive.tar.gz', or the whole name if it doesn't have an
+ * extension, as in 'Makefile'. */
+static const char *
+_get_content_type_key (const char *name,
+		       gboolean   *is_extension)
+{
+	const char *ext;
+
+	ext = (*name == '.') ? strchr (name + 1, '.') : strchr (name, '.');
+	*is_extension = (ext != NULL);
+	return (ext != NULL) ? ext : name;
+}
+
+
+static const char *
+_content_type_guess (const char *name)
+{
+	char       *guessed;
+	const char *content_type;
+
+	guessed = g_content_type_guess (name, NULL, 0, NULL);
+	content_type = g_intern_string (guessed);
+	g_free (guessed);
+
+	return content_type;
+}
+
+
 void
 fr_file_data_update_content_type (FrFileData *fdata)
 {
-	g_free (fdata->content_type);
+	const char *name;
+	const char *key;
+	gboolean    is_extension;
+	const char *content_type;
 
-	if (fdata->dir)
-		fdata->content_type = g_strdup (MIME_TYPE_DIRECTORY);
-	else
-		fdata->content_type = g_content_type_guess (fdata->full_path, NULL, 0, NULL);
+	if (fdata->dir) {
+		fdata->content_type = g_intern_static_string (MIME_TYPE_DIRECTORY);
+		return;
+	}
+
+	name = _g_path_get_basename (fdata->full_path);
+	key = _get_content_type_key (name, &is_extension);
+
+	G_LOCK (content_type_cache);
+	if (content_type_cache == NULL)
+		content_type_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	content_type = g_hash_table_lookup (content_type_cache, key);
+	G_UNLOCK (content_type_cache);
+
+	if (content_type == NULL) {
+		const char *key_content_type;
+
+		/* the cached type must not depend on the first name seen:
+		 * cache the type of a name made of the extension only, and
+		 * only if it's the type of the actual name too.  Names
+		 * matched literally, as 'CMakeLists.txt', are not cached. */
+
+		content_type = _content_type_guess (name);
+		if (is_extension) {
+			g_autofree char *key_name = g_strconcat ("x", key, NULL);
+			key_content_type = _content_type_guess (key_name);
+		}
+		else
+			key_content_type = content_type;
+
+		if (key_content_type == content_type) {
+			G_LOCK (content_type_cache);
+			if (g_hash_table_size (content_type_cache) >= CONTENT_TYPE_CACHE_MAX_SIZE)
+				g_hash_table_remove_all (content_type_cache);
+			g_hash_table_insert (content_type_cache, g_strdup (key), (gpointer) content_type);
+			G_UNLOCK (content_type_cache);
+		}
+	}
+
+	fdata->content_type = content_type;
+}
+
+
+/* Returns the content type, guessed the first time it's requested. */
+const char *
+fr_file_data_get_content_type (FrFileData *fdata)
+{
+	if (fdata->content_type == NULL)
+		fr_file_data_update_content_type (fdata);
+	return fdata->content_type;
+}
+
+
+/* Returns the description of the content type, the descriptions are cached
+ * as the content types. */
+const char *
+fr_file_data_get_content_type_description (FrFileData *fdata)
+{
+	const char *content_type = fr_file_data_get_content_type (fdata);
+	const char *description;
+
+	G_LOCK (content_type_cache);
+	if (description_cache == NULL)
+		description_cache = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+	description = g_hash_table_lookup (description_cache, content_type);
+	if (description == NULL) {
+		description = g_content_type_get_description (content_type);
+		g_hash_table_insert (description_cache, (gpointer) content_type, (gpointer) description);
+	}
+	G_UNLOCK (content_type_cache);
+
+	return description;
 }
 
 
@@ -176,3 +289,102 @@ fr_find_path_in_file_data_array (GPtrArray  *array,
 
 	return -1;
 }
+
+
+/* -- FrFileDataStore -- */
+
+
+struct _FrFileDataStore {
+	GStringChunk *strings;
+};
+
+
+FrFileDataStore *
+fr_file_data_store_new (void)
+{
+	FrFileDataStore *store;
+
+	store = g_new (FrFileDataStore, 1);
+	store->strings = g_string_chunk_new (64 * 1024);
+
+	return store;
+}
+
+
+/* The files added to the store must be freed before the store. */
+void
+fr_file_data_store_free (FrFileDataStore *store)
+{
+	if (store == NULL)
+		return;
+	g_string_chunk_free (store->strings);
+	g_free (store);
+}
+
+
+static char *
+_get_pointer_in_copy (const char *p,
+		      const char *original,
+		      gsize       original_size,
+		      char       *copy)
+{
+	if ((p >= original) && (p <= original + original_size))
+		return copy + (p - original);
+	else
+		return NULL;
+}
+
+
+/* Moves the paths and the name of @fdata in the store, the strings that
+ * point into full_path are updated. */
+void
+fr_file_data_store_add (FrFileDataStore *store,
+			FrFileData      *fdata)
+{
+	char  *full_path;
+	gsize  full_path_size;
+	char  *p;
+
+	if (fdata->in_store || (fdata->full_path == NULL))
+		return;
+
+	full_path = fdata->full_path;
+	full_path_size = strlen (full_path);
+	fdata->full_path = g_string_chunk_insert_len (store->strings, full_path, full_path_size);
+
+	if ((p = _get_pointer_in_copy (fdata->original_path, full_path, full_path_size, fdata->full_path)) != NULL) {
+		fdata->original_path = p;
+	}
+	else if (fdata->free_original_path && (fdata->original_path != NULL)) {
+		p = g_string_chunk_insert (store->strings, fdata->original_path);
+		g_free (fdata->original_path);
+		fdata->original_path = p;
+		fdata->free_original_path = FALSE;
+	}
+
+	/* the name of the files is the last part of the full path, the
+	 * folder names are shared */
+
+	if ((p = _get_pointer_in_copy (fdata->name, full_path, full_path_size, fdata->full_path)) != NULL) {
+		fdata->name = p;
+	}
+	else if (fdata->name != NULL) {
+		const char *basename = _g_path_get_basename (fdata->full_path);
+
+		if (strcmp (basename, fdata->name) == 0)
+			p = (char *) basename;
+		else
+			p = g_string_chunk_insert_const (store->strings, fdata->name);
+		g_free (fdata->name);
+		fdata->name = p;
+	}
+
+	if (fdata->path != NULL) {
+		p = g_string_chunk_insert_const (store->strings, fdata->path);
+		g_free (fdata->path);
+		fdata->path = p;
+	}
+
+	g_free (full_path);
+	fdata->in_store = TRUE;
+}
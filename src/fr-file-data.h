@@ -38,7 +38,8 @@ typedef struct {
 	gboolean    encrypted;        /* Whether the file is encrypted. */
 	gboolean    dir;              /* Whether this is a directory listed in the archive */
 	goffset     dir_size;
-	char       *content_type;
+	const char *content_type;     /* Interned string, use
+				       * fr_file_data_get_content_type. */
 
 	/* Additional data. */
 
@@ -51,8 +52,15 @@ typedef struct {
 	/* Private data */
 
 	gboolean    free_original_path;
+	gboolean    in_store;         /* Whether the paths and the name are
+				       * owned by a FrFileDataStore. */
 } FrFileData;
 
+/* FrFileDataStore: the strings of the files of an archive.  The paths are
+ * copied in a single arena, the folder paths and names are shared between
+ * the files. */
+typedef struct _FrFileDataStore FrFileDataStore;
+
 #define FR_TYPE_FILE_DATA (fr_file_data_get_type ())
 
 GType fr_file_data_get_type (void);
@@ -60,10 +68,16 @@ FrFileData *fr_file_data_new (void);
 FrFileData *fr_file_data_copy (FrFileData *src);
 void fr_file_data_free (FrFileData *fdata);
 void fr_file_data_update_content_type (FrFileData *fdata);
+const char *fr_file_data_get_content_type (FrFileData *fdata);
+const char *fr_file_data_get_content_type_description (FrFileData *fdata);
 gboolean fr_file_data_is_dir (FrFileData *fdata);
 void fr_file_data_set_list_name (FrFileData *fdata, const char *value);
 int fr_file_data_compare_by_path (gconstpointer a, gconstpointer b);
 
+FrFileDataStore *fr_file_data_store_new (void);
+void fr_file_data_store_free (FrFileDataStore *store);
+void fr_file_data_store_add (FrFileDataStore *store, FrFileData *fdata);
+
 /**
  * fr_find_path_in_file_data_array:
  * @array: (element-type FrFileData)
@@ -30,12 +30,14 @@
 #include <sys/wait.h>
 #include <unistd.h>
 #include <glib.h>
+#include <glib-unix.h>
 #include "file-utils.h"
 #include "fr-process.h"
 #include "glib-utils.h"
 
-#define REFRESH_RATE 20
 #define BUFFER_SIZE 16384
+#define MAX_RAW_LINES 2000 /* first and last output lines of a command to keep
+			    * for the error messages */
 
 
 /* -- FrCommandInfo --  */
@@ -50,6 +52,9 @@ typedef struct {
 	guint         ignore_error : 1;  /* whether to continue to execute
 					  * other commands if this command
 					  * fails. */
+	guint         parallel : 1;      /* whether the command can be
+					  * executed at the same time as the
+					  * adjacent parallel commands. */
 	FrContinueFunc  continue_func;
 	gpointer      continue_data;
 	FrProcFunc      begin_func;
@@ -69,6 +74,7 @@ fr_command_info_new (void)
 	info->dir = NULL;
 	info->sticky = FALSE;
 	info->ignore_error = FALSE;
+	info->parallel = FALSE;
 
 	return info;
 }
@@ -97,19 +103,38 @@ fr_command_info_free (FrCommandInfo *info)
 /* -- FrChannelData -- */
 
 
+static const char *try_charsets[] = { "UTF-8", "ISO-8859-1", "WINDOWS-1252" };
+static int         n_charsets = G_N_ELEMENTS (try_charsets);
+
+
 static void
 fr_channel_data_init (FrChannelData *channel)
 {
 	channel->source = NULL;
+	channel->watch_id = 0;
 	channel->raw = NULL;
+	channel->n_raw = 0;
+	channel->n_raw_before = 0;
+	channel->charset = -1;
 	channel->status = G_IO_STATUS_NORMAL;
 	channel->error = NULL;
 }
 
 
+static void
+fr_channel_data_remove_watch (FrChannelData *channel)
+{
+	if (channel->watch_id != 0) {
+		g_source_remove (channel->watch_id);
+		channel->watch_id = 0;
+	}
+}
+
+
 static void
 fr_channel_data_close_source (FrChannelData *channel)
 {
+	fr_channel_data_remove_watch (channel);
 	if (channel->source != NULL) {
 		g_io_channel_shutdown (channel->source, FALSE, NULL);
 		g_io_channel_unref (channel->source);
@@ -118,24 +143,167 @@ fr_channel_data_close_source (FrChannelData *channel)
 }
 
 
+/* Removes the lines in the middle of the output of the current command,
+ * keeping its first and last MAX_RAW_LINES lines: the error messages can be
+ * at the start of the output, as the wrong password ones, or at the end.
+ * The newest lines are at the beginning of @raw, the last @n_before lines are
+ * the output of the previous commands. */
+static GList *
+raw_lines_trim (GList *raw,
+		guint *n_lines,
+		guint  n_before)
+{
+	guint  n_removed;
+	GList *last_kept;
+	GList *first_removed;
+	GList *last_removed;
+
+	if (*n_lines - n_before <= 2 * MAX_RAW_LINES)
+		return raw;
+
+	n_removed = *n_lines - n_before - 2 * MAX_RAW_LINES;
+	last_kept = g_list_nth (raw, MAX_RAW_LINES - 1);
+	first_removed = last_kept->next;
+	last_removed = g_list_nth (first_removed, n_removed - 1);
+
+	last_kept->next = last_removed->next;
+	last_kept->next->prev = last_kept;
+	first_removed->prev = NULL;
+	last_removed->next = NULL;
+	_g_string_list_free (first_removed);
+	*n_lines -= n_removed;
+
+	return raw;
+}
+
+
+/* Trims the list only when the output of the current command is three times
+ * the maximum size, to avoid scanning it for each line. */
+static GList *
+raw_lines_prepend (GList *raw,
+		   guint *n_lines,
+		   guint  n_before,
+		   char  *line)
+{
+	raw = g_list_prepend (raw, line);
+	*n_lines += 1;
+	if (*n_lines - n_before >= 3 * MAX_RAW_LINES)
+		raw = raw_lines_trim (raw, n_lines, n_before);
+
+	return raw;
+}
+
+
+/* Called before adding the output of a new command: only the last
+ * MAX_RAW_LINES lines of the previous commands are kept. */
+static void
+fr_channel_data_start_command (FrChannelData *channel)
+{
+	if (channel->n_raw > MAX_RAW_LINES) {
+		GList *last = g_list_nth (channel->raw, MAX_RAW_LINES - 1);
+
+		last->next->prev = NULL;
+		_g_string_list_free (last->next);
+		last->next = NULL;
+		channel->n_raw = MAX_RAW_LINES;
+	}
+	channel->n_raw_before = channel->n_raw;
+}
+
+
+/* Adds the output of a command read apart, already trimmed. */
+static void
+fr_channel_data_add_command_output (FrChannelData *channel,
+				    GList         *raw,
+				    guint          n_raw)
+{
+	fr_channel_data_start_command (channel);
+	channel->raw = g_list_concat (raw, channel->raw);
+	channel->n_raw += n_raw;
+}
+
+
+static const char *
+fr_channel_data_get_charset (FrChannelData *channel)
+{
+	const char *charset;
+
+	if (channel->charset >= 0)
+		return try_charsets[channel->charset];
+
+	g_get_charset (&charset);
+	return charset;
+}
+
+
+/* Converts @line to UTF-8, when the line is not valid in the current charset
+ * the next ones are tried, and the first valid one is used for the following
+ * lines as well.  Takes the ownership of @line. */
+static char *
+fr_channel_data_decode_line (FrChannelData *channel,
+			     char          *line,
+			     gsize          length)
+{
+	char *utf8_line;
+
+	while (TRUE) {
+		const char *charset = fr_channel_data_get_charset (channel);
+
+		if ((g_ascii_strcasecmp (charset, "UTF-8") == 0) && g_utf8_validate (line, length, NULL)) {
+			g_clear_error (&channel->error);
+			return line;
+		}
+
+		g_clear_error (&channel->error);
+		utf8_line = g_convert (line, length, "UTF-8", charset, NULL, NULL, &channel->error);
+		if ((utf8_line != NULL) || (channel->charset >= n_charsets - 1))
+			break;
+
+		channel->charset++;
+	}
+
+	g_free (line);
+
+	return utf8_line;
+}
+
+
+/* Reads a line in the UTF-8 encoding, without the terminator. */
 static GIOStatus
-fr_channel_data_read (FrChannelData *channel)
+fr_channel_data_read_line (FrChannelData  *channel,
+			   char          **line)
 {
-	char  *line;
+	char  *raw_line;
 	gsize  length;
 	gsize  terminator_pos;
 
+	channel->status = g_io_channel_read_line (channel->source,
+						  &raw_line,
+						  &length,
+						  &terminator_pos,
+						  &channel->error);
+	if (channel->status != G_IO_STATUS_NORMAL)
+		return channel->status;
+
+	raw_line[terminator_pos] = 0;
+	*line = fr_channel_data_decode_line (channel, raw_line, terminator_pos);
+	if (*line == NULL)
+		channel->status = G_IO_STATUS_ERROR;
+
+	return channel->status;
+}
+
+
+static GIOStatus
+fr_channel_data_read (FrChannelData *channel)
+{
+	char *line;
+
 	channel->status = G_IO_STATUS_NORMAL;
 	g_clear_error (&channel->error);
 
-	while ((channel->status = g_io_channel_read_line (channel->source,
-							  &line,
-							  &length,
-							  &terminator_pos,
-							  &channel->error)) == G_IO_STATUS_NORMAL)
-	{
-		line[terminator_pos] = 0;
-		channel->raw = g_list_prepend (channel->raw, line);
+	while (fr_channel_data_read_line (channel, &line) == G_IO_STATUS_NORMAL) {
+		channel->raw = raw_lines_prepend (channel->raw, &channel->n_raw, channel->n_raw_before, line);
 		if (channel->line_func != NULL)
 			(*channel->line_func) (line, channel->line_data);
 	}
@@ -166,6 +334,8 @@ fr_channel_data_reset (FrChannelData *channel)
 		g_list_free_full (channel->raw, g_free);
 		channel->raw = NULL;
 	}
+	channel->n_raw = 0;
+	channel->n_raw_before = 0;
 }
 
 
@@ -176,18 +346,18 @@ fr_channel_data_free (FrChannelData *channel)
 }
 
 
+/* The channel is read as binary data, the lines are converted to UTF-8 by
+ * fr_channel_data_decode_line. */
 static void
 fr_channel_data_set_fd (FrChannelData *channel,
-			int            fd,
-			const char    *charset)
+			int            fd)
 {
 	fr_channel_data_reset (channel);
 
 	channel->source = g_io_channel_unix_new (fd);
 	g_io_channel_set_flags (channel->source, G_IO_FLAG_NONBLOCK, NULL);
+	g_io_channel_set_encoding (channel->source, NULL, NULL);
 	g_io_channel_set_buffer_size (channel->source, BUFFER_SIZE);
-	if (charset != NULL)
-		g_io_channel_set_encoding (channel->source, charset, NULL);
 }
 
 
@@ -237,8 +407,6 @@ enum {
 
 
 static guint       fr_process_signals[LAST_SIGNAL] = { 0 };
-static const char *try_charsets[] = { "UTF-8", "ISO-8859-1", "WINDOWS-1252" };
-static int         n_charsets = G_N_ELEMENTS (try_charsets);
 
 
 typedef struct {
@@ -247,16 +415,32 @@ typedef struct {
 	gint         current_comm;        /* currently editing command. */
 
 	GPid         command_pid;
-	guint        check_timeout;
+	guint        child_watch;
+	gboolean     child_exited;
+	int          child_status;
+
+	gboolean     out_in_thread;       /* whether to read the output in
+					   * out_thread. */
+	GThread     *out_thread;
+	GList       *out_thread_raw;      /* lines read by out_thread. */
+	guint        out_thread_n_raw;
 
 	gboolean     running;
 	gboolean     stopping;
 	gint         current_command;
 
+	GPtrArray   *parallel_commands;   /* ParallelCommand elements, the
+					   * parallel commands in execution. */
+	gint         next_parallel;       /* next command of the parallel
+					   * group to execute. */
+	gint         parallel_end;        /* first command after the parallel
+					   * group. */
+	gboolean     parallel_stopped;
+	int          max_parallel;
+
 	gboolean     use_standard_locale;
 	gboolean     sticky_only;         /* whether to execute only sticky
 			 		   * commands. */
-	int          current_charset;
 
 	ExecuteData *exec_data;
 } FrProcessPrivate;
@@ -264,6 +448,67 @@ typedef struct {
 G_DEFINE_FINAL_TYPE_WITH_PRIVATE (FrProcess, fr_process, G_TYPE_OBJECT)
 
 
+static void
+child_reaped_cb (GPid     pid,
+		 gint     status,
+		 gpointer user_data)
+{
+	g_spawn_close_pid (pid);
+}
+
+
+/* -- ParallelCommand -- */
+
+
+typedef struct {
+	ExecuteData   *exec_data;
+	int            n_command;
+	GPid           pid;
+	guint          child_watch;
+	gboolean       killed;      /* killed because of an error or because
+				     * the operation was cancelled. */
+	FrChannelData  out;
+	FrChannelData  err;
+} ParallelCommand;
+
+
+static void
+parallel_command_free (ParallelCommand *command)
+{
+	if (command == NULL)
+		return;
+
+	fr_channel_data_free (&command->out);
+	fr_channel_data_free (&command->err);
+	g_clear_error (&command->out.error);
+	g_clear_error (&command->err.error);
+	if (command->child_watch != 0) {
+		g_source_remove (command->child_watch);
+		g_child_watch_add (command->pid, child_reaped_cb, NULL);
+	}
+	g_free (command);
+}
+
+
+/* Stops watching the current command, the command is reaped when it exits
+ * but its result is ignored. */
+static void
+_fr_process_remove_watches (FrProcess *process)
+{
+	FrProcessPrivate *private = fr_process_get_instance_private (process);
+
+	fr_channel_data_remove_watch (&process->out);
+	fr_channel_data_remove_watch (&process->err);
+
+	if (private->child_watch != 0) {
+		g_source_remove (private->child_watch);
+		private->child_watch = 0;
+		if (private->command_pid > 0)
+			g_child_watch_add (private->command_pid, child_reaped_cb, NULL);
+	}
+}
+
+
 static void
 fr_process_finalize (GObject *object)
 {
@@ -276,6 +521,11 @@ fr_process_finalize (GObject *object)
 
 	FrProcessPrivate *private = fr_process_get_instance_private (process);
 
+	_fr_process_remove_watches (process);
+	if (private->out_thread != NULL)
+		g_thread_join (private->out_thread);
+	_g_string_list_free (private->out_thread_raw);
+	g_ptr_array_unref (private->parallel_commands);
 	execute_data_free (private->exec_data);
 	fr_process_clear (process);
 	g_ptr_array_free (private->comm, FALSE);
@@ -322,12 +572,19 @@ fr_process_init (FrProcess *process)
 	fr_channel_data_init (&process->out);
 	fr_channel_data_init (&process->err);
 
-	private->check_timeout = 0;
+	private->child_watch = 0;
+	private->child_exited = FALSE;
+	private->child_status = 0;
+	private->out_in_thread = FALSE;
+	private->out_thread = NULL;
+	private->out_thread_raw = NULL;
+	private->out_thread_n_raw = 0;
+	private->parallel_commands = g_ptr_array_new_with_free_func ((GDestroyNotify) parallel_command_free);
+	private->max_parallel = g_get_num_processors ();
 	private->running = FALSE;
 	private->stopping = FALSE;
 	process->restart = FALSE;
 
-	private->current_charset = -1;
 	private->use_standard_locale = FALSE;
 	private->exec_data = NULL;
 }
@@ -469,6 +726,35 @@ fr_process_set_ignore_error (FrProcess *process,
 }
 
 
+/* Consecutive parallel commands are executed at the same time, up to the
+ * number of commands specified with fr_process_set_max_parallel. */
+void
+fr_process_set_parallel (FrProcess *process,
+			 gboolean   parallel)
+{
+	FrCommandInfo *info;
+
+	g_return_if_fail (process != NULL);
+	FrProcessPrivate *private = fr_process_get_instance_private (process);
+	g_return_if_fail (private->current_comm >= 0);
+
+	info = g_ptr_array_index (private->comm, private->current_comm);
+	info->parallel = parallel;
+}
+
+
+void
+fr_process_set_max_parallel (FrProcess *process,
+			     int        max_parallel)
+{
+	g_return_if_fail (process != NULL);
+	g_return_if_fail (max_parallel > 0);
+
+	FrProcessPrivate *private = fr_process_get_instance_private (process);
+	private->max_parallel = max_parallel;
+}
+
+
 void
 fr_process_add_arg (FrProcess  *process,
 		    const char *arg)
@@ -638,6 +924,25 @@ fr_process_set_out_line_func (FrProcess *process,
 {
 	g_return_if_fail (process != NULL);
 
+	FrProcessPrivate *private = fr_process_get_instance_private (process);
+	private->out_in_thread = FALSE;
+	process->out.line_func = func;
+	process->out.line_data = data;
+}
+
+
+/* Like fr_process_set_out_line_func but @func is called in a worker thread,
+ * to parse long outputs without blocking the user interface.  @func must be
+ * thread safe and must not emit signals. */
+void
+fr_process_set_out_thread_line_func (FrProcess *process,
+				     FrLineFunc   func,
+				     gpointer   data)
+{
+	g_return_if_fail (process != NULL);
+
+	FrProcessPrivate *private = fr_process_get_instance_private (process);
+	private->out_in_thread = (func != NULL);
 	process->out.line_func = func;
 	process->out.line_data = data;
 }
@@ -694,6 +999,26 @@ allow_sticky_processes_only (ExecuteData *exec_data)
 }
 
 
+/* Kills the running commands of the parallel group, the sticky commands are
+ * left running. */
+static void
+_fr_process_kill_parallel_commands (FrProcess *process)
+{
+	FrProcessPrivate *private = fr_process_get_instance_private (process);
+	guint             i;
+
+	for (i = 0; i < private->parallel_commands->len; i++) {
+		ParallelCommand *command = g_ptr_array_index (private->parallel_commands, i);
+
+		if (command->killed || command_is_sticky (process, command->n_command))
+			continue;
+
+		killpg (command->pid, SIGTERM);
+		command->killed = TRUE;
+	}
+}
+
+
 static void
 execute_cancelled_cb (GCancellable *cancellable,
 		      gpointer      user_data)
@@ -711,17 +1036,17 @@ execute_cancelled_cb (GCancellable *cancellable,
 	private->stopping = TRUE;
 	exec_data->error = fr_error_new (FR_ERROR_STOPPED, 0, NULL);
 
-	if (command_is_sticky (process, private->current_command))
+	if (private->parallel_commands->len > 0)
+		_fr_process_kill_parallel_commands (process);
+
+	else if (command_is_sticky (process, private->current_command))
 		allow_sticky_processes_only (exec_data);
 
 	else if (private->command_pid > 0)
 		killpg (private->command_pid, SIGTERM);
 
 	else {
-		if (private->check_timeout != 0) {
-			g_source_remove (private->check_timeout);
-			private->check_timeout = 0;
-		}
+		_fr_process_remove_watches (process);
 
 		private->command_pid = 0;
 		fr_channel_data_close_source (&process->out);
@@ -738,17 +1063,6 @@ execute_cancelled_cb (GCancellable *cancellable,
 }
 
 
-static void _fr_process_start (ExecuteData *exec_data);
-
-
-static void
-_fr_process_restart (ExecuteData *exec_data)
-{
-	exec_data->process->restart = TRUE;
-	_fr_process_start (exec_data);
-}
-
-
 static void  execute_current_command (ExecuteData *exec_data);
 
 
@@ -772,67 +1086,90 @@ child_setup (gpointer user_data)
 }
 
 
-static const char *
-_fr_process_get_charset (FrProcess *process)
+static void
+_fr_process_execute_complete_in_idle (ExecuteData *exec_data)
 {
-	const char *charset = NULL;
-	FrProcessPrivate *private = fr_process_get_instance_private (process);
+	if (exec_data->cancel_id != 0) {
+		g_cancellable_disconnect (exec_data->cancellable, exec_data->cancel_id);
+		exec_data->cancel_id = 0;
+	}
+	g_simple_async_result_complete_in_idle (exec_data->result);
+}
 
-	if (private->current_charset >= 0)
-		charset = try_charsets[private->current_charset];
-	else if (g_get_charset (&charset))
-		charset = NULL;
 
-	return charset;
+static FrError *
+_fr_process_get_exit_error (int status)
+{
+	if (! WIFEXITED (status))
+		return fr_error_new (FR_ERROR_EXITED_ABNORMALLY, 255, NULL);
+	if (WEXITSTATUS (status) == 255)
+		return fr_error_new (FR_ERROR_COMMAND_NOT_FOUND, 0, NULL);
+	if (WEXITSTATUS (status) != 0)
+		return fr_error_new (FR_ERROR_COMMAND_ERROR, WEXITSTATUS (status), NULL);
+	return NULL;
 }
 
 
 static void
-_fr_process_execute_complete_in_idle (ExecuteData *exec_data)
+_fr_process_check_charset_error (FrError **error)
 {
-	if (exec_data->cancel_id != 0) {
-		g_cancellable_disconnect (exec_data->cancellable, exec_data->cancel_id);
-		exec_data->cancel_id = 0;
+	FrError *charset_error;
+
+	if ((*error == NULL)
+	    || ((*error)->type != FR_ERROR_IO_CHANNEL)
+	    || ! g_error_matches ((*error)->gerror, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE))
+	{
+		return;
 	}
-	g_simple_async_result_complete_in_idle (exec_data->result);
+
+	/* no charset is valid for the output */
+
+	charset_error = fr_error_new (FR_ERROR_BAD_CHARSET, 0, (*error)->gerror);
+	fr_error_free (*error);
+	*error = charset_error;
+}
+
+
+static void _fr_process_done (ExecuteData *exec_data);
+
+
+static void
+_fr_process_execute_next_command (ExecuteData *exec_data)
+{
+	FrProcess        *process = exec_data->process;
+	FrProcessPrivate *private = fr_process_get_instance_private (process);
+
+	if (private->sticky_only) {
+		do {
+			private->current_command++;
+		}
+		while ((private->current_command <= private->n_comm)
+			&& ! command_is_sticky (process, private->current_command));
+	}
+	else
+		private->current_command++;
+
+	if (private->current_command <= private->n_comm)
+		execute_current_command (exec_data);
+	else
+		_fr_process_done (exec_data);
 }
 
 
-static gint
-check_child (gpointer data)
+/* Called when the current command exited with @status, or when its output
+ * cannot be read, in this case exec_data->error is set and @status is not
+ * used. */
+static void
+_fr_process_command_completed (ExecuteData *exec_data,
+			       int          status)
 {
-	ExecuteData   *exec_data = data;
 	FrProcess     *process = exec_data->process;
 	FrProcessPrivate *private = fr_process_get_instance_private (process);
 	FrCommandInfo *info;
-	pid_t          pid;
-	int            status;
 	gboolean       continue_process;
 
 	info = g_ptr_array_index (private->comm, private->current_command);
 
-	/* Remove check. */
-
-	g_source_remove (private->check_timeout);
-	private->check_timeout = 0;
-
-	if (fr_channel_data_read (&process->out) == G_IO_STATUS_ERROR) {
-		exec_data->error = fr_error_new (FR_ERROR_IO_CHANNEL, 0, process->out.error);
-	}
-	else if (fr_channel_data_read (&process->err) == G_IO_STATUS_ERROR) {
-		exec_data->error = fr_error_new (FR_ERROR_IO_CHANNEL, 0, process->err.error);
-	}
-	else {
-		pid = waitpid (private->command_pid, &status, WNOHANG);
-		if (pid != private->command_pid) {
-			/* Add check again. */
-			private->check_timeout = g_timeout_add (REFRESH_RATE,
-							              check_child,
-							              exec_data);
-			return FALSE;
-		}
-	}
-
 	if (info->ignore_error && (exec_data->error != NULL)) {
 #ifdef DEBUG
 			{
@@ -847,19 +1184,8 @@ check_child (gpointer data)
 		fr_clear_error (&exec_data->error);
 		debug (DEBUG_INFO, "[error ignored]\n");
 	}
-	else if (exec_data->error == NULL) {
-		if (WIFEXITED (status)) {
-			if (WEXITSTATUS (status) == 255) {
-				exec_data->error = fr_error_new (FR_ERROR_COMMAND_NOT_FOUND, 0, NULL);
-			}
-			else if (WEXITSTATUS (status) != 0) {
-				exec_data->error = fr_error_new (FR_ERROR_COMMAND_ERROR, WEXITSTATUS (status), NULL);
-			}
-		}
-		else {
-			exec_data->error = fr_error_new (FR_ERROR_EXITED_ABNORMALLY, 255, NULL);
-		}
-	}
+	else if (exec_data->error == NULL)
+		exec_data->error = _fr_process_get_exit_error (status);
 
 	private->command_pid = 0;
 
@@ -875,19 +1201,7 @@ check_child (gpointer data)
 
 	/**/
 
-	if ((exec_data->error != NULL)
-	    && (exec_data->error->type == FR_ERROR_IO_CHANNEL)
-	    && g_error_matches (exec_data->error->gerror, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE))
-	{
-		if (private->current_charset < n_charsets - 1) {
-			/* try with another charset */
-			private->current_charset++;
-			_fr_process_restart (exec_data);
-			return FALSE;
-		}
-		fr_error_free (exec_data->error);
-		exec_data->error = fr_error_new (FR_ERROR_BAD_CHARSET, 0, exec_data->error->gerror);
-	}
+	_fr_process_check_charset_error (&exec_data->error);
 
 	/* Check whether to continue or stop the process */
 
@@ -910,23 +1224,19 @@ check_child (gpointer data)
 #endif
 		}
 
-		if (private->sticky_only) {
-			do {
-				private->current_command++;
-			}
-			while ((private->current_command <= private->n_comm)
-				&& ! command_is_sticky (process, private->current_command));
-		}
-		else
-			private->current_command++;
-
-		if (private->current_command <= private->n_comm) {
-			execute_current_command (exec_data);
-			return FALSE;
-		}
+		_fr_process_execute_next_command (exec_data);
+		return;
 	}
 
-	/* Done */
+	_fr_process_done (exec_data);
+}
+
+
+static void
+_fr_process_done (ExecuteData *exec_data)
+{
+	FrProcess        *process = exec_data->process;
+	FrProcessPrivate *private = fr_process_get_instance_private (process);
 
 	private->current_command = -1;
 	private->use_standard_locale = FALSE;
@@ -949,34 +1259,190 @@ check_child (gpointer data)
 
 		_g_string_list_free (process->out.raw);
 		process->out.raw = exec_data->first_error_stdout;
+		process->out.n_raw = g_list_length (process->out.raw);
+		process->out.n_raw_before = 0;
 		exec_data->first_error_stdout = NULL;
 
 		_g_string_list_free (process->err.raw);
 		process->err.raw = exec_data->first_error_stderr;
+		process->err.n_raw = g_list_length (process->err.raw);
+		process->err.n_raw_before = 0;
 		exec_data->first_error_stderr = NULL;
 	}
 
 	_fr_process_execute_complete_in_idle (exec_data);
+}
 
-	return FALSE;
+
+/* The command is completed when it has exited and the output thread has read
+ * all its output. */
+static void
+_fr_process_check_command_completed (ExecuteData *exec_data)
+{
+	FrProcessPrivate *private = fr_process_get_instance_private (exec_data->process);
+
+	if (private->out_thread != NULL)
+		return;
+
+	if (private->child_exited)
+		_fr_process_command_completed (exec_data, private->child_status);
+	else if (exec_data->error != NULL) {
+		/* don't wait for the command to exit */
+		_fr_process_remove_watches (exec_data->process);
+		_fr_process_command_completed (exec_data, 0);
+	}
 }
 
 
 static void
-execute_current_command (ExecuteData *exec_data)
+child_exited_cb (GPid     pid,
+		 gint     status,
+		 gpointer user_data)
 {
-	FrProcess      *process = exec_data->process;
+	ExecuteData *exec_data = user_data;
+	FrProcess   *process = exec_data->process;
 	FrProcessPrivate *private = fr_process_get_instance_private (process);
-	FrCommandInfo  *info;
-	GList          *scan;
-	char          **argv;
-	int             out_fd, err_fd;
-	int             i = 0;
-	GError         *error = NULL;
 
-	debug (DEBUG_INFO, "%d/%d) ", private->current_command, private->n_comm);
+	private->child_watch = 0;
+	private->child_exited = TRUE;
+	private->child_status = status;
+	g_spawn_close_pid (pid);
 
-	info = g_ptr_array_index (private->comm, private->current_command);
+	/* read the output written before exiting, the output thread reads
+	 * until the end by itself. */
+
+	fr_channel_data_remove_watch (&process->out);
+	fr_channel_data_remove_watch (&process->err);
+
+	if (exec_data->error == NULL) {
+		if ((private->out_thread == NULL) && (fr_channel_data_read (&process->out) == G_IO_STATUS_ERROR))
+			exec_data->error = fr_error_new (FR_ERROR_IO_CHANNEL, 0, process->out.error);
+		else if (fr_channel_data_read (&process->err) == G_IO_STATUS_ERROR)
+			exec_data->error = fr_error_new (FR_ERROR_IO_CHANNEL, 0, process->err.error);
+	}
+
+	_fr_process_check_command_completed (exec_data);
+}
+
+
+static gboolean
+_fr_process_channel_ready (ExecuteData   *exec_data,
+			   FrChannelData *channel)
+{
+	FrProcessPrivate *private = fr_process_get_instance_private (exec_data->process);
+
+	switch (fr_channel_data_read (channel)) {
+	case G_IO_STATUS_ERROR:
+		channel->watch_id = 0;
+		if (exec_data->error == NULL)
+			exec_data->error = fr_error_new (FR_ERROR_IO_CHANNEL, 0, channel->error);
+		if (private->out_thread != NULL) {
+			/* stop the command, otherwise the output thread
+			 * could wait for it forever. */
+			if (private->command_pid > 0)
+				killpg (private->command_pid, SIGTERM);
+		}
+		else
+			_fr_process_check_command_completed (exec_data);
+		return G_SOURCE_REMOVE;
+
+	case G_IO_STATUS_EOF:
+		/* the rest is read when the command exits */
+		channel->watch_id = 0;
+		return G_SOURCE_REMOVE;
+
+	default:
+		return G_SOURCE_CONTINUE;
+	}
+}
+
+
+static gboolean
+out_ready_cb (gint         fd,
+	      GIOCondition condition,
+	      gpointer     user_data)
+{
+	ExecuteData *exec_data = user_data;
+
+	return _fr_process_channel_ready (exec_data, &exec_data->process->out);
+}
+
+
+static gboolean
+err_ready_cb (gint         fd,
+	      GIOCondition condition,
+	      gpointer     user_data)
+{
+	ExecuteData *exec_data = user_data;
+
+	return _fr_process_channel_ready (exec_data, &exec_data->process->err);
+}
+
+
+static gboolean
+output_read_cb (gpointer user_data)
+{
+	ExecuteData *exec_data = user_data;
+	FrProcess   *process = exec_data->process;
+	FrProcessPrivate *private = fr_process_get_instance_private (process);
+
+	g_thread_join (private->out_thread);
+	private->out_thread = NULL;
+	fr_channel_data_add_command_output (&process->out, private->out_thread_raw, private->out_thread_n_raw);
+	private->out_thread_raw = NULL;
+	private->out_thread_n_raw = 0;
+
+	if ((process->out.status == G_IO_STATUS_ERROR) && (exec_data->error == NULL))
+		exec_data->error = fr_error_new (FR_ERROR_IO_CHANNEL, 0, process->out.error);
+
+	_fr_process_check_command_completed (exec_data);
+
+	return G_SOURCE_REMOVE;
+}
+
+
+/* Reads and parses the whole output of the command, the lines are kept
+ * apart from out.raw, which can be used by the main thread meanwhile. */
+static gpointer
+read_output_thread (gpointer user_data)
+{
+	ExecuteData   *exec_data = user_data;
+	FrProcessPrivate *private = fr_process_get_instance_private (exec_data->process);
+	FrChannelData *channel = &exec_data->process->out;
+	char          *line;
+
+	g_clear_error (&channel->error);
+	while (fr_channel_data_read_line (channel, &line) == G_IO_STATUS_NORMAL) {
+		private->out_thread_raw = raw_lines_prepend (private->out_thread_raw, &private->out_thread_n_raw, 0, line);
+		if (channel->line_func != NULL)
+			(*channel->line_func) (line, channel->line_data);
+	}
+
+	g_idle_add (output_read_cb, exec_data);
+
+	return NULL;
+}
+
+
+/* Executes the command @n_command, calling its begin function first. */
+static gboolean
+_fr_process_spawn_command (FrProcess  *process,
+			   int         n_command,
+			   GPid       *pid,
+			   int        *out_fd,
+			   int        *err_fd,
+			   GError    **error)
+{
+	FrProcessPrivate *private = fr_process_get_instance_private (process);
+	FrCommandInfo    *info;
+	GList            *scan;
+	char            **argv;
+	int               i = 0;
+	gboolean          result;
+
+	debug (DEBUG_INFO, "%d/%d) ", n_command, private->n_comm);
+
+	info = g_ptr_array_index (private->comm, n_command);
 
 	argv = g_new (char *, g_list_length (info->args) + 1);
 	for (scan = info->args; scan; scan = scan->next)
@@ -996,6 +1462,9 @@ execute_current_command (ExecuteData *exec_data)
 		if (info->ignore_error)
 			g_print ("\t[ignore error]\n");
 
+		if (info->parallel)
+			g_print ("\t[parallel]\n");
+
 		g_print ("\t");
 		for (j = 0; j < i; j++)
 			g_print ("%s ", argv[j]);
@@ -1006,36 +1475,321 @@ execute_current_command (ExecuteData *exec_data)
 	if (info->begin_func != NULL)
 		(*info->begin_func) (info->begin_data);
 
-	if (! g_spawn_async_with_pipes (info->dir,
-					argv,
-					NULL,
-					(G_SPAWN_LEAVE_DESCRIPTORS_OPEN
-					 | G_SPAWN_SEARCH_PATH
-					 | G_SPAWN_DO_NOT_REAP_CHILD),
-					child_setup,
-					process,
-					&private->command_pid,
-					NULL,
-					&out_fd,
-					&err_fd,
-					&error))
+	result = g_spawn_async_with_pipes (info->dir,
+					   argv,
+					   NULL,
+					   (G_SPAWN_LEAVE_DESCRIPTORS_OPEN
+					    | G_SPAWN_SEARCH_PATH
+					    | G_SPAWN_DO_NOT_REAP_CHILD),
+					   child_setup,
+					   process,
+					   pid,
+					   NULL,
+					   out_fd,
+					   err_fd,
+					   error);
+
+	g_free (argv);
+
+	return result;
+}
+
+
+/* -- parallel commands -- */
+
+
+static void _fr_process_run_parallel_commands (ExecuteData *exec_data);
+
+
+static void
+parallel_command_exited_cb (GPid     pid,
+			    gint     status,
+			    gpointer user_data)
+{
+	ParallelCommand  *command = user_data;
+	ExecuteData      *exec_data = command->exec_data;
+	FrProcess        *process = exec_data->process;
+	FrProcessPrivate *private = fr_process_get_instance_private (process);
+	FrCommandInfo    *info;
+	FrError          *error;
+	gboolean          continue_process;
+	gboolean          kill_group;
+
+	command->child_watch = 0;
+	g_spawn_close_pid (pid);
+
+	info = g_ptr_array_index (private->comm, command->n_command);
+
+	/* read the output written before exiting */
+
+	if (command->out.status != G_IO_STATUS_ERROR)
+		fr_channel_data_flush (&command->out);
+	if (command->err.status != G_IO_STATUS_ERROR)
+		fr_channel_data_flush (&command->err);
+
+	if (command->out.status == G_IO_STATUS_ERROR)
+		error = fr_error_new (FR_ERROR_IO_CHANNEL, 0, command->out.error);
+	else if (command->err.status == G_IO_STATUS_ERROR)
+		error = fr_error_new (FR_ERROR_IO_CHANNEL, 0, command->err.error);
+	else
+		error = _fr_process_get_exit_error (status);
+	_fr_process_check_charset_error (&error);
+
+	if (info->ignore_error && (error != NULL)) {
+		fr_clear_error (&error);
+		debug (DEBUG_INFO, "[error ignored]\n");
+	}
+
+	/* add the output to the output of the other commands */
+
+	fr_channel_data_add_command_output (&process->out, command->out.raw, command->out.n_raw);
+	command->out.raw = NULL;
+
+	fr_channel_data_add_command_output (&process->err, command->err.raw, command->err.n_raw);
+	command->err.raw = NULL;
+
+	if (info->end_func != NULL)
+		(*info->end_func) (info->end_data);
+
+	/* keep the first error, as for the other commands */
+
+	if ((exec_data->error == NULL) && ! command->killed)
+		exec_data->error = error;
+	else
+		fr_error_free (error);
+
+	/* a killed command would not have been executed after the error,
+	 * ignore its result. */
+
+	kill_group = FALSE;
+	if (! command->killed) {
+		continue_process = TRUE;
+		if (info->continue_func != NULL)
+			continue_process = (*info->continue_func) (&exec_data->error, info->continue_data);
+
+		if (! continue_process) {
+			private->parallel_stopped = TRUE;
+			kill_group = TRUE;
+		}
+		else if (exec_data->error != NULL) {
+			/* as for the other commands, from now on execute only
+			 * the sticky commands. */
+
+			private->current_command = command->n_command;
+			allow_sticky_processes_only (exec_data);
+			kill_group = TRUE;
+		}
+	}
+
+	g_ptr_array_remove (private->parallel_commands, command);
+	if (kill_group)
+		_fr_process_kill_parallel_commands (process);
+	_fr_process_run_parallel_commands (exec_data);
+}
+
+
+static gboolean
+_fr_process_parallel_channel_ready (ParallelCommand *command,
+				    FrChannelData   *channel)
+{
+	switch (fr_channel_data_read (channel)) {
+	case G_IO_STATUS_ERROR:
+		/* the error is reported when the command exits */
+		channel->watch_id = 0;
+		killpg (command->pid, SIGTERM);
+		return G_SOURCE_REMOVE;
+
+	case G_IO_STATUS_EOF:
+		channel->watch_id = 0;
+		return G_SOURCE_REMOVE;
+
+	default:
+		return G_SOURCE_CONTINUE;
+	}
+}
+
+
+static gboolean
+parallel_out_ready_cb (gint         fd,
+		       GIOCondition condition,
+		       gpointer     user_data)
+{
+	ParallelCommand *command = user_data;
+
+	return _fr_process_parallel_channel_ready (command, &command->out);
+}
+
+
+static gboolean
+parallel_err_ready_cb (gint         fd,
+		       GIOCondition condition,
+		       gpointer     user_data)
+{
+	ParallelCommand *command = user_data;
+
+	return _fr_process_parallel_channel_ready (command, &command->err);
+}
+
+
+static gboolean
+_fr_process_spawn_parallel_command (ExecuteData *exec_data,
+				    int          n_command)
+{
+	FrProcess        *process = exec_data->process;
+	FrProcessPrivate *private = fr_process_get_instance_private (process);
+	ParallelCommand  *command;
+	int               out_fd, err_fd;
+	GError           *error = NULL;
+
+	command = g_new0 (ParallelCommand, 1);
+	command->exec_data = exec_data;
+	command->n_command = n_command;
+	fr_channel_data_init (&command->out);
+	fr_channel_data_init (&command->err);
+
+	if (! _fr_process_spawn_command (process, n_command, &command->pid, &out_fd, &err_fd, &error)) {
+		if (exec_data->error == NULL)
+			exec_data->error = fr_error_new (FR_ERROR_SPAWN, 0, error);
+
+		g_error_free (error);
+		parallel_command_free (command);
+		return FALSE;
+	}
+
+	/* the lines of the parallel commands are passed to the line
+	 * functions in the main thread, as soon as they are read. */
+
+	fr_channel_data_set_fd (&command->out, out_fd);
+	command->out.line_func = process->out.line_func;
+	command->out.line_data = process->out.line_data;
+	command->out.charset = process->out.charset;
+	command->out.watch_id = g_unix_fd_add (out_fd, G_IO_IN | G_IO_HUP | G_IO_ERR, parallel_out_ready_cb, command);
+
+	fr_channel_data_set_fd (&command->err, err_fd);
+	command->err.line_func = process->err.line_func;
+	command->err.line_data = process->err.line_data;
+	command->err.charset = process->err.charset;
+	command->err.watch_id = g_unix_fd_add (err_fd, G_IO_IN | G_IO_HUP | G_IO_ERR, parallel_err_ready_cb, command);
+
+	command->child_watch = g_child_watch_add (command->pid, parallel_command_exited_cb, command);
+	g_ptr_array_add (private->parallel_commands, command);
+
+	return TRUE;
+}
+
+
+static void
+_fr_process_run_parallel_commands (ExecuteData *exec_data)
+{
+	FrProcess        *process = exec_data->process;
+	FrProcessPrivate *private = fr_process_get_instance_private (process);
+
+	while (! private->parallel_stopped
+	       && (private->parallel_commands->len < (guint) private->max_parallel)
+	       && (private->next_parallel < private->parallel_end))
+	{
+		int n_command = private->next_parallel++;
+
+		/* after an error execute only the sticky commands */
+
+		if ((private->sticky_only || (exec_data->error != NULL))
+		    && ! command_is_sticky (process, n_command))
+		{
+			continue;
+		}
+
+		if (! _fr_process_spawn_parallel_command (exec_data, n_command)) {
+			private->parallel_stopped = TRUE;
+			_fr_process_kill_parallel_commands (process);
+		}
+	}
+
+	if (private->parallel_commands->len > 0)
+		return;
+
+	/* all the commands of the group are completed */
+
+	private->current_command = private->parallel_end - 1;
+
+	if (private->parallel_stopped) {
+		_fr_process_done (exec_data);
+		return;
+	}
+
+	/* the group was stopped before any command failed */
+
+	if ((exec_data->error != NULL) && ! private->sticky_only)
+		allow_sticky_processes_only (exec_data);
+	_fr_process_execute_next_command (exec_data);
+}
+
+
+/* Executes the current command and the following parallel commands. */
+static void
+_fr_process_start_parallel_commands (ExecuteData *exec_data)
+{
+	FrProcess        *process = exec_data->process;
+	FrProcessPrivate *private = fr_process_get_instance_private (process);
+
+	private->next_parallel = private->current_command;
+	private->parallel_end = private->current_command;
+	while (private->parallel_end <= private->n_comm) {
+		FrCommandInfo *info = g_ptr_array_index (private->comm, private->parallel_end);
+
+		if (! info->parallel)
+			break;
+		private->parallel_end++;
+	}
+	private->parallel_stopped = FALSE;
+
+	_fr_process_run_parallel_commands (exec_data);
+}
+
+
+static void
+execute_current_command (ExecuteData *exec_data)
+{
+	FrProcess      *process = exec_data->process;
+	FrProcessPrivate *private = fr_process_get_instance_private (process);
+	FrCommandInfo  *info;
+	int             out_fd, err_fd;
+	GError         *error = NULL;
+
+	info = g_ptr_array_index (private->comm, private->current_command);
+	if (info->parallel) {
+		_fr_process_start_parallel_commands (exec_data);
+		return;
+	}
+
+	if (! _fr_process_spawn_command (process,
+					 private->current_command,
+					 &private->command_pid,
+					 &out_fd,
+					 &err_fd,
+					 &error))
 	{
 		exec_data->error = fr_error_new (FR_ERROR_SPAWN, 0, error);
 		_fr_process_execute_complete_in_idle (exec_data);
 
 		g_error_free (error);
-		g_free (argv);
 		return;
 	}
 
-	g_free (argv);
+	fr_channel_data_set_fd (&process->out, out_fd);
+	fr_channel_data_set_fd (&process->err, err_fd);
 
-	fr_channel_data_set_fd (&process->out, out_fd, _fr_process_get_charset (process));
-	fr_channel_data_set_fd (&process->err, err_fd, _fr_process_get_charset (process));
+	/* read the output as soon as it's available, and continue with the
+	 * next command as soon as this one exits. */
 
-	private->check_timeout = g_timeout_add (REFRESH_RATE,
-					              check_child,
-					              exec_data);
+	private->child_exited = FALSE;
+	if (private->out_in_thread) {
+		g_io_channel_set_flags (process->out.source, 0, NULL);
+		private->out_thread = g_thread_new ("fr-process-output", read_output_thread, exec_data);
+	}
+	else
+		process->out.watch_id = g_unix_fd_add (out_fd, G_IO_IN | G_IO_HUP | G_IO_ERR, out_ready_cb, exec_data);
+	process->err.watch_id = g_unix_fd_add (err_fd, G_IO_IN | G_IO_HUP | G_IO_ERR, err_ready_cb, exec_data);
+	private->child_watch = g_child_watch_add (private->command_pid, child_exited_cb, exec_data);
 }
 
 
@@ -1096,8 +1850,10 @@ fr_process_execute (FrProcess           *process,
 
         g_simple_async_result_set_op_res_gpointer (exec_data->result, exec_data, NULL);
 
-	if (! process->restart)
-		private->current_charset = -1;
+	/* detect the output charset again */
+
+	process->out.charset = -1;
+	process->err.charset = -1;
 
 	if (cancellable != NULL) {
 		GError *error = NULL;
@@ -37,7 +37,14 @@ typedef void     (*FrLineFunc)     (char *line, gpointer data);
 
 typedef struct {
 	GIOChannel *source;
-	GList      *raw;
+	guint       watch_id;   /* the watch for the data available in
+				 * source. */
+	GList      *raw;        /* the first and the last lines of the
+				 * output of each command. */
+	guint       n_raw;
+	guint       n_raw_before; /* the lines of the previous commands */
+	int         charset;    /* the charset of the output, -1 for the
+				 * locale charset. */
 	FrLineFunc    line_func;
 	gpointer    line_data;
 	GIOStatus   status;
@@ -92,11 +99,19 @@ void        fr_process_set_sticky           (FrProcess            *fr_proc,
 					     gboolean              sticky);
 void        fr_process_set_ignore_error     (FrProcess            *fr_proc,
 					     gboolean              ignore_error);
+void        fr_process_set_parallel         (FrProcess            *fr_proc,
+					     gboolean              parallel);
+void        fr_process_set_max_parallel     (FrProcess            *fr_proc,
+					     int                   max_parallel);
 void        fr_process_use_standard_locale  (FrProcess            *fr_proc,
 					     gboolean              use_stand_locale);
 void        fr_process_set_out_line_func    (FrProcess            *fr_proc,
 					     FrLineFunc              func,
 					     gpointer              func_data);
+void        fr_process_set_out_thread_line_func
+					    (FrProcess            *fr_proc,
+					     FrLineFunc              func,
+					     gpointer              func_data);
 void        fr_process_set_err_line_func    (FrProcess            *fr_proc,
 					     FrLineFunc              func,
 					     gpointer              func_data);
@@ -44,6 +44,7 @@
 #include "fr-location-bar.h"
 #include "fr-archive.h"
 #include "fr-command.h"
+#include "fr-dir-index.h"
 #include "fr-error.h"
 #include "fr-new-archive-dialog.h"
 #include "fr-window.h"
@@ -299,6 +300,14 @@ typedef struct {
 	gboolean         closing;
 	gboolean         notify;
 	gboolean         populating_file_list;
+	gboolean         listing;                   /* whether the listing
+						     * thread is filling the
+						     * file list. */
+	GHashTable      *listed_names;              /* the names shown while
+						     * listing the archive. */
+	FrDirIndex      *dir_index;                 /* the folders of the
+						     * archive, built when
+						     * needed. */
 
 	FrClipboardData *clipboard_data;
 	FrClipboardData *copy_data;
@@ -528,6 +537,9 @@ fr_window_free_private_data (FrWindow *window)
 	g_free (private->custom_action_message);
 
 	g_object_unref (private->list_store);
+	if (private->listed_names != NULL)
+		g_hash_table_unref (private->listed_names);
+	fr_dir_index_free (private->dir_index);
 
 	if (private->clipboard_data != NULL) {
 		fr_clipboard_data_unref (private->clipboard_data);
@@ -938,37 +950,40 @@ fr_window_history_print (FrWindow *window)
 #endif
 
 
+/* The folder tree is built once after the archive is listed, and dropped
+ * when the file list changes. */
+static FrDirIndex *
+fr_window_get_dir_index (FrWindow *window)
+{
+	FrWindowPrivate *private = fr_window_get_instance_private (window);
+
+	if (private->dir_index == NULL)
+		private->dir_index = fr_dir_index_new (window->archive->files);
+
+	return private->dir_index;
+}
+
+
+static void
+fr_window_clear_dir_index (FrWindow *window)
+{
+	FrWindowPrivate *private = fr_window_get_instance_private (window);
+
+	g_clear_pointer (&private->dir_index, fr_dir_index_free);
+}
+
+
 static gboolean
 fr_window_dir_exists_in_archive (FrWindow   *window,
 				 const char *dir_name)
 {
-	size_t dir_name_len;
-
 	if (dir_name == NULL)
 		return FALSE;
 
-	dir_name_len = strlen (dir_name);
-	if (dir_name_len == 0)
+	if ((*dir_name == '\0') || (strcmp (dir_name, "/") == 0))
 		return TRUE;
 
-	if (strcmp (dir_name, "/") == 0)
-		return TRUE;
-
-	for (guint i = 0; i < window->archive->files->len; i++) {
-		FrFileData *fdata = g_ptr_array_index (window->archive->files, i);
-
-		if (strncmp (dir_name, fdata->full_path, dir_name_len) == 0) {
-			return TRUE;
-		}
-		else if (fdata->dir
-			 && (fdata->full_path[strlen (fdata->full_path) - 1] != '/')
-			 && (strncmp (dir_name, fdata->full_path, dir_name_len - 1) == 0))
-		{
-			return TRUE;
-		}
-	}
-
-	return FALSE;
+	return fr_dir_index_get_folder (fr_window_get_dir_index (window), dir_name) != NULL;
 }
 
 
@@ -1194,18 +1209,36 @@ fr_window_pop_message (FrWindow *window)
 }
 
 
+/* Returns the files and the folders shown in the current folder, a folder
+ * is shown with the first entry inside it, which can be the folder entry
+ * itself. */
 static GPtrArray *
 fr_window_get_current_dir_list (FrWindow *window)
 {
-	GPtrArray *files;
+	FrDirIndexNode *folder;
+	GPtrArray      *files;
 
-	files = g_ptr_array_sized_new (128);
+	folder = fr_dir_index_get_folder (fr_window_get_dir_index (window), fr_window_get_current_location (window));
+	if (folder == NULL)
+		return g_ptr_array_new ();
 
-	for (guint i = 0; i < window->archive->files->len; i++) {
-		FrFileData *fdata = g_ptr_array_index (window->archive->files, i);
+	files = g_ptr_array_sized_new (folder->folders->len + folder->files->len);
 
-		if (fdata->list_name == NULL)
-			continue;
+	for (guint i = 0; i < folder->folders->len; i++) {
+		FrDirIndexNode *child = g_ptr_array_index (folder->folders, i);
+		FrFileData     *fdata = child->file_data;
+
+		fr_file_data_set_list_name (fdata, child->name);
+		fdata->list_dir = strlen (fdata->full_path) > strlen (child->path);
+		fdata->dir_size = child->size;
+		g_ptr_array_add (files, fdata);
+	}
+
+	for (guint i = 0; i < folder->files->len; i++) {
+		FrFileData *fdata = g_ptr_array_index (folder->files, i);
+
+		fr_file_data_set_list_name (fdata, _g_path_get_basename (fdata->full_path));
+		fdata->list_dir = FALSE;
 		g_ptr_array_add (files, fdata);
 	}
 
@@ -1242,32 +1275,6 @@ _fr_window_stop_activity_mode (FrWindow *window)
 /* -- window_update_file_list -- */
 
 
-static guint64
-get_dir_size (FrWindow   *window,
-	      const char *current_dir,
-	      const char *name)
-{
-	guint64  size;
-	char    *dirname;
-	size_t   dirname_l;
-
-	dirname = g_strconcat (current_dir, name, "/", NULL);
-	dirname_l = strlen (dirname);
-
-	size = 0;
-	for (guint i = 0; i < window->archive->files->len; i++) {
-		FrFileData *fd = g_ptr_array_index (window->archive->files, i);
-
-		if (strncmp (dirname, fd->full_path, dirname_l) == 0)
-			size += fd->size;
-	}
-
-	g_free (dirname);
-
-	return size;
-}
-
-
 static gboolean
 file_data_respects_filter (FrWindow *window,
 			   GRegex   *filter,
@@ -1338,7 +1345,7 @@ compute_file_list_name (FrWindow   *window,
 		if ((end != NULL) && (*(end + 1) != '\0'))
 			fdata->list_dir = TRUE;
 		fr_file_data_set_list_name (fdata, dir_name);
-		fdata->dir_size = get_dir_size (window, current_dir, dir_name);
+		fdata->dir_size = 0;
 	}
 
 	return TRUE;
@@ -1475,7 +1482,7 @@ get_icon (FrWindow  *window,
 		if (fr_file_data_is_dir (fdata))
 			content_type = MIME_TYPE_DIRECTORY;
 		else
-			content_type = fdata->content_type;
+			content_type = fr_file_data_get_content_type (fdata);
 		icon = g_content_type_get_icon (content_type);
 	}
 
@@ -1542,6 +1549,94 @@ add_selected_from_tree_view (GtkTreeModel *model,
 }
 
 
+static void
+fr_window_list_store_append_file (FrWindow   *window,
+				  FrFileData *fdata)
+{
+	FrWindowPrivate *private = fr_window_get_instance_private (window);
+	GtkTreeIter  iter;
+	GdkPixbuf   *icon, *emblem;
+	char        *utf8_name;
+
+	gtk_list_store_append (private->list_store, &iter);
+
+	icon = get_icon (window, fdata);
+	emblem = get_emblem (window, fdata);
+	utf8_name = g_filename_display_name (fdata->list_name);
+
+	if (fr_file_data_is_dir (fdata)) {
+		char *utf8_path;
+		char *tmp;
+		char *s_size;
+		char *s_time;
+
+		if (fdata->list_dir)
+			tmp = _g_path_remove_ending_separator (fr_window_get_current_location (window));
+
+		else
+			tmp = _g_path_remove_level (fdata->path);
+		utf8_path = g_filename_display_name (tmp);
+		g_free (tmp);
+
+		s_size = g_format_size (fdata->dir_size);
+
+		if (fdata->list_dir) {
+			s_time = g_strdup ("");
+		} else {
+			g_autoptr (GDateTime) date_time;
+			date_time = g_date_time_new_from_unix_local (fdata->modified);
+			s_time = g_date_time_format (date_time, _("%d %B %Y, %H:%M"));
+		}
+
+		gtk_list_store_set (private->list_store, &iter,
+				    COLUMN_FILE_DATA, fdata,
+				    COLUMN_ICON, icon,
+				    COLUMN_NAME, utf8_name,
+				    COLUMN_EMBLEM, emblem,
+				    COLUMN_TYPE, _("Folder"),
+				    COLUMN_SIZE, s_size,
+				    COLUMN_TIME, s_time,
+				    COLUMN_PATH, utf8_path,
+				    -1);
+		g_free (utf8_path);
+		g_free (s_size);
+		g_free (s_time);
+	}
+	else {
+		g_autoptr (GDateTime) date_time;
+		char *utf8_path;
+		char *s_size;
+		char *s_time;
+		const char *desc;
+
+		utf8_path = g_filename_display_name (fdata->path);
+
+		s_size = g_format_size (fdata->size);
+		date_time = g_date_time_new_from_unix_local (fdata->modified);
+		s_time = g_date_time_format (date_time, _("%d %B %Y, %H:%M"));
+		desc = fr_file_data_get_content_type_description (fdata);
+
+		gtk_list_store_set (private->list_store, &iter,
+				    COLUMN_FILE_DATA, fdata,
+				    COLUMN_ICON, icon,
+				    COLUMN_NAME, utf8_name,
+				    COLUMN_EMBLEM, emblem,
+				    COLUMN_TYPE, desc,
+				    COLUMN_SIZE, s_size,
+				    COLUMN_TIME, s_time,
+				    COLUMN_PATH, utf8_path,
+				    -1);
+		g_free (utf8_path);
+		g_free (s_size);
+		g_free (s_time);
+	}
+
+	g_free (utf8_name);
+	_g_object_unref (icon);
+	_g_object_unref (emblem);
+}
+
+
 static void
 fr_window_populate_file_list (FrWindow  *window,
 			      GPtrArray *files)
@@ -1567,90 +1662,9 @@ fr_window_populate_file_list (FrWindow  *window,
 
 	for (guint i = 0; i < files->len; i++) {
 		FrFileData *fdata = g_ptr_array_index (files, i);
-		GtkTreeIter  iter;
-		GdkPixbuf   *icon, *emblem;
-		char        *utf8_name;
 
-		if (fdata->list_name == NULL)
-			continue;
-
-		gtk_list_store_append (private->list_store, &iter);
-
-		icon = get_icon (window, fdata);
-		emblem = get_emblem (window, fdata);
-		utf8_name = g_filename_display_name (fdata->list_name);
-
-		if (fr_file_data_is_dir (fdata)) {
-			char *utf8_path;
-			char *tmp;
-			char *s_size;
-			char *s_time;
-
-			if (fdata->list_dir)
-				tmp = _g_path_remove_ending_separator (fr_window_get_current_location (window));
-
-			else
-				tmp = _g_path_remove_level (fdata->path);
-			utf8_path = g_filename_display_name (tmp);
-			g_free (tmp);
-
-			s_size = g_format_size (fdata->dir_size);
-
-			if (fdata->list_dir) {
-				s_time = g_strdup ("");
-			} else {
-				g_autoptr (GDateTime) date_time;
-				date_time = g_date_time_new_from_unix_local (fdata->modified);
-				s_time = g_date_time_format (date_time, _("%d %B %Y, %H:%M"));
-			}
-
-			gtk_list_store_set (private->list_store, &iter,
-					    COLUMN_FILE_DATA, fdata,
-					    COLUMN_ICON, icon,
-					    COLUMN_NAME, utf8_name,
-					    COLUMN_EMBLEM, emblem,
-					    COLUMN_TYPE, _("Folder"),
-					    COLUMN_SIZE, s_size,
-					    COLUMN_TIME, s_time,
-					    COLUMN_PATH, utf8_path,
-					    -1);
-			g_free (utf8_path);
-			g_free (s_size);
-			g_free (s_time);
-		}
-		else {
-			g_autoptr (GDateTime) date_time;
-			char *utf8_path;
-			char *s_size;
-			char *s_time;
-			char *desc;
-
-			utf8_path = g_filename_display_name (fdata->path);
-
-			s_size = g_format_size (fdata->size);
-			date_time = g_date_time_new_from_unix_local (fdata->modified);
-			s_time = g_date_time_format (date_time, _("%d %B %Y, %H:%M"));
-			desc = g_content_type_get_description (fdata->content_type);
-
-			gtk_list_store_set (private->list_store, &iter,
-					    COLUMN_FILE_DATA, fdata,
-					    COLUMN_ICON, icon,
-					    COLUMN_NAME, utf8_name,
-					    COLUMN_EMBLEM, emblem,
-					    COLUMN_TYPE, desc,
-					    COLUMN_SIZE, s_size,
-					    COLUMN_TIME, s_time,
-					    COLUMN_PATH, utf8_path,
-					    -1);
-			g_free (utf8_path);
-			g_free (s_size);
-			g_free (s_time);
-			g_free (desc);
-		}
-
-		g_free (utf8_name);
-		_g_object_unref (icon);
-		_g_object_unref (emblem);
+		if (fdata->list_name != NULL)
+			fr_window_list_store_append_file (window, fdata);
 	}
 
 	gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (private->list_store),
@@ -1774,7 +1788,9 @@ fr_window_update_dir_tree (FrWindow *window)
 	GHashTable *dir_cache;
 	GdkPixbuf  *icon;
 
-	if (! gtk_widget_get_realized (GTK_WIDGET (window)))
+	/* the file list is not complete while listing, the tree is updated
+	 * when the listing is finished. */
+	if (! gtk_widget_get_realized (GTK_WIDGET (window)) || private->listing)
 		return;
 
 	gtk_tree_store_clear (private->tree_store);
@@ -1905,7 +1921,9 @@ fr_window_update_file_list (FrWindow *window,
 	GPtrArray  *files;
 	gboolean    free_files = FALSE;
 
-	if (! gtk_widget_get_realized (GTK_WIDGET (window)))
+	/* the file list is being filled by the listing thread, the rows are
+	 * added by fr_archive_files_added_cb meanwhile. */
+	if (! gtk_widget_get_realized (GTK_WIDGET (window)) || private->listing)
 		return;
 
 	if (gtk_widget_get_realized (private->list_view))
@@ -1963,7 +1981,6 @@ fr_window_update_file_list (FrWindow *window,
 		}
 		g_free (current_dir);
 
-		fr_window_compute_list_names (window, window->archive->files);
 		files = fr_window_get_current_dir_list (window);
 		free_files = TRUE;
 	}
@@ -3118,6 +3135,31 @@ static void fr_window_batch_exec_next_action (FrWindow *window);
 static void fr_window_archive_list (FrWindow *window);
 
 
+/* Shows the file list updated by the last operation. */
+static void
+fr_window_show_updated_files (FrWindow *window)
+{
+	fr_window_clear_dir_index (window);
+	fr_window_go_to_location (window, fr_window_get_current_location (window), TRUE);
+	fr_window_update_dir_tree (window);
+}
+
+
+/* Shows the changes made to the archive, the archive is listed again if
+ * the file list was not updated by the operation. */
+static void
+fr_window_update_after_changes (FrWindow *window,
+				GError   *error)
+{
+	FrWindowPrivate *private = fr_window_get_instance_private (window);
+
+	if ((error == NULL) && fr_archive_get_files_updated (window->archive))
+		fr_window_show_updated_files (window);
+	else
+		private->reload_archive = TRUE;
+}
+
+
 static void
 _archive_operation_completed (FrWindow *window,
 			      FrAction  action,
@@ -3134,6 +3176,10 @@ _archive_operation_completed (FrWindow *window,
 	debug (DEBUG_INFO, "%s [DONE] (FR::Window)\n", action_names[action]);
 #endif
 
+	/* the folders index points to the old file list */
+	if ((window->archive != NULL) && fr_archive_get_files_updated (window->archive))
+		fr_window_clear_dir_index (window);
+
 	_fr_window_stop_activity_mode (window);
 	_handle_archive_operation_error (window, window->archive, action, error, &continue_batch, &opens_dialog);
 	if (opens_dialog)
@@ -3236,7 +3282,7 @@ _archive_operation_completed (FrWindow *window,
 		}
 
 		if (! private->batch_mode && ! operation_canceled)
-			private->reload_archive = TRUE;
+			fr_window_update_after_changes (window, error);
 
 		break;
 
@@ -3254,7 +3300,7 @@ _archive_operation_completed (FrWindow *window,
 	case FR_ACTION_UPDATING_FILES:
 		close_progress_dialog (window, FALSE);
 		if (! private->batch_mode && ! operation_canceled)
-			private->reload_archive = TRUE;
+			fr_window_update_after_changes (window, error);
 		break;
 
 	default:
@@ -5248,8 +5294,8 @@ type_column_sort_func (GtkTreeModel *model,
         	else {
         		const char  *desc1, *desc2;
 
-        		desc1 = g_content_type_get_description (fdata1->content_type);
-        		desc2 = g_content_type_get_description (fdata2->content_type);
+        		desc1 = fr_file_data_get_content_type_description (fdata1);
+        		desc2 = fr_file_data_get_content_type_description (fdata2);
         		result = strcasecmp (desc1, desc2);
         		if (result == 0)
         			result = strcmp (fdata1->sort_key, fdata2->sort_key);
@@ -5428,6 +5474,55 @@ fr_archive_stoppable_cb (FrArchive *archive,
 }
 
 
+/* Shows the files of the current folder while the archive is being listed,
+ * the complete list is sorted and shown by fr_window_update_file_list when
+ * the listing is finished. */
+static void
+fr_archive_files_added_cb (FrArchive *archive,
+			   GPtrArray *files,
+			   FrWindow  *window)
+{
+	FrWindowPrivate *private = fr_window_get_instance_private (window);
+	const char      *current_dir;
+	size_t           current_dir_len;
+	GRegex          *filter;
+
+	if ((private->action != FR_ACTION_LISTING_CONTENT) || ! gtk_widget_get_realized (GTK_WIDGET (window)))
+		return;
+
+	if (private->listed_names == NULL) {
+		private->listed_names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+		fr_window_clear_dir_index (window);
+		gtk_list_store_clear (private->list_store);
+		gtk_widget_set_sensitive (private->list_view, TRUE);
+		gtk_widget_show_all (gtk_widget_get_parent (private->list_view));
+	}
+
+	current_dir = private->archive_present ? fr_window_get_current_location (window) : "/";
+	current_dir_len = strlen (current_dir);
+	filter = _fr_window_create_filter (window);
+
+	private->populating_file_list = TRUE;
+	for (guint i = 0; i < files->len; i++) {
+		FrFileData *fdata = g_ptr_array_index (files, i);
+		gboolean    different_name;
+
+		/* the size of the folders is computed at the end, the files
+		 * array is being filled by the listing thread. */
+
+		fr_file_data_set_list_name (fdata, NULL);
+		fdata->list_dir = FALSE;
+		compute_file_list_name (window, filter, fdata, current_dir, current_dir_len, private->listed_names, &different_name);
+		if (fdata->list_name != NULL)
+			fr_window_list_store_append_file (window, fdata);
+	}
+	private->populating_file_list = FALSE;
+
+	if (filter != NULL)
+		g_regex_unref (filter);
+}
+
+
 static void
 fr_window_activate_filter (FrWindow *window)
 {
@@ -5610,6 +5705,7 @@ fr_window_construct (FrWindow *window)
 	private->archive_present = FALSE;
 	private->archive_new = FALSE;
 	private->reload_archive = FALSE;
+	private->listing = FALSE;
 	private->archive_file = NULL;
 
 	private->drag_destination_folder = NULL;
@@ -6001,6 +6097,8 @@ static void
 _fr_window_set_archive (FrWindow  *window,
 			FrArchive *archive)
 {
+	fr_window_clear_dir_index (window);
+
 	if (window->archive != NULL) {
 		g_signal_handlers_disconnect_by_data (window->archive, window);
 		g_object_unref (window->archive);
@@ -6031,6 +6129,10 @@ _fr_window_set_archive (FrWindow  *window,
 			  "working-archive",
 			  G_CALLBACK (fr_window_working_archive_cb),
 			  window);
+	g_signal_connect (window->archive,
+			  "files-added",
+			  G_CALLBACK (fr_archive_files_added_cb),
+			  window);
 }
 
 
@@ -6074,9 +6176,13 @@ archive_list_ready_cb (GObject      *source_object,
 		       GAsyncResult *result,
 		       gpointer      user_data)
 {
-	FrWindow *window = user_data;
-	GError   *error = NULL;
+	FrWindow        *window = user_data;
+	FrWindowPrivate *private = fr_window_get_instance_private (window);
+	GError          *error = NULL;
 
+	private->listing = FALSE;
+	g_clear_pointer (&private->listed_names, g_hash_table_unref);
+	fr_window_clear_dir_index (window);
 	fr_archive_operation_finish (FR_ARCHIVE (source_object), result, &error);
 	_archive_operation_completed (window, FR_ACTION_LISTING_CONTENT, error);
 
@@ -6095,6 +6201,7 @@ fr_window_archive_list (FrWindow *window)
 	}
 
 	_archive_operation_started (window, FR_ACTION_LISTING_CONTENT);
+	private->listing = TRUE;
 	fr_archive_list (window->archive,
 	                 private->password,
 	                 private->cancellable,
@@ -7284,6 +7391,10 @@ fr_window_go_to_location (FrWindow   *window,
 	g_return_if_fail (window != NULL);
 	g_return_if_fail (path != NULL);
 
+	/* the folders cannot be browsed until the archive is listed */
+	if (private->listing)
+		return;
+
 	if (force_update) {
 		g_free (private->last_location);
 		private->last_location = NULL;
@@ -8691,8 +8802,17 @@ static void
 paste_from_archive_completed_successfully (FrWindow *window)
 {
 	FrWindowPrivate *private = fr_window_get_instance_private (window);
+	gboolean         files_updated;
+
 	_paste_from_archive_operation_completed (window, FR_ACTION_PASTING_FILES, NULL);
 
+	/* the files cut from this same archive were removed by another
+	 * archive object */
+
+	files_updated = fr_archive_get_files_updated (window->archive)
+			&& ((private->clipboard_data->op != FR_CLIPBOARD_OP_CUT)
+			    || ! g_file_equal (private->clipboard_data->file, fr_archive_get_file (window->archive)));
+
 	fr_clipboard_data_unref (private->clipboard_data);
 	private->clipboard_data = NULL;
 
@@ -8702,7 +8822,10 @@ paste_from_archive_completed_successfully (FrWindow *window)
 	}
 
 	private->archive_new = FALSE;
-	fr_window_archive_reload (window);
+	if (files_updated)
+		fr_window_show_updated_files (window);
+	else
+		fr_window_archive_reload (window);
 }
 
 
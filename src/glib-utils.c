@@ -123,6 +123,37 @@ _g_error_free (GError *error)
 }
 
 
+void
+_g_set_error_from_errno (GError     **error,
+			 int          errsv,
+			 const char  *filename)
+{
+	if (filename != NULL)
+		g_set_error (error,
+			     G_IO_ERROR,
+			     g_io_error_from_errno (errsv),
+			     "%s: %s",
+			     filename,
+			     g_strerror (errsv));
+	else
+		g_set_error_literal (error,
+				     G_IO_ERROR,
+				     g_io_error_from_errno (errsv),
+				     g_strerror (errsv));
+}
+
+
+/* GBytes */
+
+
+void
+_g_bytes_unref (GBytes *bytes)
+{
+	if (bytes != NULL)
+		g_bytes_unref (bytes);
+}
+
+
 /* string */
 
 
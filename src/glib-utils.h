@@ -63,6 +63,13 @@ GEnumValue *        _g_enum_type_get_value_by_nick (GType                enum_ty
 /* error */
 
 void                _g_error_free                  (GError              *error);
+void                _g_set_error_from_errno        (GError             **error,
+						    int                  errsv,
+						    const char          *filename);
+
+/* GBytes */
+
+void                _g_bytes_unref                 (GBytes              *bytes);
 
 /* string */
 
@@ -0,0 +1,808 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  File-Roller
+ *
+ *  Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <zlib.h>
+#include <glib.h>
+#include <gio/gio.h>
+#include "gzip-utils.h"
+
+
+#define WINDOW_SIZE      32768
+#define INPUT_SIZE       (64 * 1024)
+#define DISCARD_SIZE     (64 * 1024)
+#define GZIP_TRAILER_SIZE 8
+#define INDEX_VARIANT_TYPE "(ta(ttyay))"
+
+
+typedef struct {
+	goffset  out;           /* uncompressed offset */
+	goffset  in;            /* compressed offset of the first full byte */
+	int      bits;          /* bits of the byte before 'in' that belong
+				 * to the block, from 0 to 7. */
+	GBytes  *window;        /* the last 32K of uncompressed data,
+				 * compressed with zlib. */
+} GzipPoint;
+
+
+struct _GzipIndex {
+	goffset  span;
+	GArray  *points;        /* GzipPoint, ordered by offset */
+};
+
+
+static void
+gzip_point_clear (GzipPoint *point)
+{
+	if (point->window != NULL)
+		g_bytes_unref (point->window);
+}
+
+
+GzipIndex *
+gzip_index_new (goffset span)
+{
+	GzipIndex *index;
+
+	index = g_new (GzipIndex, 1);
+	index->span = span;
+	index->points = g_array_new (FALSE, FALSE, sizeof (GzipPoint));
+	g_array_set_clear_func (index->points, (GDestroyNotify) gzip_point_clear);
+
+	return index;
+}
+
+
+void
+gzip_index_free (GzipIndex *index)
+{
+	if (index == NULL)
+		return;
+	g_array_unref (index->points);
+	g_free (index);
+}
+
+
+guint
+gzip_index_get_n_points (GzipIndex *index)
+{
+	return index->points->len;
+}
+
+
+GVariant *
+gzip_index_to_variant (GzipIndex *index)
+{
+	GVariantBuilder builder;
+	guint           i;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ttyay)"));
+	for (i = 0; i < index->points->len; i++) {
+		GzipPoint *point = &g_array_index (index->points, GzipPoint, i);
+
+		g_variant_builder_add (&builder,
+				       "(tty@ay)",
+				       (guint64) point->out,
+				       (guint64) point->in,
+				       (guchar) point->bits,
+				       g_variant_new_from_bytes (G_VARIANT_TYPE_BYTESTRING, point->window, TRUE));
+	}
+
+	return g_variant_new ("(ta(ttyay))", (guint64) index->span, &builder);
+}
+
+
+/* Returns NULL if the variant is not a valid index. */
+GzipIndex *
+gzip_index_new_from_variant (GVariant *variant)
+{
+	GzipIndex    *index;
+	guint64       span;
+	GVariantIter *iter;
+	guint64       out;
+	guint64       in;
+	guchar        bits;
+	GVariant     *window;
+
+	if (! g_variant_is_of_type (variant, G_VARIANT_TYPE (INDEX_VARIANT_TYPE)))
+		return NULL;
+
+	g_variant_get (variant, "(ta(ttyay))", &span, &iter);
+	index = gzip_index_new (span);
+	while (g_variant_iter_next (iter, "(tty@ay)", &out, &in, &bits, &window)) {
+		GzipPoint  point;
+		GzipPoint *last;
+
+		last = (index->points->len > 0) ? &g_array_index (index->points, GzipPoint, index->points->len - 1) : NULL;
+		if ((bits > 7) || ((last != NULL) && ((out <= (guint64) last->out) || (in < (guint64) last->in)))) {
+			g_variant_unref (window);
+			gzip_index_free (index);
+			index = NULL;
+			break;
+		}
+
+		point.out = out;
+		point.in = in;
+		point.bits = bits;
+		point.window = g_variant_get_data_as_bytes (window);
+		g_array_append_val (index->points, point);
+
+		g_variant_unref (window);
+	}
+	g_variant_iter_free (iter);
+
+	return index;
+}
+
+
+/* GzipReader */
+
+
+struct _GzipReader {
+	GInputStream *istream;
+	GzipIndex    *index;
+	z_stream      strm;
+	guchar       *input;
+	goffset       in_offset;        /* offset of the end of the input
+					 * buffer in the compressed stream */
+	goffset       out_offset;
+	gboolean      started;
+	gboolean      raw;              /* restarted from a checkpoint, the
+					 * member header was not read */
+	gboolean      member_end;
+	int           trailer_to_skip;
+	gboolean      eof;
+};
+
+
+GzipReader *
+gzip_reader_new (GInputStream *istream,
+		 GzipIndex    *index)
+{
+	GzipReader *reader;
+
+	reader = g_new0 (GzipReader, 1);
+	reader->istream = g_object_ref (istream);
+	reader->index = index;
+	reader->input = g_malloc (INPUT_SIZE);
+
+	return reader;
+}
+
+
+void
+gzip_reader_free (GzipReader *reader)
+{
+	if (reader == NULL)
+		return;
+	if (reader->started)
+		inflateEnd (&reader->strm);
+	g_object_unref (reader->istream);
+	g_free (reader->input);
+	g_free (reader);
+}
+
+
+static void
+_gzip_reader_set_error (GzipReader  *reader,
+			GError     **error)
+{
+	g_set_error (error,
+		     G_IO_ERROR,
+		     G_IO_ERROR_INVALID_DATA,
+		     "Invalid gzip data: %s",
+		     (reader->strm.msg != NULL) ? reader->strm.msg : "unexpected end of data");
+}
+
+
+/* Positions the reader at the compressed offset 'in', the decompressor is
+ * reset with the given window bits. */
+static gboolean
+_gzip_reader_restart (GzipReader    *reader,
+		      goffset        in,
+		      int            window_bits,
+		      GCancellable  *cancellable,
+		      GError       **error)
+{
+	if (! g_seekable_seek (G_SEEKABLE (reader->istream), in, G_SEEK_SET, cancellable, error))
+		return FALSE;
+
+	if (! reader->started) {
+		memset (&reader->strm, 0, sizeof (reader->strm));
+		if (inflateInit2 (&reader->strm, window_bits) != Z_OK) {
+			_gzip_reader_set_error (reader, error);
+			return FALSE;
+		}
+		reader->started = TRUE;
+	}
+	else if (inflateReset2 (&reader->strm, window_bits) != Z_OK) {
+		_gzip_reader_set_error (reader, error);
+		return FALSE;
+	}
+
+	reader->strm.next_in = reader->input;
+	reader->strm.avail_in = 0;
+	reader->in_offset = in;
+	reader->member_end = FALSE;
+	reader->trailer_to_skip = 0;
+	reader->eof = FALSE;
+
+	return TRUE;
+}
+
+
+static gboolean
+_gzip_reader_fill_input (GzipReader    *reader,
+			 GCancellable  *cancellable,
+			 GError       **error)
+{
+	gssize bytes_read;
+
+	bytes_read = g_input_stream_read (reader->istream, reader->input, INPUT_SIZE, cancellable, error);
+	if (bytes_read < 0)
+		return FALSE;
+
+	reader->strm.next_in = reader->input;
+	reader->strm.avail_in = bytes_read;
+	reader->in_offset += bytes_read;
+
+	return TRUE;
+}
+
+
+static void
+_gzip_reader_add_point (GzipReader *reader)
+{
+	GzipIndex *index = reader->index;
+	GzipPoint  point;
+	guchar     window[WINDOW_SIZE];
+	uInt       window_size = WINDOW_SIZE;
+	uLongf     compressed_size;
+	guchar    *compressed;
+
+	if (inflateGetDictionary (&reader->strm, window, &window_size) != Z_OK)
+		return;
+
+	compressed_size = compressBound (window_size);
+	compressed = g_malloc (compressed_size);
+	if (compress2 (compressed, &compressed_size, window, window_size, Z_BEST_SPEED) != Z_OK) {
+		g_free (compressed);
+		return;
+	}
+
+	point.out = reader->out_offset;
+	point.in = reader->in_offset - reader->strm.avail_in;
+	point.bits = reader->strm.data_type & 7;
+	point.window = g_bytes_new_take (compressed, compressed_size);
+	g_array_append_val (index->points, point);
+}
+
+
+static gboolean
+_gzip_reader_need_point (GzipReader *reader)
+{
+	GzipIndex *index = reader->index;
+	goffset    last_out;
+
+	if (index == NULL)
+		return FALSE;
+
+	/* at the end of a block, but not at the end of the last block of the
+	 * member. */
+	if (((reader->strm.data_type & 128) == 0) || ((reader->strm.data_type & 64) != 0))
+		return FALSE;
+
+	last_out = (index->points->len > 0) ? g_array_index (index->points, GzipPoint, index->points->len - 1).out : 0;
+
+	return reader->out_offset >= last_out + index->span;
+}
+
+
+gssize
+gzip_reader_read (GzipReader    *reader,
+		  void          *buffer,
+		  gsize          size,
+		  GCancellable  *cancellable,
+		  GError       **error)
+{
+	if (! reader->started && ! _gzip_reader_restart (reader, 0, 15 + 16, cancellable, error))
+		return -1;
+
+	reader->strm.next_out = buffer;
+	reader->strm.avail_out = size;
+
+	while ((reader->strm.avail_out > 0) && ! reader->eof) {
+		uInt avail_out;
+		int  ret;
+
+		if (reader->strm.avail_in == 0) {
+			if (! _gzip_reader_fill_input (reader, cancellable, error))
+				return -1;
+
+			if (reader->strm.avail_in == 0) {
+				if (! reader->member_end || (reader->trailer_to_skip > 0)) {
+					_gzip_reader_set_error (reader, error);
+					return -1;
+				}
+				reader->eof = TRUE;
+				break;
+			}
+		}
+
+		if (reader->trailer_to_skip > 0) {
+			uInt n = MIN (reader->strm.avail_in, (uInt) reader->trailer_to_skip);
+
+			reader->strm.next_in += n;
+			reader->strm.avail_in -= n;
+			reader->trailer_to_skip -= n;
+			continue;
+		}
+
+		if (reader->member_end) {
+			/* another member follows, or padding that is
+			 * ignored as gzip does. */
+			if (reader->strm.next_in[0] != 0x1f) {
+				reader->eof = TRUE;
+				break;
+			}
+			if (inflateReset2 (&reader->strm, 15 + 16) != Z_OK) {
+				_gzip_reader_set_error (reader, error);
+				return -1;
+			}
+			reader->member_end = FALSE;
+		}
+
+		avail_out = reader->strm.avail_out;
+		ret = inflate (&reader->strm, Z_BLOCK);
+		reader->out_offset += avail_out - reader->strm.avail_out;
+
+		if (ret == Z_STREAM_END) {
+			reader->member_end = TRUE;
+			if (reader->raw) {
+				/* raw deflate doesn't read the member
+				 * trailer. */
+				reader->trailer_to_skip = GZIP_TRAILER_SIZE;
+				reader->raw = FALSE;
+			}
+		}
+		else if ((ret != Z_OK) && (ret != Z_BUF_ERROR)) {
+			_gzip_reader_set_error (reader, error);
+			return -1;
+		}
+		else if (_gzip_reader_need_point (reader))
+			_gzip_reader_add_point (reader);
+	}
+
+	return size - reader->strm.avail_out;
+}
+
+
+goffset
+gzip_reader_tell (GzipReader *reader)
+{
+	return reader->out_offset;
+}
+
+
+static gboolean
+_gzip_reader_restart_at_point (GzipReader    *reader,
+			       GzipPoint     *point,
+			       GCancellable  *cancellable,
+			       GError       **error)
+{
+	guchar window[WINDOW_SIZE];
+	uLongf window_size = WINDOW_SIZE;
+	gsize  compressed_size;
+	const guchar *compressed;
+
+	compressed = g_bytes_get_data (point->window, &compressed_size);
+	if (uncompress (window, &window_size, compressed, compressed_size) != Z_OK) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid gzip index");
+		return FALSE;
+	}
+
+	if (! _gzip_reader_restart (reader, point->in - ((point->bits > 0) ? 1 : 0), -15, cancellable, error))
+		return FALSE;
+
+	if (point->bits > 0) {
+		guchar byte;
+		gsize  bytes_read;
+
+		if (! g_input_stream_read_all (reader->istream, &byte, 1, &bytes_read, cancellable, error))
+			return FALSE;
+		if (bytes_read != 1) {
+			_gzip_reader_set_error (reader, error);
+			return FALSE;
+		}
+		reader->in_offset += 1;
+		inflatePrime (&reader->strm, point->bits, byte >> (8 - point->bits));
+	}
+	inflateSetDictionary (&reader->strm, window, window_size);
+
+	reader->out_offset = point->out;
+	reader->raw = TRUE;
+
+	return TRUE;
+}
+
+
+/* Moves to the uncompressed 'offset', restarting from the nearest
+ * checkpoint before it. */
+gboolean
+gzip_reader_seek (GzipReader    *reader,
+		  goffset        offset,
+		  GCancellable  *cancellable,
+		  GError       **error)
+{
+	GzipPoint         *point = NULL;
+	g_autofree guchar *discard = NULL;
+
+	if (reader->index != NULL) {
+		guint i;
+
+		for (i = 0; i < reader->index->points->len; i++) {
+			GzipPoint *p = &g_array_index (reader->index->points, GzipPoint, i);
+
+			if (p->out > offset)
+				break;
+			point = p;
+		}
+	}
+
+	/* restart only if the checkpoint is nearer than the current
+	 * position. */
+
+	if (! reader->started || (offset < reader->out_offset) || ((point != NULL) && (point->out > reader->out_offset))) {
+		if (point != NULL) {
+			if (! _gzip_reader_restart_at_point (reader, point, cancellable, error))
+				return FALSE;
+		}
+		else {
+			if (! _gzip_reader_restart (reader, 0, 15 + 16, cancellable, error))
+				return FALSE;
+			reader->out_offset = 0;
+			reader->raw = FALSE;
+		}
+	}
+
+	discard = g_malloc (DISCARD_SIZE);
+	while (reader->out_offset < offset) {
+		gssize bytes_read;
+
+		bytes_read = gzip_reader_read (reader, discard, MIN (DISCARD_SIZE, offset - reader->out_offset), cancellable, error);
+		if (bytes_read < 0)
+			return FALSE;
+		if (bytes_read == 0) {
+			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid gzip offset");
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+
+/* GzipWriter
+ *
+ * The input is split in blocks, every block is compressed by a separate
+ * raw deflate stream that uses the last 32K of the previous block as
+ * dictionary, and is terminated with a sync flush to end on a byte
+ * boundary, so the compressed blocks can be concatenated in a single
+ * deflate stream, as pigz does. */
+
+
+#define WRITER_BLOCK_SIZE   (128 * 1024)
+#define WRITER_MIN_SPACE    64
+#define GZIP_OS_UNIX        3
+
+
+typedef struct {
+	GBytes     *input;
+	GBytes     *dictionary;
+	gboolean    last;
+	GByteArray *output;
+	uLong       crc;
+	gboolean    done;
+	gboolean    failed;
+} GzipBlock;
+
+
+struct _GzipWriter {
+	int            level;
+	guint          max_blocks;      /* blocks in the queue */
+	GzipWriteFunc  write_func;
+	gpointer       user_data;
+	GThreadPool   *pool;
+	GMutex         mutex;
+	GCond          cond;
+	GQueue        *blocks;          /* GzipBlock, in stream order */
+	GByteArray    *input;
+	GBytes        *dictionary;
+	uLong          crc;
+	guint32        size;            /* uncompressed size modulo 2^32 */
+	gboolean       header_written;
+};
+
+
+static void
+gzip_block_free (GzipBlock *block)
+{
+	if (block->input != NULL)
+		g_bytes_unref (block->input);
+	if (block->dictionary != NULL)
+		g_bytes_unref (block->dictionary);
+	if (block->output != NULL)
+		g_byte_array_unref (block->output);
+	g_free (block);
+}
+
+
+static void
+gzip_block_compress (GzipBlock  *block,
+		     GzipWriter *writer)
+{
+	z_stream      strm;
+	const guchar *input;
+	gsize         input_size;
+	gsize         used;
+	int           flush;
+	int           ret;
+
+	input = g_bytes_get_data (block->input, &input_size);
+	block->crc = crc32 (0L, input, input_size);
+
+	memset (&strm, 0, sizeof (strm));
+	ret = deflateInit2 (&strm, writer->level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+	if ((ret == Z_OK) && (block->dictionary != NULL)) {
+		const guchar *dictionary;
+		gsize         dictionary_size;
+
+		dictionary = g_bytes_get_data (block->dictionary, &dictionary_size);
+		ret = deflateSetDictionary (&strm, dictionary, dictionary_size);
+	}
+
+	if (ret == Z_OK) {
+		block->output = g_byte_array_sized_new (deflateBound (&strm, input_size) + WRITER_MIN_SPACE);
+		g_byte_array_set_size (block->output, deflateBound (&strm, input_size) + WRITER_MIN_SPACE);
+
+		strm.next_in = (guchar *) input;
+		strm.avail_in = input_size;
+		flush = block->last ? Z_FINISH : Z_SYNC_FLUSH;
+		used = 0;
+		do {
+			if (block->output->len - used < WRITER_MIN_SPACE)
+				g_byte_array_set_size (block->output, block->output->len * 2);
+			strm.next_out = block->output->data + used;
+			strm.avail_out = block->output->len - used;
+			ret = deflate (&strm, flush);
+			used = block->output->len - strm.avail_out;
+		}
+		while ((ret == Z_OK) && (block->last || (strm.avail_out == 0)));
+		g_byte_array_set_size (block->output, used);
+
+		if (block->last)
+			block->failed = (ret != Z_STREAM_END);
+		else
+			block->failed = (ret != Z_OK) && (ret != Z_BUF_ERROR);
+		deflateEnd (&strm);
+	}
+	else
+		block->failed = TRUE;
+
+	g_mutex_lock (&writer->mutex);
+	block->done = TRUE;
+	g_cond_broadcast (&writer->cond);
+	g_mutex_unlock (&writer->mutex);
+}
+
+
+GzipWriter *
+gzip_writer_new (int            level,
+		 guint          n_threads,
+		 GzipWriteFunc  write_func,
+		 gpointer       user_data)
+{
+	GzipWriter *writer;
+
+	n_threads = MAX (n_threads, 1);
+
+	writer = g_new0 (GzipWriter, 1);
+	writer->level = level;
+	writer->max_blocks = n_threads * 2;
+	writer->write_func = write_func;
+	writer->user_data = user_data;
+	writer->pool = g_thread_pool_new ((GFunc) gzip_block_compress, writer, n_threads, FALSE, NULL);
+	g_mutex_init (&writer->mutex);
+	g_cond_init (&writer->cond);
+	writer->blocks = g_queue_new ();
+	writer->input = g_byte_array_sized_new (WRITER_BLOCK_SIZE);
+	writer->crc = crc32 (0L, Z_NULL, 0);
+
+	return writer;
+}
+
+
+void
+gzip_writer_free (GzipWriter *writer)
+{
+	if (writer == NULL)
+		return;
+
+	/* wait for the running blocks */
+	g_thread_pool_free (writer->pool, FALSE, TRUE);
+
+	g_queue_free_full (writer->blocks, (GDestroyNotify) gzip_block_free);
+	g_byte_array_unref (writer->input);
+	if (writer->dictionary != NULL)
+		g_bytes_unref (writer->dictionary);
+	g_mutex_clear (&writer->mutex);
+	g_cond_clear (&writer->cond);
+	g_free (writer);
+}
+
+
+static void
+_gzip_writer_set_error (GError **error)
+{
+	g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED, "Compression failed");
+}
+
+
+static gboolean
+_gzip_writer_write_header (GzipWriter  *writer,
+			   GError     **error)
+{
+	guchar header[10] = { 0x1f, 0x8b, Z_DEFLATED, 0, 0, 0, 0, 0, 0, GZIP_OS_UNIX };
+
+	if (writer->header_written)
+		return TRUE;
+
+	if (writer->level == 9)
+		header[8] = 2;
+	else if (writer->level == 1)
+		header[8] = 4;
+	writer->header_written = TRUE;
+
+	return writer->write_func (header, sizeof (header), writer->user_data, error);
+}
+
+
+/* Writes the compressed blocks in stream order, waiting for the compression
+ * to finish until there are at most 'max_blocks' blocks in the queue. */
+static gboolean
+_gzip_writer_write_blocks (GzipWriter  *writer,
+			   guint        max_blocks,
+			   GError     **error)
+{
+	for (;;) {
+		GzipBlock *block;
+		gsize      input_size;
+		gboolean   success;
+
+		g_mutex_lock (&writer->mutex);
+		block = g_queue_peek_head (writer->blocks);
+		while ((block != NULL) && ! block->done && (g_queue_get_length (writer->blocks) > max_blocks))
+			g_cond_wait (&writer->cond, &writer->mutex);
+		if ((block == NULL) || ! block->done) {
+			g_mutex_unlock (&writer->mutex);
+			return TRUE;
+		}
+		g_queue_pop_head (writer->blocks);
+		g_mutex_unlock (&writer->mutex);
+
+		if (block->failed) {
+			_gzip_writer_set_error (error);
+			gzip_block_free (block);
+			return FALSE;
+		}
+
+		input_size = g_bytes_get_size (block->input);
+		writer->crc = crc32_combine (writer->crc, block->crc, input_size);
+		writer->size += input_size;
+		success = writer->write_func (block->output->data, block->output->len, writer->user_data, error);
+		gzip_block_free (block);
+
+		if (! success)
+			return FALSE;
+	}
+}
+
+
+static gboolean
+_gzip_writer_add_block (GzipWriter  *writer,
+			gboolean     last,
+			GError     **error)
+{
+	GzipBlock *block;
+	gsize      size;
+
+	if (! _gzip_writer_write_blocks (writer, writer->max_blocks - 1, error))
+		return FALSE;
+
+	block = g_new0 (GzipBlock, 1);
+	block->input = g_byte_array_free_to_bytes (writer->input);
+	block->dictionary = writer->dictionary;
+	block->last = last;
+	writer->input = g_byte_array_sized_new (WRITER_BLOCK_SIZE);
+
+	size = g_bytes_get_size (block->input);
+	if (size >= WINDOW_SIZE)
+		writer->dictionary = g_bytes_new_from_bytes (block->input, size - WINDOW_SIZE, WINDOW_SIZE);
+	else
+		writer->dictionary = NULL;
+
+	g_mutex_lock (&writer->mutex);
+	g_queue_push_tail (writer->blocks, block);
+	g_mutex_unlock (&writer->mutex);
+
+	return g_thread_pool_push (writer->pool, block, error);
+}
+
+
+gboolean
+gzip_writer_write (GzipWriter  *writer,
+		   const void  *buffer,
+		   gsize        size,
+		   GError     **error)
+{
+	const guchar *data = buffer;
+
+	if (! _gzip_writer_write_header (writer, error))
+		return FALSE;
+
+	while (size > 0) {
+		gsize n;
+
+		n = MIN (size, WRITER_BLOCK_SIZE - writer->input->len);
+		g_byte_array_append (writer->input, data, n);
+		data += n;
+		size -= n;
+
+		if ((writer->input->len == WRITER_BLOCK_SIZE) && ! _gzip_writer_add_block (writer, FALSE, error))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+gboolean
+gzip_writer_close (GzipWriter  *writer,
+		   GError     **error)
+{
+	guchar trailer[GZIP_TRAILER_SIZE];
+	int    i;
+
+	if (! _gzip_writer_write_header (writer, error)
+	    || ! _gzip_writer_add_block (writer, TRUE, error)
+	    || ! _gzip_writer_write_blocks (writer, 0, error))
+	{
+		return FALSE;
+	}
+
+	for (i = 0; i < 4; i++) {
+		trailer[i] = (writer->crc >> (8 * i)) & 0xff;
+		trailer[i + 4] = (writer->size >> (8 * i)) & 0xff;
+	}
+
+	return writer->write_func (trailer, sizeof (trailer), writer->user_data, error);
+}
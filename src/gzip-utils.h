@@ -0,0 +1,87 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  File-Roller
+ *
+ *  Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GZIP_UTILS_H
+#define GZIP_UTILS_H
+
+#include <glib.h>
+#include <gio/gio.h>
+
+/* GzipIndex: a list of checkpoints in a gzip stream, each checkpoint
+ * contains the decompressor state needed to restart the decompression at a
+ * deflate block boundary.  The checkpoints are added by GzipReader while
+ * decompressing, about every 'span' uncompressed bytes. */
+
+typedef struct _GzipIndex  GzipIndex;
+typedef struct _GzipReader GzipReader;
+typedef struct _GzipWriter GzipWriter;
+
+typedef gboolean (*GzipWriteFunc) (const void  *buffer,
+				   gsize        size,
+				   gpointer     user_data,
+				   GError     **error);
+
+/* GzipIndex */
+
+GzipIndex *  gzip_index_new              (goffset        span);
+void         gzip_index_free             (GzipIndex     *index);
+guint        gzip_index_get_n_points     (GzipIndex     *index);
+GVariant *   gzip_index_to_variant       (GzipIndex     *index);
+GzipIndex *  gzip_index_new_from_variant (GVariant      *variant);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GzipIndex, gzip_index_free)
+
+/* GzipReader */
+
+GzipReader * gzip_reader_new             (GInputStream  *istream,
+					  GzipIndex     *index);
+void         gzip_reader_free            (GzipReader    *reader);
+gssize       gzip_reader_read            (GzipReader    *reader,
+					  void          *buffer,
+					  gsize          size,
+					  GCancellable  *cancellable,
+					  GError       **error);
+goffset      gzip_reader_tell            (GzipReader    *reader);
+gboolean     gzip_reader_seek            (GzipReader    *reader,
+					  goffset        offset,
+					  GCancellable  *cancellable,
+					  GError       **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GzipReader, gzip_reader_free)
+
+/* GzipWriter: compresses the data in blocks using a pool of threads, the
+ * blocks are joined in a single standard gzip member. */
+
+GzipWriter * gzip_writer_new             (int            level,
+					  guint          n_threads,
+					  GzipWriteFunc  write_func,
+					  gpointer       user_data);
+void         gzip_writer_free            (GzipWriter    *writer);
+gboolean     gzip_writer_write           (GzipWriter    *writer,
+					  const void    *buffer,
+					  gsize          size,
+					  GError       **error);
+gboolean     gzip_writer_close           (GzipWriter    *writer,
+					  GError       **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GzipWriter, gzip_writer_free)
+
+#endif /* GZIP_UTILS_H */
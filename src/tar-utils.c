@@ -0,0 +1,249 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  File-Roller
+ *
+ *  Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+#include <gio/gio.h>
+#include "tar-utils.h"
+
+
+#define TAR_BLOCK_SIZE          512
+#define TAR_MAX_PAX_HEADER_SIZE (1024 * 1024)
+
+
+static guint64
+_tar_round_to_block (guint64 size)
+{
+	return (size + TAR_BLOCK_SIZE - 1) & ~((guint64) TAR_BLOCK_SIZE - 1);
+}
+
+
+static gboolean
+_tar_block_is_zero (const guchar *block)
+{
+	int i;
+
+	for (i = 0; i < TAR_BLOCK_SIZE; i++)
+		if (block[i] != 0)
+			return FALSE;
+
+	return TRUE;
+}
+
+
+/* Numeric fields are octal, large values can use the base-256 encoding. */
+static gboolean
+_tar_parse_number (const guchar *field,
+		   int           size,
+		   guint64      *value)
+{
+	int i;
+
+	*value = 0;
+
+	if (field[0] & 0x80) {
+		if (field[0] != 0x80)
+			return FALSE;
+		for (i = 1; i < size; i++) {
+			if (*value >> 56)
+				return FALSE;
+			*value = (*value << 8) | field[i];
+		}
+		return TRUE;
+	}
+
+	for (i = 0; (i < size) && (field[i] == ' '); i++)
+		;
+	for (; (i < size) && (field[i] >= '0') && (field[i] <= '7'); i++) {
+		if (*value >> 61)
+			return FALSE;
+		*value = (*value << 3) | (field[i] - '0');
+	}
+	for (; i < size; i++)
+		if ((field[i] != ' ') && (field[i] != '\0'))
+			return FALSE;
+
+	return TRUE;
+}
+
+
+static gboolean
+_tar_header_is_valid (const guchar *header)
+{
+	guint64  checksum;
+	guint64  unsigned_sum = 0;
+	gint64   signed_sum = 0;
+	int      i;
+
+	if (! _tar_parse_number (header + 148, 8, &checksum))
+		return FALSE;
+
+	for (i = 0; i < TAR_BLOCK_SIZE; i++) {
+		guchar c = ((i >= 148) && (i < 156)) ? ' ' : header[i];
+
+		unsigned_sum += c;
+		signed_sum += (signed char) c;
+	}
+
+	return (checksum == unsigned_sum) || ((gint64) checksum == signed_sum);
+}
+
+
+/* Returns the value of the 'size' record of a pax extended header, or -1. */
+static gint64
+_tar_pax_header_get_size (const char *data,
+			  gsize       size)
+{
+	gint64 value = -1;
+	gsize  offset = 0;
+
+	while (offset < size) {
+		const char *record = data + offset;
+		const char *key;
+		char       *end;
+		guint64     length;
+
+		length = g_ascii_strtoull (record, &end, 10);
+		if ((end == record) || (*end != ' ') || (length == 0) || (length > size - offset))
+			return -1;
+
+		key = end + 1;
+		if ((record + length - key > 5) && (strncmp (key, "size=", 5) == 0))
+			value = g_ascii_strtoll (key + 5, NULL, 10);
+
+		offset += length;
+	}
+
+	return value;
+}
+
+
+static gboolean
+_tar_read_block (GInputStream  *istream,
+		 guchar        *block,
+		 gboolean      *eof,
+		 GCancellable  *cancellable,
+		 GError       **error)
+{
+	gsize bytes_read;
+
+	if (! g_input_stream_read_all (istream, block, TAR_BLOCK_SIZE, &bytes_read, cancellable, error))
+		return FALSE;
+
+	*eof = (bytes_read == 0);
+	if ((bytes_read > 0) && (bytes_read < TAR_BLOCK_SIZE)) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Truncated tar archive");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+/* Sets @offset to the position of the end-of-archive blocks, that is where
+ * new entries can be written.  Only the headers are read, the entry data is
+ * skipped.  Returns FALSE if the archive uses features that make the end
+ * position uncertain (old GNU sparse files, multi-volume archives). */
+gboolean
+tar_find_end_of_entries (GInputStream  *istream,
+			 guint64       *offset,
+			 GCancellable  *cancellable,
+			 GError       **error)
+{
+	guchar  header[TAR_BLOCK_SIZE];
+	guint64 position = 0;
+	gint64  pax_size = -1;
+
+	if (! G_IS_SEEKABLE (istream) || ! g_seekable_can_seek (G_SEEKABLE (istream))) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "The archive stream is not seekable");
+		return FALSE;
+	}
+
+	while (TRUE) {
+		gboolean eof;
+		guint64  size;
+		char     type;
+
+		if (! g_seekable_seek (G_SEEKABLE (istream), position, G_SEEK_SET, cancellable, error))
+			return FALSE;
+		if (! _tar_read_block (istream, header, &eof, cancellable, error))
+			return FALSE;
+
+		if (eof || _tar_block_is_zero (header)) {
+			*offset = position;
+			return TRUE;
+		}
+
+		if (! _tar_header_is_valid (header) || ! _tar_parse_number (header + 124, 12, &size)) {
+			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid tar header");
+			return FALSE;
+		}
+
+		type = header[156];
+		switch (type) {
+		case 'x':
+			/* extended header for the next entry */
+			if (size > TAR_MAX_PAX_HEADER_SIZE) {
+				g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "Extended tar header too large");
+				return FALSE;
+			}
+			else {
+				g_autofree char *data = g_malloc (MAX (size, 1));
+				gsize            bytes_read;
+
+				if (! g_input_stream_read_all (istream, data, size, &bytes_read, cancellable, error))
+					return FALSE;
+				if (bytes_read < size) {
+					g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Truncated tar archive");
+					return FALSE;
+				}
+				pax_size = _tar_pax_header_get_size (data, size);
+			}
+			break;
+
+		case 'g':
+		case 'L':
+		case 'K':
+			break;
+
+		case 'S':
+		case 'M':
+			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "Unsupported tar entry type");
+			return FALSE;
+
+		default:
+			if (pax_size >= 0)
+				size = pax_size;
+			pax_size = -1;
+
+			/* links, devices, directories and fifos have no data,
+			 * readers don't agree on a non-zero size here. */
+			if ((type >= '1') && (type <= '6') && (size != 0)) {
+				g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "Unsupported tar entry size");
+				return FALSE;
+			}
+			break;
+		}
+
+		position += TAR_BLOCK_SIZE + _tar_round_to_block (size);
+	}
+}
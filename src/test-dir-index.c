@@ -0,0 +1,151 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  File-Roller
+ *
+ *  Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <glib.h>
+#include "fr-dir-index.h"
+
+
+static FrFileData *
+add_file (GPtrArray  *files,
+	  const char *full_path,
+	  goffset     size,
+	  gboolean    dir)
+{
+	FrFileData *fdata;
+
+	fdata = fr_file_data_new ();
+	fdata->full_path = g_strdup (full_path);
+	fdata->size = size;
+	fdata->dir = dir;
+	g_ptr_array_add (files, fdata);
+
+	return fdata;
+}
+
+
+static void
+assert_folder (FrDirIndexNode *node,
+	       const char     *name,
+	       const char     *path,
+	       goffset         size,
+	       guint           n_files,
+	       guint           n_folders,
+	       guint           n_direct_files)
+{
+	g_assert_nonnull (node);
+	g_assert_cmpstr (node->name, ==, name);
+	g_assert_cmpstr (node->path, ==, path);
+	g_assert_cmpint (node->size, ==, size);
+	g_assert_cmpuint (node->n_files, ==, n_files);
+	g_assert_cmpuint (node->folders->len, ==, n_folders);
+	g_assert_cmpuint (node->files->len, ==, n_direct_files);
+}
+
+
+static void
+test_dir_index (void)
+{
+	g_autoptr (GPtrArray) files = NULL;
+	g_autoptr (FrDirIndex) index = NULL;
+	FrFileData     *c_txt, *d_txt, *e_file, *f_txt, *g_dir, *h_txt, *i_txt, *k_txt;
+	FrDirIndexNode *root, *a, *b, *e, *g, *j;
+
+	files = g_ptr_array_new_with_free_func ((GDestroyNotify) fr_file_data_free);
+
+	/* "/a/" and "/a/b/" have no entry of their own */
+	c_txt = add_file (files, "/a/b/c.txt", 10, FALSE);
+	d_txt = add_file (files, "/a/b/d.txt", 20, FALSE);
+
+	/* a file and a folder with the same name */
+	e_file = add_file (files, "/a/e", 5, FALSE);
+	f_txt = add_file (files, "/a/e/f.txt", 7, FALSE);
+
+	/* a folder entry before and after the folder content */
+	g_dir = add_file (files, "/g/", 0, TRUE);
+	h_txt = add_file (files, "/g/h.txt", 3, FALSE);
+	i_txt = add_file (files, "/i.txt", 1, FALSE);
+	k_txt = add_file (files, "/j/k.txt", 2, FALSE);
+	add_file (files, "/j", 0, TRUE);
+
+	index = fr_dir_index_new (files);
+
+	/* the sizes and the number of files are recursive, the folder
+	 * entries are not counted. */
+
+	root = fr_dir_index_get_folder (index, NULL);
+	assert_folder (root, "", "/", 48, 7, 3, 1);
+	g_assert_null (root->parent);
+	g_assert_true (root->file_data == c_txt);
+	g_assert_true (g_ptr_array_index (root->files, 0) == i_txt);
+	g_assert_true (fr_dir_index_get_folder (index, "") == root);
+	g_assert_true (fr_dir_index_get_folder (index, "/") == root);
+
+	a = fr_dir_index_get_folder (index, "/a");
+	assert_folder (a, "a", "/a/", 42, 4, 2, 1);
+	g_assert_true (a->parent == root);
+	g_assert_true (a->file_data == c_txt);
+	g_assert_true (g_ptr_array_index (root->folders, 0) == a);
+	g_assert_true (fr_dir_index_get_folder (index, "/a/") == a);
+
+	b = fr_dir_index_get_folder (index, "/a/b/");
+	assert_folder (b, "b", "/a/b/", 30, 2, 0, 2);
+	g_assert_true (b->parent == a);
+	g_assert_true (b->file_data == c_txt);
+	g_assert_true (g_ptr_array_index (b->files, 0) == c_txt);
+	g_assert_true (g_ptr_array_index (b->files, 1) == d_txt);
+
+	/* the file "e" is in "/a/", the folder "e" contains "f.txt" */
+
+	g_assert_true (g_ptr_array_index (a->files, 0) == e_file);
+	e = fr_dir_index_get_folder (index, "/a/e");
+	assert_folder (e, "e", "/a/e/", 7, 1, 0, 1);
+	g_assert_true (e->parent == a);
+	g_assert_true (e->file_data == f_txt);
+	g_assert_true (g_ptr_array_index (a->folders, 1) == e);
+
+	g = fr_dir_index_get_folder (index, "/g/");
+	assert_folder (g, "g", "/g/", 3, 1, 0, 1);
+	g_assert_true (g->file_data == g_dir);
+	g_assert_true (g_ptr_array_index (g->files, 0) == h_txt);
+
+	j = fr_dir_index_get_folder (index, "/j/");
+	assert_folder (j, "j", "/j/", 2, 1, 0, 1);
+	g_assert_true (j->file_data == k_txt);
+
+	/* files and missing paths are not folders */
+
+	g_assert_null (fr_dir_index_get_folder (index, "/a/b/c.txt"));
+	g_assert_null (fr_dir_index_get_folder (index, "/i.txt"));
+	g_assert_null (fr_dir_index_get_folder (index, "/missing/"));
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/dir-index/folders", test_dir_index);
+
+	return g_test_run ();
+}
@@ -0,0 +1,137 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  File-Roller
+ *
+ *  Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include "dirfd-utils.h"
+
+
+static void
+add_created_folder (const char *relative_path,
+		    gpointer    user_data)
+{
+	g_ptr_array_add (user_data, g_strdup (relative_path));
+}
+
+
+static void
+test_open_parent (void)
+{
+	g_autofree char *root = NULL;
+	g_autofree char *path = NULL;
+	g_autoptr (GPtrArray) created = NULL;
+	g_autoptr (DirfdCache) cache = NULL;
+	g_autoptr (GError) error = NULL;
+	char *name = NULL;
+	int   fd;
+
+	root = g_dir_make_tmp ("test-dirfd-XXXXXX", NULL);
+	g_assert_nonnull (root);
+
+	created = g_ptr_array_new_with_free_func (g_free);
+	cache = dirfd_cache_new (root, add_created_folder, created, NULL);
+	g_assert_nonnull (cache);
+
+	/* the missing folders are created */
+
+	fd = dirfd_cache_open_parent (cache, "a//b/./c/file.txt", &name, NULL);
+	g_assert_cmpint (fd, >=, 0);
+	g_assert_cmpstr (name, ==, "file.txt");
+	g_assert_cmpuint (created->len, ==, 3);
+	g_assert_cmpstr (g_ptr_array_index (created, 2), ==, "a/b/c");
+	close (fd);
+	g_clear_pointer (&name, g_free);
+
+	path = g_build_filename (root, "a", "b", "c", NULL);
+	g_assert_true (g_file_test (path, G_FILE_TEST_IS_DIR));
+	g_clear_pointer (&path, g_free);
+
+	/* a file in the root folder, the folders are not created again */
+
+	fd = dirfd_cache_open_parent (cache, "file.txt/", &name, NULL);
+	g_assert_cmpint (fd, >=, 0);
+	g_assert_cmpstr (name, ==, "file.txt");
+	g_assert_cmpuint (created->len, ==, 3);
+	close (fd);
+	g_clear_pointer (&name, g_free);
+
+	/* symbolic links in the parents are not followed */
+
+	path = g_build_filename (root, "a", "link", NULL);
+	g_assert_cmpint (symlink ("/tmp", path), ==, 0);
+	fd = dirfd_cache_open_parent (cache, "a/link/file.txt", &name, &error);
+	g_assert_cmpint (fd, <, 0);
+	g_assert_null (name);
+	g_assert_true (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_TOO_MANY_LINKS));
+	g_unlink (path);
+	g_clear_pointer (&path, g_free);
+	g_clear_error (&error);
+
+	/* a file where a folder is expected is not a symbolic link */
+
+	path = g_build_filename (root, "a", "file", NULL);
+	g_assert_true (g_file_set_contents (path, "", 0, NULL));
+	fd = dirfd_cache_open_parent (cache, "a/file/file.txt", &name, &error);
+	g_assert_cmpint (fd, <, 0);
+	g_assert_true (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_DIRECTORY));
+	g_unlink (path);
+	g_clear_pointer (&path, g_free);
+	g_clear_error (&error);
+
+	/* a removed folder is created again */
+
+	path = g_build_filename (root, "a", "b", "c", NULL);
+	dirfd_cache_remove (cache, "a/b/c");
+	g_assert_cmpint (g_rmdir (path), ==, 0);
+	fd = dirfd_cache_open_parent (cache, "a/b/c/file.txt", &name, NULL);
+	g_assert_cmpint (fd, >=, 0);
+	g_assert_cmpuint (created->len, ==, 4);
+	g_assert_true (g_file_test (path, G_FILE_TEST_IS_DIR));
+	close (fd);
+	g_clear_pointer (&name, g_free);
+	g_clear_pointer (&path, g_free);
+
+	path = g_build_filename (root, "a", "b", "c", NULL);
+	g_rmdir (path);
+	g_clear_pointer (&path, g_free);
+	path = g_build_filename (root, "a", "b", NULL);
+	g_rmdir (path);
+	g_clear_pointer (&path, g_free);
+	path = g_build_filename (root, "a", NULL);
+	g_rmdir (path);
+	g_rmdir (root);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	g_test_init (&argc, &argv, NULL);
+	g_test_add_func ("/dirfd_cache_open_parent", test_open_parent);
+	return g_test_run ();
+}
@@ -0,0 +1,212 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  File-Roller
+ *
+ *  Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <zlib.h>
+#include <glib.h>
+#include <gio/gio.h>
+#include "gzip-utils.h"
+
+
+#define DATA_SIZE (1024 * 1024)
+#define SPAN      (64 * 1024)
+
+
+static GBytes *
+create_data (void)
+{
+	GRand  *rand;
+	guchar *data;
+	gsize   i;
+
+	/* compressible but not trivial data */
+
+	rand = g_rand_new_with_seed (42);
+	data = g_malloc (DATA_SIZE);
+	for (i = 0; i < DATA_SIZE; i++)
+		data[i] = 'a' + g_rand_int_range (rand, 0, 8);
+	g_rand_free (rand);
+
+	return g_bytes_new_take (data, DATA_SIZE);
+}
+
+
+static void
+append_gzip_member (GByteArray   *array,
+		    const guchar *data,
+		    gsize         size)
+{
+	z_stream strm;
+	guchar   buffer[16 * 1024];
+	int      ret;
+
+	memset (&strm, 0, sizeof (strm));
+	g_assert_cmpint (deflateInit2 (&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY), ==, Z_OK);
+	strm.next_in = (guchar *) data;
+	strm.avail_in = size;
+	do {
+		strm.next_out = buffer;
+		strm.avail_out = sizeof (buffer);
+		ret = deflate (&strm, Z_FINISH);
+		g_byte_array_append (array, buffer, sizeof (buffer) - strm.avail_out);
+	}
+	while (ret == Z_OK);
+	g_assert_cmpint (ret, ==, Z_STREAM_END);
+	deflateEnd (&strm);
+}
+
+
+static void
+assert_data_at (GzipReader *reader,
+		GBytes     *data,
+		goffset     offset)
+{
+	guchar buffer[1000];
+	gssize bytes_read;
+
+	g_assert_true (gzip_reader_seek (reader, offset, NULL, NULL));
+	g_assert_cmpint (gzip_reader_tell (reader), ==, offset);
+	bytes_read = gzip_reader_read (reader, buffer, sizeof (buffer), NULL, NULL);
+	g_assert_cmpint (bytes_read, ==, sizeof (buffer));
+	g_assert_cmpmem (buffer, bytes_read, (guchar *) g_bytes_get_data (data, NULL) + offset, bytes_read);
+}
+
+
+static void
+test_index (void)
+{
+	g_autoptr (GBytes) data = NULL;
+	g_autoptr (GByteArray) compressed = NULL;
+	g_autoptr (GBytes) compressed_bytes = NULL;
+	g_autoptr (GInputStream) istream = NULL;
+	g_autoptr (GzipIndex) index = NULL;
+	g_autoptr (GzipIndex) loaded_index = NULL;
+	g_autoptr (GVariant) variant = NULL;
+	g_autoptr (GzipReader) reader = NULL;
+	const guchar *bytes;
+	guchar       *buffer;
+	gssize        bytes_read;
+	gsize         total = 0;
+
+	/* two members of half size each */
+
+	data = create_data ();
+	bytes = g_bytes_get_data (data, NULL);
+	compressed = g_byte_array_new ();
+	append_gzip_member (compressed, bytes, DATA_SIZE / 2);
+	append_gzip_member (compressed, bytes + DATA_SIZE / 2, DATA_SIZE / 2);
+	compressed_bytes = g_bytes_new (compressed->data, compressed->len);
+	istream = g_memory_input_stream_new_from_bytes (compressed_bytes);
+
+	/* read the whole stream building the index */
+
+	index = gzip_index_new (SPAN);
+	reader = gzip_reader_new (istream, index);
+	buffer = g_malloc (DATA_SIZE + 1);
+	while ((bytes_read = gzip_reader_read (reader, buffer + total, MIN (4096, DATA_SIZE - total + 1), NULL, NULL)) > 0)
+		total += bytes_read;
+	g_assert_cmpint (bytes_read, ==, 0);
+	g_assert_cmpuint (total, ==, DATA_SIZE);
+	g_assert_cmpmem (buffer, total, bytes, DATA_SIZE);
+	g_free (buffer);
+	g_assert_cmpuint (gzip_index_get_n_points (index), >, 4);
+	g_clear_pointer (&reader, gzip_reader_free);
+
+	/* seek with a saved index, in both members and across them */
+
+	variant = g_variant_ref_sink (gzip_index_to_variant (index));
+	loaded_index = gzip_index_new_from_variant (variant);
+	g_assert_nonnull (loaded_index);
+	g_assert_cmpuint (gzip_index_get_n_points (loaded_index), ==, gzip_index_get_n_points (index));
+
+	reader = gzip_reader_new (istream, loaded_index);
+	assert_data_at (reader, data, DATA_SIZE - 1000);
+	assert_data_at (reader, data, 100);
+	assert_data_at (reader, data, DATA_SIZE / 2 - 500);
+	assert_data_at (reader, data, DATA_SIZE / 4 + 12345);
+	assert_data_at (reader, data, DATA_SIZE / 4 + 20000);
+}
+
+
+static gboolean
+append_to_array (const void  *buffer,
+		 gsize        size,
+		 gpointer     user_data,
+		 GError     **error)
+{
+	g_byte_array_append (user_data, buffer, size);
+	return TRUE;
+}
+
+
+static void
+test_writer (void)
+{
+	g_autoptr (GBytes) data = NULL;
+	g_autoptr (GByteArray) compressed = NULL;
+	g_autoptr (GzipWriter) writer = NULL;
+	const guchar *bytes;
+	guchar       *buffer;
+	gsize         offset;
+	gsize         buffer_size;
+	z_stream      strm;
+
+	data = create_data ();
+	bytes = g_bytes_get_data (data, NULL);
+	compressed = g_byte_array_new ();
+
+	/* write with buffers not aligned to the block size */
+
+	writer = gzip_writer_new (Z_DEFAULT_COMPRESSION, 4, append_to_array, compressed);
+	for (offset = 0; offset < DATA_SIZE; offset += 10000)
+		g_assert_true (gzip_writer_write (writer, bytes + offset, MIN (10000, DATA_SIZE - offset), NULL));
+	g_assert_true (gzip_writer_close (writer, NULL));
+	g_assert_cmpuint (compressed->len, <, DATA_SIZE / 2);
+
+	/* the result must be a single standard gzip member */
+
+	buffer_size = DATA_SIZE + 1;
+	buffer = g_malloc (buffer_size);
+	memset (&strm, 0, sizeof (strm));
+	g_assert_cmpint (inflateInit2 (&strm, 15 + 16), ==, Z_OK);
+	strm.next_in = compressed->data;
+	strm.avail_in = compressed->len;
+	strm.next_out = buffer;
+	strm.avail_out = buffer_size;
+	g_assert_cmpint (inflate (&strm, Z_FINISH), ==, Z_STREAM_END);
+	g_assert_cmpuint (strm.avail_in, ==, 0);
+	g_assert_cmpuint (strm.total_out, ==, DATA_SIZE);
+	g_assert_cmpmem (buffer, strm.total_out, bytes, DATA_SIZE);
+	inflateEnd (&strm);
+	g_free (buffer);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	g_test_init (&argc, &argv, NULL);
+	g_test_add_func ("/gzip_reader_seek", test_index);
+	g_test_add_func ("/gzip_writer", test_writer);
+	return g_test_run ();
+}
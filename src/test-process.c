@@ -0,0 +1,201 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  File-Roller
+ *
+ *  Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <glib.h>
+#include <gio/gio.h>
+#include "fr-process.h"
+
+
+typedef struct {
+	GMainLoop *loop;
+	gboolean   result;
+	FrError   *error;
+	int        sticky_only;
+	gboolean   sleep_ended;
+	gboolean   sleep_ended_before_sticky_only;
+	gboolean   next_executed;
+	gboolean   sticky_executed;
+} TestData;
+
+
+static void
+sleep_end_cb (gpointer user_data)
+{
+	TestData *data = user_data;
+
+	data->sleep_ended = TRUE;
+}
+
+
+static void
+next_end_cb (gpointer user_data)
+{
+	TestData *data = user_data;
+
+	data->next_executed = TRUE;
+}
+
+
+static void
+sticky_end_cb (gpointer user_data)
+{
+	TestData *data = user_data;
+
+	data->sticky_executed = TRUE;
+}
+
+
+static void
+sticky_only_cb (FrProcess *process,
+		gpointer   user_data)
+{
+	TestData *data = user_data;
+
+	if (data->sticky_only == 0)
+		data->sleep_ended_before_sticky_only = data->sleep_ended;
+	data->sticky_only++;
+}
+
+
+static void
+execute_ready_cb (GObject      *source_object,
+		  GAsyncResult *result,
+		  gpointer      user_data)
+{
+	TestData *data = user_data;
+
+	data->result = fr_process_execute_finish (FR_PROCESS (source_object), result, &data->error);
+	g_main_loop_quit (data->loop);
+}
+
+
+static void
+test_parallel_group_error (void)
+{
+	g_autoptr (FrProcess) process = NULL;
+	TestData data = { 0 };
+	gint64   start_time;
+
+	process = fr_process_new ();
+	fr_process_set_max_parallel (process, 2);
+	g_signal_connect (process, "sticky_only", G_CALLBACK (sticky_only_cb), &data);
+
+	/* a group with a long command and a failing command */
+
+	fr_process_begin_command (process, "sleep");
+	fr_process_set_parallel (process, TRUE);
+	fr_process_set_end_func (process, sleep_end_cb, &data);
+	fr_process_add_arg (process, "30");
+	fr_process_end_command (process);
+
+	fr_process_begin_command (process, "sh");
+	fr_process_set_parallel (process, TRUE);
+	fr_process_add_arg (process, "-c");
+	fr_process_add_arg (process, "echo failed >&2; exit 3");
+	fr_process_end_command (process);
+
+	/* the next command is not executed, the sticky command is */
+
+	fr_process_begin_command (process, "true");
+	fr_process_set_end_func (process, next_end_cb, &data);
+	fr_process_end_command (process);
+
+	fr_process_begin_command (process, "true");
+	fr_process_set_sticky (process, TRUE);
+	fr_process_set_end_func (process, sticky_end_cb, &data);
+	fr_process_end_command (process);
+
+	data.loop = g_main_loop_new (NULL, FALSE);
+	start_time = g_get_monotonic_time ();
+	fr_process_execute (process, NULL, execute_ready_cb, &data);
+	g_main_loop_run (data.loop);
+
+	/* the error of the failing command is reported */
+
+	g_assert_false (data.result);
+	g_assert_nonnull (data.error);
+	g_assert_cmpint (data.error->type, ==, FR_ERROR_COMMAND_ERROR);
+	g_assert_cmpint (data.error->status, ==, 3);
+	g_assert_nonnull (process->err.raw);
+	g_assert_cmpstr (process->err.raw->data, ==, "failed");
+
+	/* the sibling is killed as soon as the command fails */
+
+	g_assert_cmpint (data.sticky_only, ==, 1);
+	g_assert_false (data.sleep_ended_before_sticky_only);
+	g_assert_true (data.sleep_ended);
+	g_assert_cmpint (g_get_monotonic_time () - start_time, <, 20 * G_USEC_PER_SEC);
+
+	g_assert_false (data.next_executed);
+	g_assert_true (data.sticky_executed);
+
+	fr_error_free (data.error);
+	g_main_loop_unref (data.loop);
+}
+
+
+static void
+test_parallel_group_ignore_error (void)
+{
+	g_autoptr (FrProcess) process = NULL;
+	TestData data = { 0 };
+
+	process = fr_process_new ();
+	g_signal_connect (process, "sticky_only", G_CALLBACK (sticky_only_cb), &data);
+
+	fr_process_begin_command (process, "true");
+	fr_process_set_parallel (process, TRUE);
+	fr_process_end_command (process);
+
+	fr_process_begin_command (process, "false");
+	fr_process_set_parallel (process, TRUE);
+	fr_process_set_ignore_error (process, TRUE);
+	fr_process_end_command (process);
+
+	fr_process_begin_command (process, "true");
+	fr_process_set_end_func (process, next_end_cb, &data);
+	fr_process_end_command (process);
+
+	data.loop = g_main_loop_new (NULL, FALSE);
+	fr_process_execute (process, NULL, execute_ready_cb, &data);
+	g_main_loop_run (data.loop);
+
+	g_assert_true (data.result);
+	g_assert_null (data.error);
+	g_assert_cmpint (data.sticky_only, ==, 0);
+	g_assert_true (data.next_executed);
+
+	g_main_loop_unref (data.loop);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/process/parallel-group-error", test_parallel_group_error);
+	g_test_add_func ("/process/parallel-group-ignore-error", test_parallel_group_ignore_error);
+
+	return g_test_run ();
+}
@@ -0,0 +1,388 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  File-Roller
+ *
+ *  Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#if ENABLE_LIBARCHIVE
+#include <archive.h>
+#include <archive_entry.h>
+#endif
+#include "zip-utils.h"
+
+
+static const char *names[] = { "a.txt", "dir/b.txt", NULL };
+static const char *contents[] = { "first file", "second file content", NULL };
+
+
+static void
+put16 (GByteArray *array,
+       guint16     value)
+{
+	guint8 b[2] = { value & 0xff, value >> 8 };
+	g_byte_array_append (array, b, 2);
+}
+
+
+static void
+put32 (GByteArray *array,
+       guint32     value)
+{
+	put16 (array, value & 0xffff);
+	put16 (array, value >> 16);
+}
+
+
+static guint32
+get_crc32 (const char *data)
+{
+	guint32 crc = 0xFFFFFFFF;
+	int     i;
+
+	for (; *data != 0; data++) {
+		crc ^= (guchar) *data;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+	}
+
+	return ~crc;
+}
+
+
+/* Builds a zip archive with stored entries, the central directory is
+ * written by ZipWriter.  The entries are regular files when @modes is
+ * NULL, the checksums are fake when @valid_crc is FALSE. */
+static GBytes *
+create_archive (const char    **names,
+		const char    **contents,
+		const guint32  *modes,
+		gboolean        valid_crc)
+{
+	g_autoptr (GOutputStream) ostream = NULL;
+	g_autoptr (GByteArray) local = NULL;
+	g_autoptr (ZipWriter) writer = NULL;
+	g_autoptr (GPtrArray) entries = NULL;
+	int i;
+
+	local = g_byte_array_new ();
+	entries = g_ptr_array_new_with_free_func ((GDestroyNotify) zip_entry_free);
+	for (i = 0; names[i] != NULL; i++) {
+		ZipEntry *entry = g_new0 (ZipEntry, 1);
+
+		entry->name = g_strdup (names[i]);
+		entry->version_made_by = (3 << 8) | 20;
+		entry->version_needed = 20;
+		entry->crc32 = valid_crc ? get_crc32 (contents[i]) : 0x12345678 + i;
+		entry->compressed_size = strlen (contents[i]);
+		entry->uncompressed_size = strlen (contents[i]);
+		entry->external_attributes = ((modes != NULL) ? modes[i] : 0100644) << 16;
+		entry->local_header_offset = local->len;
+		entry->extra = g_bytes_new (NULL, 0);
+		entry->comment = g_bytes_new (NULL, 0);
+		g_ptr_array_add (entries, entry);
+
+		put32 (local, 0x04034b50);
+		put16 (local, 20);
+		put16 (local, 0);
+		put16 (local, 0);
+		put16 (local, 0);
+		put16 (local, 0);
+		put32 (local, entry->crc32);
+		put32 (local, entry->compressed_size);
+		put32 (local, entry->uncompressed_size);
+		put16 (local, strlen (names[i]));
+		put16 (local, 0);
+		g_byte_array_append (local, (guint8 *) names[i], strlen (names[i]));
+		g_byte_array_append (local, (guint8 *) contents[i], strlen (contents[i]));
+	}
+
+	ostream = g_memory_output_stream_new_resizable ();
+	g_assert_true (g_output_stream_write_all (ostream, local->data, local->len, NULL, NULL, NULL));
+
+	writer = zip_writer_new (ostream, local->len);
+	for (i = 0; i < (int) entries->len; i++)
+		zip_writer_keep_entry (writer, g_ptr_array_index (entries, i));
+	g_assert_true (zip_writer_finish (writer, NULL, NULL, NULL));
+	g_assert_true (g_output_stream_close (ostream, NULL, NULL));
+
+	return g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (ostream));
+}
+
+
+static GBytes *
+create_test_archive (void)
+{
+	return create_archive (names, contents, NULL, FALSE);
+}
+
+
+static char *
+read_entry_data (GBytes   *archive,
+		 ZipEntry *entry)
+{
+	const guint8 *data = g_bytes_get_data (archive, NULL);
+	const guint8 *header = data + entry->local_header_offset;
+	guint16       name_size = header[26] | (header[27] << 8);
+	guint16       extra_size = header[28] | (header[29] << 8);
+
+	g_assert_cmpmem (header + 30, name_size, entry->name, strlen (entry->name));
+
+	return g_strndup ((const char *) header + 30 + name_size + extra_size, entry->compressed_size);
+}
+
+
+static void
+test_read_directory (void)
+{
+	g_autoptr (GBytes) archive = NULL;
+	g_autoptr (GInputStream) istream = NULL;
+	g_autoptr (ZipDirectory) dir = NULL;
+	GError *error = NULL;
+	int     i;
+
+	archive = create_test_archive ();
+	istream = g_memory_input_stream_new_from_bytes (archive);
+	dir = zip_directory_read (istream, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (dir);
+	g_assert_cmpuint (dir->entries->len, ==, 2);
+	g_assert_true (zip_directory_names_are_utf8 (dir));
+	g_assert_cmpuint (dir->end_offset, ==, g_bytes_get_size (archive));
+
+	for (i = 0; names[i] != NULL; i++) {
+		ZipEntry *entry = g_ptr_array_index (dir->entries, i);
+		g_autofree char *content = NULL;
+
+		g_assert_cmpstr (entry->name, ==, names[i]);
+		g_assert_cmpuint (entry->crc32, ==, 0x12345678 + i);
+		g_assert_false (zip_entry_is_dir (entry));
+		content = read_entry_data (archive, entry);
+		g_assert_cmpstr (content, ==, contents[i]);
+	}
+}
+
+
+static void
+test_copy_with_rename (void)
+{
+	g_autoptr (GBytes) archive = NULL;
+	g_autoptr (GInputStream) istream = NULL;
+	g_autoptr (ZipDirectory) dir = NULL;
+	g_autoptr (GOutputStream) ostream = NULL;
+	g_autoptr (ZipWriter) writer = NULL;
+	g_autoptr (GBytes) new_archive = NULL;
+	g_autoptr (GInputStream) new_istream = NULL;
+	g_autoptr (ZipDirectory) new_dir = NULL;
+	const char *new_name = "renamed/\xc3\xa9t\xc3\xa9.txt";
+	GError     *error = NULL;
+	ZipEntry   *entry;
+	char       *content;
+
+	archive = create_test_archive ();
+	istream = g_memory_input_stream_new_from_bytes (archive);
+	dir = zip_directory_read (istream, NULL, &error);
+	g_assert_no_error (error);
+
+	/* copy the entries in reverse order, renaming the first one */
+
+	ostream = g_memory_output_stream_new_resizable ();
+	writer = zip_writer_new (ostream, 0);
+	g_assert_true (zip_writer_copy_entry (writer, istream, g_ptr_array_index (dir->entries, 1), NULL, NULL, &error));
+	g_assert_no_error (error);
+	g_assert_true (zip_writer_copy_entry (writer, istream, g_ptr_array_index (dir->entries, 0), new_name, NULL, &error));
+	g_assert_no_error (error);
+	g_assert_true (zip_writer_finish (writer, dir->comment, NULL, &error));
+	g_assert_no_error (error);
+	g_assert_true (g_output_stream_close (ostream, NULL, NULL));
+	new_archive = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (ostream));
+
+	new_istream = g_memory_input_stream_new_from_bytes (new_archive);
+	new_dir = zip_directory_read (new_istream, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_cmpuint (new_dir->entries->len, ==, 2);
+
+	entry = g_ptr_array_index (new_dir->entries, 0);
+	g_assert_cmpstr (entry->name, ==, names[1]);
+	g_assert_cmpuint (entry->local_header_offset, ==, 0);
+	content = read_entry_data (new_archive, entry);
+	g_assert_cmpstr (content, ==, contents[1]);
+	g_free (content);
+
+	entry = g_ptr_array_index (new_dir->entries, 1);
+	g_assert_cmpstr (entry->name, ==, new_name);
+	g_assert_cmpuint (entry->crc32, ==, 0x12345678);
+	g_assert_true (entry->flags & (1 << 11));
+	content = read_entry_data (new_archive, entry);
+	g_assert_cmpstr (content, ==, contents[0]);
+	g_free (content);
+}
+
+
+static void
+test_renamed_local_header (void)
+{
+	g_autoptr (GBytes) archive = NULL;
+	g_autoptr (GInputStream) istream = NULL;
+	g_autoptr (ZipDirectory) dir = NULL;
+	GError       *error = NULL;
+	ZipEntry     *entry;
+	GBytes       *header;
+	const guint8 *data;
+
+	archive = create_test_archive ();
+	istream = g_memory_input_stream_new_from_bytes (archive);
+	dir = zip_directory_read (istream, NULL, &error);
+	g_assert_no_error (error);
+
+	/* same size */
+
+	entry = g_ptr_array_index (dir->entries, 1);
+	g_assert_true (zip_entry_get_renamed_local_header (entry, istream, "dir/c.txt", &header, NULL, &error));
+	g_assert_no_error (error);
+	g_assert_nonnull (header);
+	g_assert_cmpuint (g_bytes_get_size (header), ==, 30 + strlen (names[1]));
+	data = g_bytes_get_data (header, NULL);
+	g_assert_cmpmem (data + 30, 9, "dir/c.txt", 9);
+	g_bytes_unref (header);
+
+	/* shorter, the difference is filled with a padding record */
+
+	g_assert_true (zip_entry_get_renamed_local_header (entry, istream, "c.txt", &header, NULL, &error));
+	g_assert_nonnull (header);
+	g_assert_cmpuint (g_bytes_get_size (header), ==, 30 + strlen (names[1]));
+	data = g_bytes_get_data (header, NULL);
+	g_assert_cmpuint (data[26] | (data[27] << 8), ==, 5);
+	g_assert_cmpuint (data[28] | (data[29] << 8), ==, 4);
+	g_assert_cmpuint (data[35] | (data[36] << 8), ==, 0xD935);
+	g_bytes_unref (header);
+
+	/* too short for a padding record, or longer */
+
+	g_assert_true (zip_entry_get_renamed_local_header (entry, istream, "dir/c.tx", &header, NULL, &error));
+	g_assert_null (header);
+	g_assert_true (zip_entry_get_renamed_local_header (entry, istream, "dir/c.txt2", &header, NULL, &error));
+	g_assert_null (header);
+}
+
+
+#if ENABLE_LIBARCHIVE
+
+
+static const char    *link_names[] = { "script.sh", "link", NULL };
+static const char    *link_contents[] = { "#!/bin/sh\n", "script.sh", NULL };
+static const guint32  link_modes[] = { 0100755, 0120777 };
+
+
+/* Extracts each entry reading only its local header and data, as done when
+ * extracting a few files. */
+static void
+test_read_archive_header (void)
+{
+	g_autoptr (GBytes) archive = NULL;
+	g_autoptr (GInputStream) istream = NULL;
+	g_autoptr (ZipDirectory) dir = NULL;
+	g_autofree char *root = NULL;
+	g_autofree char *script_path = NULL;
+	g_autofree char *link_path = NULL;
+	g_autofree char *target = NULL;
+	const guint8    *data;
+	GError          *error = NULL;
+	GStatBuf         buf;
+	guint            i;
+
+	archive = create_archive (link_names, link_contents, link_modes, TRUE);
+	data = g_bytes_get_data (archive, NULL);
+	istream = g_memory_input_stream_new_from_bytes (archive);
+	dir = zip_directory_read (istream, NULL, &error);
+	g_assert_no_error (error);
+
+	root = g_dir_make_tmp ("test-zip-XXXXXX", NULL);
+	g_assert_nonnull (root);
+
+	for (i = 0; i < dir->entries->len; i++) {
+		ZipEntry             *entry = g_ptr_array_index (dir->entries, i);
+		struct archive       *a;
+		struct archive       *disk;
+		struct archive_entry *archive_entry;
+		g_autofree char      *path = NULL;
+		char                  buffer[1024];
+		la_ssize_t            size;
+
+		a = archive_read_new ();
+		archive_read_support_format_zip_streamable (a);
+		g_assert_cmpint (archive_read_open_memory (a, data + entry->local_header_offset, entry->data_end - entry->local_header_offset), ==, ARCHIVE_OK);
+		g_assert_cmpint (zip_entry_read_archive_header (entry, a, &archive_entry), ==, ARCHIVE_OK);
+
+		path = g_build_filename (root, entry->name, NULL);
+		archive_entry_set_pathname (archive_entry, path);
+
+		disk = archive_write_disk_new ();
+		archive_write_disk_set_options (disk, ARCHIVE_EXTRACT_PERM);
+		g_assert_cmpint (archive_write_header (disk, archive_entry), ==, ARCHIVE_OK);
+		while ((size = archive_read_data (a, buffer, sizeof (buffer))) > 0)
+			g_assert_cmpint (archive_write_data (disk, buffer, size), ==, size);
+		g_assert_cmpint (size, ==, 0);
+		g_assert_cmpint (archive_write_finish_entry (disk), ==, ARCHIVE_OK);
+
+		archive_write_free (disk);
+		archive_read_free (a);
+	}
+
+	/* the permissions and the symbolic link are restored */
+
+	script_path = g_build_filename (root, "script.sh", NULL);
+	g_assert_cmpint (g_lstat (script_path, &buf), ==, 0);
+	g_assert_true (S_ISREG (buf.st_mode));
+	g_assert_cmpint (buf.st_mode & 0777, ==, 0755);
+
+	link_path = g_build_filename (root, "link", NULL);
+	g_assert_cmpint (g_lstat (link_path, &buf), ==, 0);
+	g_assert_true (S_ISLNK (buf.st_mode));
+	target = g_file_read_link (link_path, &error);
+	g_assert_no_error (error);
+	g_assert_cmpstr (target, ==, "script.sh");
+
+	g_unlink (link_path);
+	g_unlink (script_path);
+	g_rmdir (root);
+}
+
+
+#endif
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	g_test_init (&argc, &argv, NULL);
+	g_test_add_func ("/zip_directory_read", test_read_directory);
+	g_test_add_func ("/zip_writer_copy_entry", test_copy_with_rename);
+	g_test_add_func ("/zip_entry_get_renamed_local_header", test_renamed_local_header);
+#if ENABLE_LIBARCHIVE
+	g_test_add_func ("/zip_entry_read_archive_header", test_read_archive_header);
+#endif
+	return g_test_run ();
+}
@@ -0,0 +1,322 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  File-Roller
+ *
+ *  Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+#include <glib.h>
+#include "uring-utils.h"
+
+
+#define OPEN_FLAGS (O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC)
+
+
+#ifdef HAVE_LIBURING
+
+
+/* Whether the kernel supports the operations, io_uring can be missing or
+ * disabled by the system policy. */
+gboolean
+uring_is_available (void)
+{
+	static gsize available = 0;
+
+	if (g_once_init_enter (&available)) {
+		struct io_uring     ring;
+		struct io_uring_probe *probe;
+		gsize               result = 1;
+
+		if (io_uring_queue_init (2, &ring, 0) == 0) {
+			probe = io_uring_get_probe_ring (&ring);
+			if ((probe != NULL)
+			    && io_uring_opcode_supported (probe, IORING_OP_OPENAT)
+			    && io_uring_opcode_supported (probe, IORING_OP_WRITE)
+			    && io_uring_opcode_supported (probe, IORING_OP_CLOSE))
+			{
+				result = 2;
+			}
+			if (probe != NULL)
+				io_uring_free_probe (probe);
+			io_uring_queue_exit (&ring);
+		}
+		g_once_init_leave (&available, result);
+	}
+
+	return available == 2;
+}
+
+
+struct _UringWriter {
+	struct io_uring ring;
+	guint           max_files;
+};
+
+
+UringWriter *
+uring_writer_new (guint max_files)
+{
+	UringWriter *writer;
+
+	writer = g_new (UringWriter, 1);
+	writer->max_files = MAX (max_files, 1);
+	if (io_uring_queue_init (writer->max_files, &writer->ring, 0) < 0) {
+		g_free (writer);
+		return NULL;
+	}
+
+	return writer;
+}
+
+
+void
+uring_writer_free (UringWriter *writer)
+{
+	if (writer == NULL)
+		return;
+
+	io_uring_queue_exit (&writer->ring);
+	g_free (writer);
+}
+
+
+typedef enum {
+	URING_OP_OPEN,
+	URING_OP_WRITE,
+	URING_OP_CLOSE
+} UringOp;
+
+
+static void
+_uring_writer_submit_and_reap (UringWriter *writer,
+			       UringOp      op,
+			       UringFile   *files,
+			       int         *fds)
+{
+	struct io_uring *ring = &writer->ring;
+	guint            n_entries;
+	guint            i;
+
+	n_entries = io_uring_sq_ready (ring);
+	if (n_entries == 0)
+		return;
+
+	io_uring_submit_and_wait (ring, n_entries);
+	for (i = 0; i < n_entries; i++) {
+		struct io_uring_cqe *cqe;
+		guint                n;
+		UringFile           *file;
+
+		if (io_uring_wait_cqe (ring, &cqe) < 0)
+			break;
+
+		n = (guint) io_uring_cqe_get_data64 (cqe);
+		file = &files[n];
+		switch (op) {
+		case URING_OP_OPEN:
+			/* the result is the file descriptor */
+			file->result = cqe->res;
+			break;
+
+		case URING_OP_WRITE:
+			if (cqe->res < 0)
+				file->result = cqe->res;
+			else if ((gsize) cqe->res < file->size)
+				file->result = -EAGAIN;
+			else
+				file->result = 0;
+			break;
+
+		case URING_OP_CLOSE:
+			fds[n] = -1;
+			if ((cqe->res < 0) && (file->result == 0))
+				file->result = cqe->res;
+			break;
+		}
+		io_uring_cqe_seen (ring, cqe);
+	}
+}
+
+
+static int
+_write_all (int         fd,
+	    const char *data,
+	    gsize       size)
+{
+	while (size > 0) {
+		ssize_t n = write (fd, data, size);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		data += n;
+		size -= n;
+	}
+
+	return 0;
+}
+
+
+static void
+_uring_writer_write_some_files (UringWriter      *writer,
+				UringFile        *files,
+				guint             n_files,
+				UringWrittenFunc  written_func)
+{
+	struct io_uring *ring = &writer->ring;
+	int             *fds;
+	guint            i;
+
+	/* open all the files with a single submission */
+
+	for (i = 0; i < n_files; i++) {
+		struct io_uring_sqe *sqe = io_uring_get_sqe (ring);
+
+		io_uring_prep_openat (sqe, files[i].dir_fd, files[i].name, OPEN_FLAGS, files[i].mode);
+		io_uring_sqe_set_data64 (sqe, i);
+		files[i].result = -ECANCELED;
+	}
+	_uring_writer_submit_and_reap (writer, URING_OP_OPEN, files, NULL);
+
+	fds = g_new (int, n_files);
+	for (i = 0; i < n_files; i++) {
+		fds[i] = files[i].result;
+
+		/* replace an existing file instead of writing into it, it
+		 * could be hard linked elsewhere */
+		if ((fds[i] == -EEXIST) && (unlinkat (files[i].dir_fd, files[i].name, 0) == 0)) {
+			fds[i] = openat (files[i].dir_fd, files[i].name, OPEN_FLAGS, files[i].mode);
+			if (fds[i] < 0)
+				fds[i] = -errno;
+		}
+		files[i].result = MIN (fds[i], 0);
+	}
+
+	/* write the data with a second submission */
+
+	for (i = 0; i < n_files; i++) {
+		struct io_uring_sqe *sqe;
+
+		if (fds[i] < 0)
+			continue;
+
+		sqe = io_uring_get_sqe (ring);
+		io_uring_prep_write (sqe, fds[i], files[i].data, files[i].size, 0);
+		io_uring_sqe_set_data64 (sqe, i);
+	}
+	_uring_writer_submit_and_reap (writer, URING_OP_WRITE, files, fds);
+
+	/* complete the short writes, then let the caller set the attributes
+	 * on the open file, there are no io_uring operations for them. */
+
+	for (i = 0; i < n_files; i++) {
+		if (fds[i] < 0)
+			continue;
+
+		if (files[i].result == -EAGAIN) {
+			off_t written = lseek (fds[i], 0, SEEK_END);
+
+			if (written >= 0)
+				files[i].result = _write_all (fds[i], (const char *) files[i].data + written, files[i].size - written);
+			else
+				files[i].result = -errno;
+		}
+		if ((files[i].result == 0) && (written_func != NULL))
+			written_func (&files[i], fds[i]);
+	}
+
+	/* close the files with a third submission */
+
+	for (i = 0; i < n_files; i++) {
+		struct io_uring_sqe *sqe;
+
+		if (fds[i] < 0)
+			continue;
+
+		sqe = io_uring_get_sqe (ring);
+		io_uring_prep_close (sqe, fds[i]);
+		io_uring_sqe_set_data64 (sqe, i);
+	}
+	_uring_writer_submit_and_reap (writer, URING_OP_CLOSE, files, fds);
+
+	/* the files not closed by the ring */
+
+	for (i = 0; i < n_files; i++) {
+		if ((fds[i] >= 0) && (close (fds[i]) != 0) && (files[i].result == 0))
+			files[i].result = -errno;
+	}
+
+	g_free (fds);
+}
+
+
+void
+uring_writer_write_files (UringWriter      *writer,
+			  UringFile        *files,
+			  guint             n_files,
+			  UringWrittenFunc  written_func)
+{
+	guint i;
+
+	for (i = 0; i < n_files; i += writer->max_files)
+		_uring_writer_write_some_files (writer, files + i, MIN (n_files - i, writer->max_files), written_func);
+}
+
+
+#else /* ! HAVE_LIBURING */
+
+
+gboolean
+uring_is_available (void)
+{
+	return FALSE;
+}
+
+
+UringWriter *
+uring_writer_new (guint max_files)
+{
+	return NULL;
+}
+
+
+void
+uring_writer_free (UringWriter *writer)
+{
+}
+
+
+void
+uring_writer_write_files (UringWriter      *writer,
+			  UringFile        *files,
+			  guint             n_files,
+			  UringWrittenFunc  written_func)
+{
+	g_assert_not_reached ();
+}
+
+
+#endif
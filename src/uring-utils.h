@@ -0,0 +1,57 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  File-Roller
+ *
+ *  Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef URING_UTILS_H
+#define URING_UTILS_H
+
+#include <sys/types.h>
+#include <glib.h>
+
+/* Writes many small files with a few io_uring submissions: the files are
+ * opened with a single submission, the data is written with a second one and
+ * the files are closed with a third one.  A UringWriter keeps the ring, to
+ * reuse it for many batches of files. */
+
+typedef struct {
+	int          dir_fd;            /* the parent folder */
+	const char  *name;              /* the name in the parent folder */
+	mode_t       mode;
+	const void  *data;
+	gsize        size;
+	gpointer     user_data;
+	int          result;            /* set to 0 or to -errno */
+} UringFile;
+
+/* Called after the data is written and before the file is closed. */
+typedef void (*UringWrittenFunc) (UringFile *file,
+				  int        fd);
+
+typedef struct _UringWriter UringWriter;
+
+gboolean      uring_is_available        (void);
+UringWriter * uring_writer_new          (guint             max_files);
+void          uring_writer_free         (UringWriter      *writer);
+void          uring_writer_write_files  (UringWriter      *writer,
+					 UringFile        *files,
+					 guint             n_files,
+					 UringWrittenFunc  written_func);
+
+#endif /* URING_UTILS_H */
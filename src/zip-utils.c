@@ -0,0 +1,1093 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  File-Roller
+ *
+ *  Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <gio/gio.h>
+#if ENABLE_LIBARCHIVE
+#include <archive.h>
+#include <archive_entry.h>
+#endif
+#include "zip-utils.h"
+
+
+#define ZIP_LOCAL_HEADER_SIGNATURE        0x04034b50
+#define ZIP_CENTRAL_HEADER_SIGNATURE      0x02014b50
+#define ZIP_END_OF_CD_SIGNATURE           0x06054b50
+#define ZIP64_END_OF_CD_SIGNATURE         0x06064b50
+#define ZIP64_END_OF_CD_LOCATOR_SIGNATURE 0x07064b50
+
+#define ZIP_LOCAL_HEADER_SIZE             30
+#define ZIP_CENTRAL_HEADER_SIZE           46
+#define ZIP_END_OF_CD_SIZE                22
+#define ZIP64_END_OF_CD_SIZE              56
+#define ZIP64_END_OF_CD_LOCATOR_SIZE      20
+#define ZIP_MAX_COMMENT_SIZE              0xFFFF
+#define ZIP_DATA_DESCRIPTOR_MAX_SIZE      24
+
+#define ZIP_EXTRA_ZIP64                   0x0001
+#define ZIP_EXTRA_EXTENDED_TIMESTAMP      0x5455
+#define ZIP_EXTRA_UNICODE_PATH            0x7075
+#define ZIP_EXTRA_PADDING                 0xD935
+
+#define ZIP_FLAG_DATA_DESCRIPTOR          (1 << 3)
+#define ZIP_FLAG_UTF8                     (1 << 11)
+
+#define ZIP_MADE_BY_UNIX                  3
+#define ZIP_VERSION_ZIP64                 45
+#define ZIP_MSDOS_DIR_ATTRIBUTE           0x10
+#define ZIP_MAX_SYMLINK_SIZE              4096
+
+#define COPY_BUFFER_SIZE                  (1024 * 1024)
+
+
+struct _ZipWriter {
+	GOutputStream *ostream;
+	guint64        offset;
+	GPtrArray     *entries;
+	guchar        *buffer;
+};
+
+
+/* -- little endian helpers -- */
+
+
+static guint16
+_zip_get16 (const guchar *p)
+{
+	return (guint16) p[0] | ((guint16) p[1] << 8);
+}
+
+
+static guint32
+_zip_get32 (const guchar *p)
+{
+	return (guint32) p[0] | ((guint32) p[1] << 8) | ((guint32) p[2] << 16) | ((guint32) p[3] << 24);
+}
+
+
+static guint64
+_zip_get64 (const guchar *p)
+{
+	return (guint64) _zip_get32 (p) | ((guint64) _zip_get32 (p + 4) << 32);
+}
+
+
+static void
+_zip_set16 (guchar  *p,
+	    guint16  value)
+{
+	p[0] = value & 0xff;
+	p[1] = (value >> 8) & 0xff;
+}
+
+
+static void
+_zip_put16 (GByteArray *array,
+	    guint16     value)
+{
+	guchar b[2];
+
+	_zip_set16 (b, value);
+	g_byte_array_append (array, b, 2);
+}
+
+
+static void
+_zip_put32 (GByteArray *array,
+	    guint32     value)
+{
+	guchar b[4];
+
+	b[0] = value & 0xff;
+	b[1] = (value >> 8) & 0xff;
+	b[2] = (value >> 16) & 0xff;
+	b[3] = (value >> 24) & 0xff;
+	g_byte_array_append (array, b, 4);
+}
+
+
+static void
+_zip_put64 (GByteArray *array,
+	    guint64     value)
+{
+	_zip_put32 (array, value & 0xffffffff);
+	_zip_put32 (array, value >> 32);
+}
+
+
+static gboolean
+_zip_str_is_ascii (const char *s)
+{
+	for (; *s != '\0'; s++)
+		if ((guchar) *s >= 0x80)
+			return FALSE;
+	return TRUE;
+}
+
+
+/* Returns a copy of the extra field without the records with the given id. */
+static GBytes *
+_zip_extra_remove_record (const guchar *extra,
+			  gsize         extra_size,
+			  guint16       id)
+{
+	GByteArray   *result;
+	const guchar *p = extra;
+	const guchar *end = extra + extra_size;
+
+	result = g_byte_array_new ();
+	while (end - p >= 4) {
+		guint16 record_id = _zip_get16 (p);
+		guint16 record_size = _zip_get16 (p + 2);
+
+		if (p + 4 + record_size > end)
+			break;
+		if (record_id != id)
+			g_byte_array_append (result, p, 4 + record_size);
+		p += 4 + record_size;
+	}
+
+	return g_byte_array_free_to_bytes (result);
+}
+
+
+/* The extra field of a renamed local header: the unicode path record would
+ * override the new name and the padding is recomputed. */
+static GBytes *
+_zip_local_extra_for_rename (const guchar *extra,
+			     gsize         extra_size)
+{
+	g_autoptr (GBytes) without_path = NULL;
+	const guchar      *data;
+	gsize              size;
+
+	without_path = _zip_extra_remove_record (extra, extra_size, ZIP_EXTRA_UNICODE_PATH);
+	data = g_bytes_get_data (without_path, &size);
+
+	return _zip_extra_remove_record (data, size, ZIP_EXTRA_PADDING);
+}
+
+
+static gboolean
+_zip_extra_has_record (GBytes  *extra,
+		       guint16  id)
+{
+	gsize         size;
+	const guchar *p = g_bytes_get_data (extra, &size);
+	const guchar *end = p + size;
+
+	while ((p != NULL) && (end - p >= 4)) {
+		if (_zip_get16 (p) == id)
+			return TRUE;
+		p += 4 + _zip_get16 (p + 2);
+	}
+
+	return FALSE;
+}
+
+
+static gboolean
+_g_input_stream_read_at (GInputStream  *istream,
+			 guint64        offset,
+			 void          *buffer,
+			 gsize          size,
+			 GCancellable  *cancellable,
+			 GError       **error)
+{
+	gsize bytes_read;
+
+	if (! g_seekable_seek (G_SEEKABLE (istream), offset, G_SEEK_SET, cancellable, error))
+		return FALSE;
+
+	if (! g_input_stream_read_all (istream, buffer, size, &bytes_read, cancellable, error))
+		return FALSE;
+
+	if (bytes_read < size) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Truncated zip archive");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+/* -- ZipEntry -- */
+
+
+ZipEntry *
+zip_entry_copy (ZipEntry *entry)
+{
+	ZipEntry *copy;
+
+	copy = g_new (ZipEntry, 1);
+	*copy = *entry;
+	copy->name = g_strdup (entry->name);
+	copy->extra = g_bytes_ref (entry->extra);
+	copy->comment = g_bytes_ref (entry->comment);
+
+	return copy;
+}
+
+
+void
+zip_entry_free (ZipEntry *entry)
+{
+	if (entry == NULL)
+		return;
+	g_free (entry->name);
+	g_bytes_unref (entry->extra);
+	g_bytes_unref (entry->comment);
+	g_free (entry);
+}
+
+
+/* Changes the name stored in the central directory, the local header must be
+ * changed as well, see zip_entry_get_renamed_local_header. */
+void
+zip_entry_set_name (ZipEntry   *entry,
+		    const char *name)
+{
+	g_autoptr (GBytes) old_extra = NULL;
+	const guchar      *data;
+	gsize              size;
+
+	g_free (entry->name);
+	entry->name = g_strdup (name);
+	if (! _zip_str_is_ascii (name))
+		entry->flags |= ZIP_FLAG_UTF8;
+
+	old_extra = entry->extra;
+	data = g_bytes_get_data (old_extra, &size);
+	entry->extra = _zip_extra_remove_record (data, size, ZIP_EXTRA_UNICODE_PATH);
+}
+
+
+/* Sets @header to the local header of @entry with the name changed to
+ * @new_name and the same size of the original header, so that it can be
+ * written in place without moving the entry data.  The difference in size
+ * is filled with a padding record in the extra field.  @header is set to
+ * %NULL if the new name doesn't fit. */
+gboolean
+zip_entry_get_renamed_local_header (ZipEntry      *entry,
+				    GInputStream  *istream,
+				    const char    *new_name,
+				    GBytes       **header,
+				    GCancellable  *cancellable,
+				    GError       **error)
+{
+	guchar             fixed[ZIP_LOCAL_HEADER_SIZE];
+	guint16            name_size;
+	guint16            extra_size;
+	g_autofree guchar *old_extra = NULL;
+	g_autoptr (GBytes) new_extra = NULL;
+	gsize              new_name_size;
+	gsize              available;
+	gsize              needed;
+	gsize              padding;
+	GByteArray        *array;
+
+	*header = NULL;
+
+	if (! _g_input_stream_read_at (istream, entry->local_header_offset, fixed, ZIP_LOCAL_HEADER_SIZE, cancellable, error))
+		return FALSE;
+
+	if (_zip_get32 (fixed) != ZIP_LOCAL_HEADER_SIGNATURE) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid zip local header");
+		return FALSE;
+	}
+
+	name_size = _zip_get16 (fixed + 26);
+	extra_size = _zip_get16 (fixed + 28);
+	old_extra = g_malloc (MAX (extra_size, 1));
+	if (! _g_input_stream_read_at (istream, entry->local_header_offset + ZIP_LOCAL_HEADER_SIZE + name_size, old_extra, extra_size, cancellable, error))
+		return FALSE;
+
+	new_extra = _zip_local_extra_for_rename (old_extra, extra_size);
+	new_name_size = strlen (new_name);
+	available = name_size + extra_size;
+	needed = new_name_size + g_bytes_get_size (new_extra);
+	if (needed > available)
+		return TRUE;
+
+	/* a padding record requires at least 4 bytes */
+	padding = available - needed;
+	if ((padding > 0) && (padding < 4))
+		return TRUE;
+	if (g_bytes_get_size (new_extra) + padding > G_MAXUINT16)
+		return TRUE;
+
+	_zip_set16 (fixed + 6, _zip_get16 (fixed + 6) | (_zip_str_is_ascii (new_name) ? 0 : ZIP_FLAG_UTF8));
+	_zip_set16 (fixed + 26, new_name_size);
+	_zip_set16 (fixed + 28, g_bytes_get_size (new_extra) + padding);
+
+	array = g_byte_array_sized_new (ZIP_LOCAL_HEADER_SIZE + available);
+	g_byte_array_append (array, fixed, ZIP_LOCAL_HEADER_SIZE);
+	g_byte_array_append (array, (guchar *) new_name, new_name_size);
+	g_byte_array_append (array, g_bytes_get_data (new_extra, NULL), g_bytes_get_size (new_extra));
+	if (padding > 0) {
+		_zip_put16 (array, ZIP_EXTRA_PADDING);
+		_zip_put16 (array, padding - 4);
+		g_byte_array_set_size (array, ZIP_LOCAL_HEADER_SIZE + available);
+		memset (array->data + array->len - (padding - 4), 0, padding - 4);
+	}
+
+	*header = g_byte_array_free_to_bytes (array);
+
+	return TRUE;
+}
+
+
+mode_t
+zip_entry_get_mode (ZipEntry *entry)
+{
+	mode_t mode = 0;
+
+	if ((entry->version_made_by >> 8) == ZIP_MADE_BY_UNIX)
+		mode = entry->external_attributes >> 16;
+
+	if ((mode & S_IFMT) == 0) {
+		if (g_str_has_suffix (entry->name, "/") || (entry->external_attributes & ZIP_MSDOS_DIR_ATTRIBUTE))
+			mode |= S_IFDIR | ((mode & 0777) ? 0 : 0755);
+		else
+			mode |= S_IFREG | ((mode & 0777) ? 0 : 0644);
+	}
+
+	return mode;
+}
+
+
+#if ENABLE_LIBARCHIVE
+
+
+/* Reads the header of @entry with a streamable libarchive reader, which only
+ * sees the local header: the file type and the permissions are taken from
+ * the central directory, and the target of a symbolic link from the entry
+ * data. */
+int
+zip_entry_read_archive_header (ZipEntry              *entry,
+			       struct archive        *a,
+			       struct archive_entry **archive_entry)
+{
+	mode_t   mode;
+	GString *target;
+	char     buffer[1024];
+	ssize_t  size;
+	int      r;
+
+	r = archive_read_next_header (a, archive_entry);
+	if (r != ARCHIVE_OK)
+		return r;
+
+	mode = zip_entry_get_mode (entry);
+	if (! S_ISLNK (mode)) {
+		archive_entry_set_mode (*archive_entry, mode);
+		return r;
+	}
+
+	target = g_string_new (NULL);
+	while ((size = archive_read_data (a, buffer, sizeof (buffer))) > 0) {
+		if (target->len + size > ZIP_MAX_SYMLINK_SIZE) {
+			archive_set_error (a, ARCHIVE_ERRNO_FILE_FORMAT, "Symbolic link target too long");
+			size = ARCHIVE_FATAL;
+			break;
+		}
+		g_string_append_len (target, buffer, size);
+	}
+
+	if (size < 0)
+		r = (int) size;
+	else {
+		archive_entry_set_mode (*archive_entry, mode);
+		archive_entry_set_size (*archive_entry, 0);
+		archive_entry_set_symlink (*archive_entry, target->str);
+	}
+	g_string_free (target, TRUE);
+
+	return r;
+}
+
+
+#endif
+
+
+gboolean
+zip_entry_is_dir (ZipEntry *entry)
+{
+	return S_ISDIR (zip_entry_get_mode (entry));
+}
+
+
+gboolean
+zip_entry_is_symlink (ZipEntry *entry)
+{
+	return S_ISLNK (zip_entry_get_mode (entry));
+}
+
+
+time_t
+zip_entry_get_mtime (ZipEntry *entry)
+{
+	gsize         size;
+	const guchar *p = g_bytes_get_data (entry->extra, &size);
+	const guchar *end = p + size;
+	GDateTime    *date_time;
+	time_t        mtime;
+
+	/* prefer the extended timestamp, it is in UTC and has a better
+	 * resolution than the MS-DOS time. */
+
+	while ((p != NULL) && (end - p >= 4)) {
+		guint16 id = _zip_get16 (p);
+		guint16 record_size = _zip_get16 (p + 2);
+
+		if (p + 4 + record_size > end)
+			break;
+		if ((id == ZIP_EXTRA_EXTENDED_TIMESTAMP) && (record_size >= 5) && (p[4] & 0x01))
+			return (gint32) _zip_get32 (p + 5);
+		p += 4 + record_size;
+	}
+
+	date_time = g_date_time_new_local (((entry->dos_date >> 9) & 0x7f) + 1980,
+					   CLAMP ((entry->dos_date >> 5) & 0x0f, 1, 12),
+					   CLAMP (entry->dos_date & 0x1f, 1, 31),
+					   MIN ((entry->dos_time >> 11) & 0x1f, 23),
+					   MIN ((entry->dos_time >> 5) & 0x3f, 59),
+					   MIN ((entry->dos_time & 0x1f) * 2, 59));
+	if (date_time == NULL)
+		return 0;
+
+	mtime = g_date_time_to_unix (date_time);
+	g_date_time_unref (date_time);
+
+	return mtime;
+}
+
+
+/* -- ZipDirectory -- */
+
+
+static void
+_zip_entry_set_extra (ZipEntry     *entry,
+		      const guchar *extra,
+		      gsize         extra_size)
+{
+	const guchar *p = extra;
+	const guchar *end = extra + extra_size;
+
+	/* the zip64 record overrides the saturated header fields, in this
+	 * order: uncompressed size, compressed size, local header offset. */
+
+	while (end - p >= 4) {
+		guint16       id = _zip_get16 (p);
+		guint16       record_size = _zip_get16 (p + 2);
+		const guchar *data = p + 4;
+		const guchar *data_end = data + record_size;
+
+		if (data_end > end)
+			break;
+
+		if (id == ZIP_EXTRA_ZIP64) {
+			if ((entry->uncompressed_size == 0xFFFFFFFF) && (data + 8 <= data_end)) {
+				entry->uncompressed_size = _zip_get64 (data);
+				data += 8;
+			}
+			if ((entry->compressed_size == 0xFFFFFFFF) && (data + 8 <= data_end)) {
+				entry->compressed_size = _zip_get64 (data);
+				data += 8;
+			}
+			if ((entry->local_header_offset == 0xFFFFFFFF) && (data + 8 <= data_end))
+				entry->local_header_offset = _zip_get64 (data);
+		}
+
+		p = data_end;
+	}
+
+	entry->extra = _zip_extra_remove_record (extra, extra_size, ZIP_EXTRA_ZIP64);
+}
+
+
+static int
+_zip_entry_compare_by_offset (gconstpointer a,
+			      gconstpointer b)
+{
+	ZipEntry *entry_a = *((ZipEntry **) a);
+	ZipEntry *entry_b = *((ZipEntry **) b);
+
+	if (entry_a->local_header_offset < entry_b->local_header_offset)
+		return -1;
+	if (entry_a->local_header_offset > entry_b->local_header_offset)
+		return 1;
+	return 0;
+}
+
+
+static gboolean
+_zip_directory_read_entries (ZipDirectory  *dir,
+			     const guchar  *cd,
+			     guint64        n_entries,
+			     GError       **error)
+{
+	const guchar *p = cd;
+	const guchar *end = cd + dir->cd_size;
+	g_autoptr (GPtrArray) sorted = NULL;
+	guint64       i;
+
+	for (i = 0; i < n_entries; i++) {
+		ZipEntry *entry;
+		guint16   name_size;
+		guint16   extra_size;
+		guint16   comment_size;
+
+		if ((end - p < ZIP_CENTRAL_HEADER_SIZE) || (_zip_get32 (p) != ZIP_CENTRAL_HEADER_SIGNATURE)) {
+			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid zip central directory");
+			return FALSE;
+		}
+
+		name_size = _zip_get16 (p + 28);
+		extra_size = _zip_get16 (p + 30);
+		comment_size = _zip_get16 (p + 32);
+		if ((p + ZIP_CENTRAL_HEADER_SIZE + name_size + extra_size + comment_size > end)
+		    || (memchr (p + ZIP_CENTRAL_HEADER_SIZE, 0, name_size) != NULL))
+		{
+			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid zip central directory");
+			return FALSE;
+		}
+
+		entry = g_new0 (ZipEntry, 1);
+		entry->version_made_by = _zip_get16 (p + 4);
+		entry->version_needed = _zip_get16 (p + 6);
+		entry->flags = _zip_get16 (p + 8);
+		entry->method = _zip_get16 (p + 10);
+		entry->dos_time = _zip_get16 (p + 12);
+		entry->dos_date = _zip_get16 (p + 14);
+		entry->crc32 = _zip_get32 (p + 16);
+		entry->compressed_size = _zip_get32 (p + 20);
+		entry->uncompressed_size = _zip_get32 (p + 24);
+		entry->internal_attributes = _zip_get16 (p + 36);
+		entry->external_attributes = _zip_get32 (p + 38);
+		entry->local_header_offset = _zip_get32 (p + 42);
+		entry->name = g_strndup ((const char *) p + ZIP_CENTRAL_HEADER_SIZE, name_size);
+		_zip_entry_set_extra (entry, p + ZIP_CENTRAL_HEADER_SIZE + name_size, extra_size);
+		entry->comment = g_bytes_new (p + ZIP_CENTRAL_HEADER_SIZE + name_size + extra_size, comment_size);
+		g_ptr_array_add (dir->entries, entry);
+
+		p += ZIP_CENTRAL_HEADER_SIZE + name_size + extra_size + comment_size;
+	}
+
+	/* the data of an entry cannot go beyond the next local header */
+
+	sorted = g_ptr_array_sized_new (dir->entries->len);
+	for (i = 0; i < dir->entries->len; i++)
+		g_ptr_array_add (sorted, g_ptr_array_index (dir->entries, i));
+	g_ptr_array_sort (sorted, _zip_entry_compare_by_offset);
+
+	for (i = 0; i < sorted->len; i++) {
+		ZipEntry *entry = g_ptr_array_index (sorted, i);
+
+		if (i + 1 < sorted->len)
+			entry->data_end = ((ZipEntry *) g_ptr_array_index (sorted, i + 1))->local_header_offset;
+		else
+			entry->data_end = dir->cd_offset;
+
+		if (entry->data_end < entry->local_header_offset + ZIP_LOCAL_HEADER_SIZE + entry->compressed_size) {
+			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Overlapping zip entries");
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+
+/* An empty directory, for an archive that doesn't exist yet. */
+ZipDirectory *
+zip_directory_new (void)
+{
+	ZipDirectory *dir;
+
+	dir = g_new0 (ZipDirectory, 1);
+	dir->entries = g_ptr_array_new_with_free_func ((GDestroyNotify) zip_entry_free);
+
+	return dir;
+}
+
+
+ZipDirectory *
+zip_directory_read (GInputStream  *istream,
+		    GCancellable  *cancellable,
+		    GError       **error)
+{
+	g_autoptr (ZipDirectory) dir = NULL;
+	g_autofree guchar *tail = NULL;
+	g_autofree guchar *cd = NULL;
+	guint64  archive_size;
+	gsize    tail_size;
+	guint64  tail_offset;
+	gssize   i;
+	guchar  *eocd = NULL;
+	guint64  eocd_offset;
+	guint64  cd_end;
+	guint64  n_entries;
+	guint16  comment_size;
+
+	if (! G_IS_SEEKABLE (istream) || ! g_seekable_can_seek (G_SEEKABLE (istream))) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "The archive stream is not seekable");
+		return NULL;
+	}
+
+	if (! g_seekable_seek (G_SEEKABLE (istream), 0, G_SEEK_END, cancellable, error))
+		return NULL;
+	archive_size = g_seekable_tell (G_SEEKABLE (istream));
+	if (archive_size < ZIP_END_OF_CD_SIZE) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid zip archive");
+		return NULL;
+	}
+
+	/* find the end of central directory record, it's followed by a
+	 * comment of at most 64k */
+
+	tail_size = MIN (archive_size, ZIP_END_OF_CD_SIZE + ZIP_MAX_COMMENT_SIZE);
+	tail_offset = archive_size - tail_size;
+	tail = g_malloc (tail_size);
+	if (! _g_input_stream_read_at (istream, tail_offset, tail, tail_size, cancellable, error))
+		return NULL;
+
+	for (i = tail_size - ZIP_END_OF_CD_SIZE; i >= 0; i--) {
+		if ((_zip_get32 (tail + i) == ZIP_END_OF_CD_SIGNATURE)
+		    && (i + ZIP_END_OF_CD_SIZE + _zip_get16 (tail + i + 20) <= tail_size))
+		{
+			eocd = tail + i;
+			break;
+		}
+	}
+
+	if (eocd == NULL) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid zip archive");
+		return NULL;
+	}
+
+	if ((_zip_get16 (eocd + 4) != 0) || (_zip_get16 (eocd + 6) != 0)) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "Multi-volume zip archives are not supported");
+		return NULL;
+	}
+
+	dir = zip_directory_new ();
+
+	eocd_offset = tail_offset + (eocd - tail);
+	n_entries = _zip_get16 (eocd + 10);
+	dir->cd_size = _zip_get32 (eocd + 12);
+	dir->cd_offset = _zip_get32 (eocd + 16);
+	comment_size = _zip_get16 (eocd + 20);
+	dir->comment = g_bytes_new (eocd + ZIP_END_OF_CD_SIZE, comment_size);
+	dir->end_offset = eocd_offset + ZIP_END_OF_CD_SIZE + comment_size;
+	cd_end = eocd_offset;
+
+	/* zip64 */
+
+	if (eocd_offset >= ZIP64_END_OF_CD_LOCATOR_SIZE) {
+		guchar locator[ZIP64_END_OF_CD_LOCATOR_SIZE];
+
+		if (! _g_input_stream_read_at (istream, eocd_offset - ZIP64_END_OF_CD_LOCATOR_SIZE, locator, ZIP64_END_OF_CD_LOCATOR_SIZE, cancellable, error))
+			return NULL;
+
+		if (_zip_get32 (locator) == ZIP64_END_OF_CD_LOCATOR_SIGNATURE) {
+			guchar  record[ZIP64_END_OF_CD_SIZE];
+			guint64 record_offset = _zip_get64 (locator + 8);
+
+			if ((record_offset + ZIP64_END_OF_CD_SIZE > eocd_offset - ZIP64_END_OF_CD_LOCATOR_SIZE)
+			    || ! _g_input_stream_read_at (istream, record_offset, record, ZIP64_END_OF_CD_SIZE, cancellable, NULL)
+			    || (_zip_get32 (record) != ZIP64_END_OF_CD_SIGNATURE))
+			{
+				g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid zip64 end of central directory");
+				return NULL;
+			}
+
+			n_entries = _zip_get64 (record + 32);
+			dir->cd_size = _zip_get64 (record + 40);
+			dir->cd_offset = _zip_get64 (record + 48);
+			cd_end = record_offset;
+		}
+	}
+
+	if ((dir->cd_offset > cd_end) || (dir->cd_size > cd_end - dir->cd_offset) || (n_entries > dir->cd_size / ZIP_CENTRAL_HEADER_SIZE)) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid zip central directory");
+		return NULL;
+	}
+
+	cd = g_try_malloc (MAX (dir->cd_size, 1));
+	if (cd == NULL) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE, "Zip central directory too large");
+		return NULL;
+	}
+
+	if (! _g_input_stream_read_at (istream, dir->cd_offset, cd, dir->cd_size, cancellable, error))
+		return NULL;
+
+	if (! _zip_directory_read_entries (dir, cd, n_entries, error))
+		return NULL;
+
+	return g_steal_pointer (&dir);
+}
+
+
+void
+zip_directory_free (ZipDirectory *dir)
+{
+	if (dir == NULL)
+		return;
+	g_ptr_array_unref (dir->entries);
+	if (dir->comment != NULL)
+		g_bytes_unref (dir->comment);
+	g_free (dir);
+}
+
+
+/* Whether the stored names are the same names libarchive reports, that is
+ * they are UTF-8 and not overridden by an Info-ZIP unicode path record. */
+gboolean
+zip_directory_names_are_utf8 (ZipDirectory *dir)
+{
+	guint i;
+
+	for (i = 0; i < dir->entries->len; i++) {
+		ZipEntry *entry = g_ptr_array_index (dir->entries, i);
+
+		if (! g_utf8_validate (entry->name, -1, NULL))
+			return FALSE;
+		if (_zip_extra_has_record (entry->extra, ZIP_EXTRA_UNICODE_PATH))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+/* -- ZipWriter -- */
+
+
+ZipWriter *
+zip_writer_new (GOutputStream *ostream,
+		guint64        offset)
+{
+	ZipWriter *writer;
+
+	writer = g_new0 (ZipWriter, 1);
+	writer->ostream = g_object_ref (ostream);
+	writer->offset = offset;
+	writer->entries = g_ptr_array_new_with_free_func ((GDestroyNotify) zip_entry_free);
+	writer->buffer = g_malloc (COPY_BUFFER_SIZE);
+
+	return writer;
+}
+
+
+void
+zip_writer_free (ZipWriter *writer)
+{
+	if (writer == NULL)
+		return;
+	g_object_unref (writer->ostream);
+	g_ptr_array_unref (writer->entries);
+	g_free (writer->buffer);
+	g_free (writer);
+}
+
+
+guint64
+zip_writer_get_offset (ZipWriter *writer)
+{
+	return writer->offset;
+}
+
+
+static gboolean
+_zip_writer_write (ZipWriter     *writer,
+		   const void    *buffer,
+		   gsize          size,
+		   GCancellable  *cancellable,
+		   GError       **error)
+{
+	gsize bytes_written;
+
+	if (! g_output_stream_write_all (writer->ostream, buffer, size, &bytes_written, cancellable, error))
+		return FALSE;
+	writer->offset += bytes_written;
+
+	return TRUE;
+}
+
+
+static gboolean
+_zip_writer_copy_range (ZipWriter     *writer,
+			GInputStream  *istream,
+			guint64        offset,
+			guint64        size,
+			GCancellable  *cancellable,
+			GError       **error)
+{
+	if (! g_seekable_seek (G_SEEKABLE (istream), offset, G_SEEK_SET, cancellable, error))
+		return FALSE;
+
+	while (size > 0) {
+		gsize bytes_read;
+
+		if (! g_input_stream_read_all (istream, writer->buffer, MIN (size, COPY_BUFFER_SIZE), &bytes_read, cancellable, error))
+			return FALSE;
+		if (bytes_read == 0) {
+			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Truncated zip archive");
+			return FALSE;
+		}
+		if (! _zip_writer_write (writer, writer->buffer, bytes_read, cancellable, error))
+			return FALSE;
+		size -= bytes_read;
+	}
+
+	return TRUE;
+}
+
+
+/* Adds an entry to the central directory without writing its data,
+ * used when the entry is already at the right offset. */
+void
+zip_writer_keep_entry (ZipWriter *writer,
+		       ZipEntry  *entry)
+{
+	g_ptr_array_add (writer->entries, zip_entry_copy (entry));
+}
+
+
+/* Copies the local header and the compressed data of @entry verbatim,
+ * changing only the stored name if @new_name is not %NULL. */
+gboolean
+zip_writer_copy_entry (ZipWriter     *writer,
+		       GInputStream  *istream,
+		       ZipEntry      *entry,
+		       const char    *new_name,
+		       GCancellable  *cancellable,
+		       GError       **error)
+{
+	guchar    header[ZIP_LOCAL_HEADER_SIZE];
+	guint16   name_size;
+	guint16   extra_size;
+	guint64   data_start;
+	guint64   data_end;
+	ZipEntry *new_entry;
+
+	if (! _g_input_stream_read_at (istream, entry->local_header_offset, header, ZIP_LOCAL_HEADER_SIZE, cancellable, error))
+		return FALSE;
+
+	if (_zip_get32 (header) != ZIP_LOCAL_HEADER_SIGNATURE) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid zip local header");
+		return FALSE;
+	}
+
+	name_size = _zip_get16 (header + 26);
+	extra_size = _zip_get16 (header + 28);
+	data_start = entry->local_header_offset + ZIP_LOCAL_HEADER_SIZE + name_size + extra_size;
+	data_end = data_start + entry->compressed_size;
+	if (entry->flags & ZIP_FLAG_DATA_DESCRIPTOR)
+		data_end += ZIP_DATA_DESCRIPTOR_MAX_SIZE;
+	data_end = MIN (data_end, entry->data_end);
+	if (data_end < data_start + entry->compressed_size) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid zip local header");
+		return FALSE;
+	}
+
+	if ((new_name != NULL) && (strlen (new_name) > G_MAXUINT16)) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_FILENAME, "File name too long");
+		return FALSE;
+	}
+
+	new_entry = zip_entry_copy (entry);
+	new_entry->local_header_offset = writer->offset;
+
+	if ((new_name == NULL) || (strcmp (new_name, entry->name) == 0)) {
+		if (! _zip_writer_copy_range (writer, istream, entry->local_header_offset, data_end - entry->local_header_offset, cancellable, error)) {
+			zip_entry_free (new_entry);
+			return FALSE;
+		}
+	}
+	else {
+		g_autofree guchar *old_extra = NULL;
+		g_autoptr (GBytes) local_extra = NULL;
+		const guchar      *data;
+		gsize              size;
+		gboolean           success;
+
+		old_extra = g_malloc (MAX (extra_size, 1));
+		if (! _g_input_stream_read_at (istream, entry->local_header_offset + ZIP_LOCAL_HEADER_SIZE + name_size, old_extra, extra_size, cancellable, error)) {
+			zip_entry_free (new_entry);
+			return FALSE;
+		}
+		local_extra = _zip_local_extra_for_rename (old_extra, extra_size);
+		zip_entry_set_name (new_entry, new_name);
+
+		_zip_set16 (header + 6, new_entry->flags);
+		_zip_set16 (header + 26, strlen (new_name));
+		_zip_set16 (header + 28, g_bytes_get_size (local_extra));
+
+		data = g_bytes_get_data (local_extra, &size);
+		success = _zip_writer_write (writer, header, ZIP_LOCAL_HEADER_SIZE, cancellable, error)
+			  && _zip_writer_write (writer, new_name, strlen (new_name), cancellable, error)
+			  && ((size == 0) || _zip_writer_write (writer, data, size, cancellable, error))
+			  && _zip_writer_copy_range (writer, istream, data_start, data_end - data_start, cancellable, error);
+		if (! success) {
+			zip_entry_free (new_entry);
+			return FALSE;
+		}
+	}
+
+	new_entry->data_end = writer->offset;
+	g_ptr_array_add (writer->entries, new_entry);
+
+	return TRUE;
+}
+
+
+static void
+_zip_append_central_header (GByteArray *array,
+			    ZipEntry   *entry)
+{
+	gboolean      zip64_uncompressed_size;
+	gboolean      zip64_compressed_size;
+	gboolean      zip64_offset;
+	guint16       zip64_size;
+	const guchar *extra;
+	gsize         extra_size;
+	gsize         comment_size;
+	const guchar *comment;
+
+	zip64_uncompressed_size = entry->uncompressed_size >= 0xFFFFFFFF;
+	zip64_compressed_size = entry->compressed_size >= 0xFFFFFFFF;
+	zip64_offset = entry->local_header_offset >= 0xFFFFFFFF;
+	zip64_size = 8 * (zip64_uncompressed_size + zip64_compressed_size + zip64_offset);
+
+	extra = g_bytes_get_data (entry->extra, &extra_size);
+	if ((zip64_size > 0 ? 4 + zip64_size : 0) + extra_size > G_MAXUINT16)
+		extra_size = 0;
+	comment = g_bytes_get_data (entry->comment, &comment_size);
+
+	_zip_put32 (array, ZIP_CENTRAL_HEADER_SIGNATURE);
+	_zip_put16 (array, entry->version_made_by);
+	_zip_put16 (array, (zip64_size > 0) ? MAX (entry->version_needed, ZIP_VERSION_ZIP64) : entry->version_needed);
+	_zip_put16 (array, entry->flags);
+	_zip_put16 (array, entry->method);
+	_zip_put16 (array, entry->dos_time);
+	_zip_put16 (array, entry->dos_date);
+	_zip_put32 (array, entry->crc32);
+	_zip_put32 (array, zip64_compressed_size ? 0xFFFFFFFF : entry->compressed_size);
+	_zip_put32 (array, zip64_uncompressed_size ? 0xFFFFFFFF : entry->uncompressed_size);
+	_zip_put16 (array, strlen (entry->name));
+	_zip_put16 (array, (zip64_size > 0 ? 4 + zip64_size : 0) + extra_size);
+	_zip_put16 (array, comment_size);
+	_zip_put16 (array, 0);
+	_zip_put16 (array, entry->internal_attributes);
+	_zip_put32 (array, entry->external_attributes);
+	_zip_put32 (array, zip64_offset ? 0xFFFFFFFF : entry->local_header_offset);
+	g_byte_array_append (array, (guchar *) entry->name, strlen (entry->name));
+	if (zip64_size > 0) {
+		_zip_put16 (array, ZIP_EXTRA_ZIP64);
+		_zip_put16 (array, zip64_size);
+		if (zip64_uncompressed_size)
+			_zip_put64 (array, entry->uncompressed_size);
+		if (zip64_compressed_size)
+			_zip_put64 (array, entry->compressed_size);
+		if (zip64_offset)
+			_zip_put64 (array, entry->local_header_offset);
+	}
+	if (extra_size > 0)
+		g_byte_array_append (array, extra, extra_size);
+	if (comment_size > 0)
+		g_byte_array_append (array, comment, comment_size);
+}
+
+
+/* Writes the central directory and the end of central directory records
+ * for all the entries copied or kept so far. */
+gboolean
+zip_writer_finish (ZipWriter     *writer,
+		   GBytes        *comment,
+		   GCancellable  *cancellable,
+		   GError       **error)
+{
+	g_autoptr (GByteArray) buffer = NULL;
+	guint64 cd_offset;
+	guint64 cd_size;
+	guint64 n_entries;
+	guint   i;
+
+	buffer = g_byte_array_sized_new (COPY_BUFFER_SIZE);
+	cd_offset = writer->offset;
+	for (i = 0; i < writer->entries->len; i++) {
+		_zip_append_central_header (buffer, g_ptr_array_index (writer->entries, i));
+		if (buffer->len >= COPY_BUFFER_SIZE) {
+			if (! _zip_writer_write (writer, buffer->data, buffer->len, cancellable, error))
+				return FALSE;
+			g_byte_array_set_size (buffer, 0);
+		}
+	}
+	cd_size = writer->offset + buffer->len - cd_offset;
+	n_entries = writer->entries->len;
+
+	if ((n_entries >= 0xFFFF) || (cd_size >= 0xFFFFFFFF) || (cd_offset >= 0xFFFFFFFF)) {
+		guint64 record_offset = writer->offset + buffer->len;
+
+		_zip_put32 (buffer, ZIP64_END_OF_CD_SIGNATURE);
+		_zip_put64 (buffer, ZIP64_END_OF_CD_SIZE - 12);
+		_zip_put16 (buffer, ZIP_VERSION_ZIP64);
+		_zip_put16 (buffer, ZIP_VERSION_ZIP64);
+		_zip_put32 (buffer, 0);
+		_zip_put32 (buffer, 0);
+		_zip_put64 (buffer, n_entries);
+		_zip_put64 (buffer, n_entries);
+		_zip_put64 (buffer, cd_size);
+		_zip_put64 (buffer, cd_offset);
+
+		_zip_put32 (buffer, ZIP64_END_OF_CD_LOCATOR_SIGNATURE);
+		_zip_put32 (buffer, 0);
+		_zip_put64 (buffer, record_offset);
+		_zip_put32 (buffer, 1);
+	}
+
+	_zip_put32 (buffer, ZIP_END_OF_CD_SIGNATURE);
+	_zip_put16 (buffer, 0);
+	_zip_put16 (buffer, 0);
+	_zip_put16 (buffer, MIN (n_entries, 0xFFFF));
+	_zip_put16 (buffer, MIN (n_entries, 0xFFFF));
+	_zip_put32 (buffer, MIN (cd_size, 0xFFFFFFFF));
+	_zip_put32 (buffer, MIN (cd_offset, 0xFFFFFFFF));
+	if (comment != NULL) {
+		gsize         comment_size;
+		const guchar *data = g_bytes_get_data (comment, &comment_size);
+
+		comment_size = MIN (comment_size, ZIP_MAX_COMMENT_SIZE);
+		_zip_put16 (buffer, comment_size);
+		if (comment_size > 0)
+			g_byte_array_append (buffer, data, comment_size);
+	}
+	else
+		_zip_put16 (buffer, 0);
+
+	return _zip_writer_write (writer, buffer->data, buffer->len, cancellable, error);
+}
@@ -0,0 +1,119 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/*
+ *  File-Roller
+ *
+ *  Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZIP_UTILS_H
+#define ZIP_UTILS_H
+
+#include <sys/types.h>
+#include <time.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+typedef struct {
+	char     *name;                 /* name as stored in the archive */
+	guint16   version_made_by;
+	guint16   version_needed;
+	guint16   flags;
+	guint16   method;
+	guint16   dos_time;
+	guint16   dos_date;
+	guint32   crc32;
+	guint64   compressed_size;
+	guint64   uncompressed_size;
+	guint16   internal_attributes;
+	guint32   external_attributes;
+	guint64   local_header_offset;
+	guint64   data_end;             /* where the entry data (and the data
+					 * descriptor, if any) ends. */
+	GBytes   *extra;                /* central directory extra field
+					 * without the zip64 record. */
+	GBytes   *comment;
+} ZipEntry;
+
+typedef struct {
+	GPtrArray *entries;             /* ZipEntry, in central directory order */
+	guint64    cd_offset;
+	guint64    cd_size;
+	guint64    end_offset;          /* size of the archive */
+	GBytes    *comment;
+} ZipDirectory;
+
+typedef struct _ZipWriter ZipWriter;
+
+/* ZipEntry */
+
+ZipEntry *     zip_entry_copy               (ZipEntry      *entry);
+void           zip_entry_free               (ZipEntry      *entry);
+gboolean       zip_entry_is_dir             (ZipEntry      *entry);
+gboolean       zip_entry_is_symlink         (ZipEntry      *entry);
+void           zip_entry_set_name           (ZipEntry      *entry,
+					     const char    *name);
+gboolean       zip_entry_get_renamed_local_header
+					    (ZipEntry      *entry,
+					     GInputStream  *istream,
+					     const char    *new_name,
+					     GBytes       **header,
+					     GCancellable  *cancellable,
+					     GError       **error);
+mode_t         zip_entry_get_mode           (ZipEntry      *entry);
+time_t         zip_entry_get_mtime          (ZipEntry      *entry);
+#if ENABLE_LIBARCHIVE
+struct archive;
+struct archive_entry;
+int            zip_entry_read_archive_header
+					    (ZipEntry      *entry,
+					     struct archive *a,
+					     struct archive_entry **archive_entry);
+#endif
+
+/* ZipDirectory */
+
+ZipDirectory * zip_directory_new            (void);
+ZipDirectory * zip_directory_read           (GInputStream  *istream,
+					     GCancellable  *cancellable,
+					     GError       **error);
+void           zip_directory_free           (ZipDirectory  *dir);
+gboolean       zip_directory_names_are_utf8 (ZipDirectory  *dir);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (ZipDirectory, zip_directory_free)
+
+/* ZipWriter */
+
+ZipWriter *    zip_writer_new               (GOutputStream *ostream,
+					     guint64        offset);
+void           zip_writer_free              (ZipWriter     *writer);
+guint64        zip_writer_get_offset        (ZipWriter     *writer);
+void           zip_writer_keep_entry        (ZipWriter     *writer,
+					     ZipEntry      *entry);
+gboolean       zip_writer_copy_entry        (ZipWriter     *writer,
+					     GInputStream  *istream,
+					     ZipEntry      *entry,
+					     const char    *new_name,
+					     GCancellable  *cancellable,
+					     GError       **error);
+gboolean       zip_writer_finish            (ZipWriter     *writer,
+					     GBytes        *comment,
+					     GCancellable  *cancellable,
+					     GError       **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (ZipWriter, zip_writer_free)
+
+#endif /* ZIP_UTILS_H */